@@ -9,11 +9,13 @@ extern "C" {
 #include <netinet/ip.h>
 #include <netinet/tcp.h>
 #include <netinet/udp.h>
+#include <netinet/ip_icmp.h>
 #include <arpa/inet.h>
 
 uint16_t cksumIp(iphdr* pIpHead);
 uint16_t cksumTcp(iphdr* pIpHead, tcphdr* pTcpHead);
 uint16_t cksumUdp(iphdr* pIpHead, udphdr* pUdpHead);
+uint16_t cksumIcmp(iphdr* pIpHead, icmphdr* pIcmpHead);
 
 #ifdef __cplusplus
 }
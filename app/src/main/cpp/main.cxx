@@ -55,6 +55,26 @@ Java_com_matthew_ipblocker_interceptor_services_TunModeService_setupNative(JNIEn
 	tunmode::initialize(env, TunModeService_object);
 }
 
+extern "C"
+JNIEXPORT jstring JNICALL
+Java_com_matthew_ipblocker_interceptor_services_TunModeService_planRoutesNative(JNIEnv* env, jclass cls, jint max_routes, jstring allowed_ips)
+{
+	std::string routes;
+
+	if (allowed_ips)
+	{
+		const char* str_allowed_ips = env->GetStringUTFChars(allowed_ips, NULL);
+		routes = tunmode::plan_routes(max_routes > 0 ? (size_t)max_routes : 0, str_allowed_ips);
+		env->ReleaseStringUTFChars(allowed_ips, str_allowed_ips);
+	}
+	else
+	{
+		routes = tunmode::plan_routes(max_routes > 0 ? (size_t)max_routes : 0, NULL);
+	}
+
+	return env->NewStringUTF(routes.c_str());
+}
+
 extern "C"
 JNIEXPORT jint JNICALL
 JNI_OnLoad(JavaVM* vm, void* reserved)
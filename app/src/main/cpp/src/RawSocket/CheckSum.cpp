@@ -60,3 +60,12 @@ uint16_t cksumUdp(iphdr* pIpHead, udphdr* pUdpHead){
   uint16_t cksum16 = htons((uint16_t)~ckSum);
   return (cksum16 == 0 ? 0xFFFF : cksum16);
 }
+
+uint16_t cksumIcmp(iphdr* pIpHead, icmphdr* pIcmpHead){
+  pIcmpHead->checksum = 0;
+  uint32_t ckSum = CalSum((uint8_t*)pIcmpHead,
+      ntohs(pIpHead->tot_len) - pIpHead->ihl * 4);
+  ckSum = (ckSum >> 16) + (ckSum & 0xffff);
+  ckSum += ckSum >> 16;
+  return htons((uint16_t)~ckSum);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+
+namespace tunmode
+{
+	/*
+	 * Append-only array shared between immutable snapshots.
+	 *
+	 * Snapshots only read the prefix that existed when they were made,
+	 * so a single writer may keep appending. Growing never moves data
+	 * under a reader: it copies into a new arena and the old one stays
+	 * alive for as long as a snapshot references it.
+	 */
+	template <typename T>
+	class Arena
+	{
+	public:
+		Arena(size_t capacity) : data{new T[capacity ? capacity : 1]}, size{0}, capacity{capacity ? capacity : 1} {}
+
+		~Arena()
+		{
+			delete[] this->data;
+		}
+
+		Arena(const Arena&) = delete;
+		Arena& operator=(const Arena&) = delete;
+
+		T*     get_data() const { return this->data; }
+		size_t get_size() const { return this->size; }
+		size_t get_capacity() const { return this->capacity; }
+
+		/* Returns the index of `count` new elements, growing `arena` if needed */
+		static size_t append(std::shared_ptr<Arena<T>>& arena, size_t count)
+		{
+			if (arena->size + count > arena->capacity)
+			{
+				size_t capacity = arena->capacity * 2;
+
+				while (capacity < arena->size + count)
+					capacity *= 2;
+
+				std::shared_ptr<Arena<T>> grown = std::make_shared<Arena<T>>(capacity);
+				memcpy((void*)grown->data, arena->data, arena->size * sizeof(T));
+				grown->size = arena->size;
+				arena = std::move(grown);
+			}
+
+			size_t index = arena->size;
+			arena->size += count;
+			return index;
+		}
+
+	private:
+		T* data;
+		size_t size;
+		size_t capacity;
+	};
+}
@@ -0,0 +1,299 @@
+#include <tunmode/common/iouring.hpp>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include <misc/logger.hpp>
+
+namespace tunmode
+{
+	namespace
+	{
+		inline int _setup(unsigned entries, struct io_uring_params* params)
+		{
+			return (int)syscall(__NR_io_uring_setup, entries, params);
+		}
+
+		inline int _enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void* arg, size_t arg_size)
+		{
+			return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size);
+		}
+
+		inline int _register(int fd, unsigned opcode, void* arg, unsigned count)
+		{
+			return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+		}
+
+		inline uint32_t _load(const uint32_t* p)
+		{
+			return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+		}
+
+		inline void _store(uint32_t* p, uint32_t value)
+		{
+			__atomic_store_n(p, value, __ATOMIC_RELEASE);
+		}
+	}
+
+	IoUring::IoUring()
+	{
+		this->fd = -1;
+		this->features = 0;
+		memset(this->supported, 0, sizeof(this->supported));
+
+		this->ring = MAP_FAILED;
+		this->ring_size = 0;
+		this->sqes = (struct io_uring_sqe*)MAP_FAILED;
+		this->sqes_size = 0;
+
+		this->buf_ring = (struct io_uring_buf_ring*)MAP_FAILED;
+		this->buf_ring_size = 0;
+		this->buf_base = nullptr;
+		this->buf_count = 0;
+		this->buf_size = 0;
+		this->buf_tail = 0;
+	}
+
+	IoUring::~IoUring()
+	{
+		this->close();
+	}
+
+	bool IoUring::open(unsigned entries)
+	{
+		struct io_uring_params params;
+		memset(&params, 0, sizeof(params));
+
+		this->fd = _setup(entries, &params);
+
+		if (this->fd < 0)
+		{
+			LOGD_("io_uring unavailable (errno %d)", errno);
+			this->fd = -1;
+			return false;
+		}
+
+		// Timed waits need IORING_ENTER_EXT_ARG
+		if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG))
+		{
+			this->close();
+			return false;
+		}
+
+		this->features = params.features;
+
+		size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+		size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+		this->ring_size = (sq_size > cq_size) ? sq_size : cq_size;
+		this->ring = mmap(nullptr, this->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_SQ_RING);
+
+		this->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+		this->sqes = (struct io_uring_sqe*)mmap(nullptr, this->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_SQES);
+
+		if ((this->ring == MAP_FAILED) || (this->sqes == MAP_FAILED))
+		{
+			this->close();
+			return false;
+		}
+
+		uint8_t* ring = (uint8_t*)this->ring;
+
+		this->sq_head = (uint32_t*)(ring + params.sq_off.head);
+		this->sq_tail = (uint32_t*)(ring + params.sq_off.tail);
+		this->sq_mask = *(uint32_t*)(ring + params.sq_off.ring_mask);
+		this->sq_entries = params.sq_entries;
+
+		this->cq_head = (uint32_t*)(ring + params.cq_off.head);
+		this->cq_tail = (uint32_t*)(ring + params.cq_off.tail);
+		this->cq_mask = *(uint32_t*)(ring + params.cq_off.ring_mask);
+		this->cqes = (struct io_uring_cqe*)(ring + params.cq_off.cqes);
+
+		// Submission slot i always holds entry i
+		uint32_t* array = (uint32_t*)(ring + params.sq_off.array);
+
+		for (uint32_t i = 0; i < params.sq_entries; i++)
+			array[i] = i;
+
+		this->sqe_head = this->sqe_tail = *this->sq_tail;
+
+		this->probe();
+		return true;
+	}
+
+	/* Requests still in flight are cancelled with the ring */
+	void IoUring::close()
+	{
+		if (this->fd != -1)
+			::close(this->fd);
+
+		if (this->buf_ring != MAP_FAILED)
+			munmap(this->buf_ring, this->buf_ring_size);
+
+		if (this->sqes != MAP_FAILED)
+			munmap(this->sqes, this->sqes_size);
+
+		if (this->ring != MAP_FAILED)
+			munmap(this->ring, this->ring_size);
+
+		this->fd = -1;
+		this->ring = MAP_FAILED;
+		this->sqes = (struct io_uring_sqe*)MAP_FAILED;
+		this->buf_ring = (struct io_uring_buf_ring*)MAP_FAILED;
+		this->buf_count = 0;
+		memset(this->supported, 0, sizeof(this->supported));
+	}
+
+	bool IoUring::is_open() const
+	{
+		return this->fd != -1;
+	}
+
+	void IoUring::probe()
+	{
+		constexpr unsigned OPS = 256;
+		std::vector<uint8_t> storage(sizeof(struct io_uring_probe) + OPS * sizeof(struct io_uring_probe_op), 0);
+		struct io_uring_probe* probe = (struct io_uring_probe*)storage.data();
+
+		if (_register(this->fd, IORING_REGISTER_PROBE, probe, OPS) < 0)
+			return;
+
+		for (unsigned op = 0; (op <= probe->last_op) && (op < probe->ops_len) && (op < OPS); op++)
+		{
+			if (probe->ops[op].flags & IO_URING_OP_SUPPORTED)
+				this->supported[op / 8] |= (uint8_t)(1 << (op % 8));
+		}
+	}
+
+	bool IoUring::supports(uint8_t opcode) const
+	{
+		return this->supported[opcode / 8] & (1 << (opcode % 8));
+	}
+
+	struct io_uring_sqe* IoUring::get_sqe()
+	{
+		if (this->sqe_tail - _load(this->sq_head) >= this->sq_entries)
+			return nullptr;
+
+		struct io_uring_sqe* sqe = &this->sqes[this->sqe_tail & this->sq_mask];
+		this->sqe_tail++;
+
+		memset(sqe, 0, sizeof(struct io_uring_sqe));
+		return sqe;
+	}
+
+	int IoUring::submit(unsigned wait_count, int timeout_ms)
+	{
+		unsigned to_submit = this->sqe_tail - this->sqe_head;
+		unsigned flags = wait_count ? IORING_ENTER_GETEVENTS : 0;
+
+		if (to_submit)
+			_store(this->sq_tail, this->sqe_tail);
+
+		if (!to_submit && !wait_count)
+			return 0;
+
+		struct __kernel_timespec ts;
+		struct io_uring_getevents_arg arg;
+		memset(&arg, 0, sizeof(arg));
+		arg.sigmask_sz = _NSIG / 8;
+
+		if (wait_count && (timeout_ms >= 0))
+		{
+			ts.tv_sec = timeout_ms / 1000;
+			ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+			arg.ts = (uint64_t)(uintptr_t)&ts;
+		}
+
+		int ret = _enter(this->fd, to_submit, wait_count, flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+
+		if (ret < 0)
+		{
+			if ((errno == ETIME) || (errno == EINTR))
+			{
+				this->sqe_head = this->sqe_tail;
+				return 0;
+			}
+
+			return -errno;
+		}
+
+		this->sqe_head += (unsigned)ret;
+		return ret;
+	}
+
+	struct io_uring_cqe* IoUring::peek_cqe()
+	{
+		uint32_t head = *this->cq_head;
+
+		if (head == _load(this->cq_tail))
+			return nullptr;
+
+		return &this->cqes[head & this->cq_mask];
+	}
+
+	void IoUring::seen()
+	{
+		_store(this->cq_head, *this->cq_head + 1);
+	}
+
+	bool IoUring::register_buffers(uint16_t group, uint8_t* base, uint32_t count, uint32_t size)
+	{
+		if ((count == 0) || (count & (count - 1)) || (count > 32768))
+			return false;
+
+		this->buf_ring_size = count * sizeof(struct io_uring_buf);
+		this->buf_ring = (struct io_uring_buf_ring*)mmap(nullptr, this->buf_ring_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if (this->buf_ring == MAP_FAILED)
+			return false;
+
+		struct io_uring_buf_reg reg;
+		memset(&reg, 0, sizeof(reg));
+		reg.ring_addr = (uint64_t)(uintptr_t)this->buf_ring;
+		reg.ring_entries = count;
+		reg.bgid = group;
+
+		if (_register(this->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+		{
+			munmap(this->buf_ring, this->buf_ring_size);
+			this->buf_ring = (struct io_uring_buf_ring*)MAP_FAILED;
+			return false;
+		}
+
+		this->buf_base = base;
+		this->buf_count = count;
+		this->buf_size = size;
+		this->buf_tail = 0;
+
+		for (uint32_t id = 0; id < count; id++)
+			this->recycle_buffer((uint16_t)id);
+
+		return true;
+	}
+
+	uint8_t* IoUring::get_buffer(uint16_t id) const
+	{
+		return this->buf_base + (size_t)id * this->buf_size;
+	}
+
+	void IoUring::recycle_buffer(uint16_t id)
+	{
+		// Not ->bufs: under C++ the uapi flexible array member sits 8 bytes in
+		struct io_uring_buf* buf = (struct io_uring_buf*)this->buf_ring + (this->buf_tail & (this->buf_count - 1));
+
+		buf->addr = (uint64_t)(uintptr_t)this->get_buffer(id);
+		buf->len = this->buf_size;
+		buf->bid = id;
+
+		this->buf_tail++;
+		__atomic_store_n(&this->buf_ring->tail, this->buf_tail, __ATOMIC_RELEASE);
+	}
+}
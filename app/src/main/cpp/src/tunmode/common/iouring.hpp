@@ -0,0 +1,87 @@
+#pragma once
+
+#include <linux/io_uring.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace tunmode
+{
+	/*
+	 * Minimal io_uring over the raw system calls, as there is no liburing
+	 * in the NDK.
+	 *
+	 * A ring is used by one thread at a time. open() fails where the
+	 * kernel is older than 5.11 or io_uring is filtered out (Android's app
+	 * seccomp policy does so on recent releases); callers then stay on
+	 * their poll/epoll path.
+	 */
+	class IoUring
+	{
+	public:
+		/* Not in every uapi header yet (Linux 6.7) */
+		static constexpr uint8_t OP_READ_MULTISHOT = 49;
+
+		IoUring();
+		~IoUring();
+
+		bool open(unsigned entries);
+		void close();
+		bool is_open() const;
+
+		bool supports(uint8_t opcode) const;
+
+		/* Zeroed entry to fill in, nullptr while the submission queue is full */
+		struct io_uring_sqe* get_sqe();
+		/*
+		 * Submits the entries filled in since the last call and waits for
+		 * `wait_count` completions, at most `timeout_ms` (-1 = no limit).
+		 * -errno on failure; a timeout or signal is not one.
+		 */
+		int submit(unsigned wait_count = 0, int timeout_ms = -1);
+
+		/* Oldest unseen completion, nullptr if none; release it with seen() */
+		struct io_uring_cqe* peek_cqe();
+		void seen();
+
+		/*
+		 * Provided buffer ring: `count` (a power of two) buffers of `size`
+		 * bytes from `base`, picked by the kernel for reads submitted with
+		 * IOSQE_BUFFER_SELECT and `group`. Needs Linux 5.19.
+		 */
+		bool     register_buffers(uint16_t group, uint8_t* base, uint32_t count, uint32_t size);
+		uint8_t* get_buffer(uint16_t id) const;
+		void     recycle_buffer(uint16_t id);
+
+	private:
+		int      fd;
+		uint32_t features;
+		uint8_t  supported[32];    // bit per opcode
+
+		void*  ring;
+		size_t ring_size;
+		struct io_uring_sqe* sqes;
+		size_t sqes_size;
+
+		uint32_t* sq_head;
+		uint32_t* sq_tail;
+		uint32_t  sq_mask;
+		uint32_t  sq_entries;
+		uint32_t  sqe_head;        // first entry not yet submitted
+		uint32_t  sqe_tail;        // next entry handed out by get_sqe()
+
+		uint32_t* cq_head;
+		uint32_t* cq_tail;
+		uint32_t  cq_mask;
+		struct io_uring_cqe* cqes;
+
+		struct io_uring_buf_ring* buf_ring;
+		size_t   buf_ring_size;
+		uint8_t* buf_base;
+		uint32_t buf_count;
+		uint32_t buf_size;
+		uint16_t buf_tail;
+
+		void probe();
+	};
+}
@@ -0,0 +1,72 @@
+#include <tunmode/common/packetpool.hpp>
+
+namespace tunmode
+{
+	PacketPool::PacketPool(size_t limit)
+	{
+		this->local = nullptr;
+		this->returned.store(nullptr);
+		this->allocated = 0;
+		this->limit = limit;
+	}
+
+	/* Packets still out (queued in a session) are not owned here any more */
+	PacketPool::~PacketPool()
+	{
+		PooledPacket* lists[2] = {this->local, this->returned.exchange(nullptr)};
+
+		for (PooledPacket* item : lists)
+		{
+			while (item)
+			{
+				PooledPacket* next = item->next;
+				delete item;
+				item = next;
+			}
+		}
+	}
+
+	Packet* PacketPool::acquire()
+	{
+		if (!this->local)
+			this->local = this->returned.exchange(nullptr, std::memory_order_acquire);
+
+		PooledPacket* item = this->local;
+
+		if (item)
+		{
+			this->local = item->next;
+		}
+		else
+		{
+			if (this->allocated >= this->limit)
+				return nullptr;
+
+			item = new PooledPacket();
+			item->pool = this;
+			this->allocated++;
+		}
+
+		item->next = nullptr;
+		return &item->packet;
+	}
+
+	void PacketPool::release(Packet* packet)
+	{
+		PooledPacket* item = reinterpret_cast<PooledPacket*>(packet);
+		PacketPool* pool = item->pool;
+		PooledPacket* head = pool->returned.load(std::memory_order_relaxed);
+
+		// Only the acquirer takes entries off, and always the whole list: no ABA
+		do
+		{
+			item->next = head;
+		}
+		while (!pool->returned.compare_exchange_weak(head, item, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	size_t PacketPool::get_limit() const
+	{
+		return this->limit;
+	}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "packet.hpp"
+
+#include <atomic>
+#include <cstddef>
+
+namespace tunmode
+{
+	/*
+	 * Packets the tunnel thread reads the TUN into and hands to sessions
+	 * as they are, without copying them.
+	 *
+	 * acquire() is only called by one thread; release() from any thread,
+	 * onto a lock-free list the acquiring thread takes over in one swap
+	 * when its own runs out. Packets are allocated on first use, up to
+	 * `limit` out at once.
+	 */
+	class PacketPool
+	{
+	public:
+		PacketPool(size_t limit);
+		~PacketPool();
+
+		/* nullptr once `limit` packets are out */
+		Packet* acquire();
+		/* Back to the pool it came from */
+		static void release(Packet* packet);
+
+		size_t get_limit() const;
+
+	private:
+		typedef struct __POOLED_PACKET__ {
+			Packet packet;                  // first: a Packet* is its PooledPacket*
+			PacketPool* pool;
+			struct __POOLED_PACKET__* next;
+		} PooledPacket;
+
+		PooledPacket* local;                     // acquirer only
+		std::atomic<PooledPacket*> returned;     // pushed by release()
+		size_t allocated;
+		size_t limit;
+	};
+
+	/* Owns a pooled packet until it is reset or goes out of scope */
+	class PacketRef
+	{
+	public:
+		PacketRef() : packet{nullptr} {}
+		~PacketRef() { this->reset(); }
+
+		PacketRef(const PacketRef&) = delete;
+		PacketRef& operator=(const PacketRef&) = delete;
+
+		Packet* get() const { return this->packet; }
+		Packet* operator->() const { return this->packet; }
+		Packet& operator*() const { return *this->packet; }
+		explicit operator bool() const { return this->packet != nullptr; }
+
+		void reset(Packet* packet = nullptr)
+		{
+			if (this->packet)
+				PacketPool::release(this->packet);
+
+			this->packet = packet;
+		}
+
+	private:
+		Packet* packet;
+	};
+}
@@ -0,0 +1,102 @@
+#include <tunmode/common/rcu.hpp>
+
+#include <thread>
+
+namespace tunmode
+{
+	namespace
+	{
+		typedef struct alignas(64) __RCU_SLOT__ {
+			std::atomic<uint64_t> epoch{0};    // 0 = quiescent
+			std::atomic<bool>     used{false};
+		} RcuSlot;
+
+		std::atomic<uint64_t> global_epoch{1};
+		RcuSlot slots[Rcu::MAX_READERS];
+
+		// Readers that could not claim a slot hold off reclamation as a group
+		std::atomic<int> overflow_readers{0};
+
+		class SlotOwner
+		{
+		public:
+			SlotOwner() : slot{nullptr}
+			{
+				for (int i = 0; i < Rcu::MAX_READERS; i++)
+				{
+					bool expected = false;
+
+					if (slots[i].used.compare_exchange_strong(expected, true))
+					{
+						this->slot = &slots[i];
+						break;
+					}
+				}
+			}
+
+			~SlotOwner()
+			{
+				if (this->slot)
+				{
+					this->slot->epoch.store(0, std::memory_order_release);
+					this->slot->used.store(false, std::memory_order_release);
+				}
+			}
+
+			RcuSlot* slot;
+		};
+
+		thread_local SlotOwner slot_owner;
+	}
+
+	void Rcu::read_lock()
+	{
+		RcuSlot* slot = slot_owner.slot;
+
+		if (slot)
+		{
+			slot->epoch.store(global_epoch.load(std::memory_order_relaxed), std::memory_order_seq_cst);
+		}
+		else
+		{
+			overflow_readers.fetch_add(1, std::memory_order_seq_cst);
+		}
+	}
+
+	void Rcu::read_unlock()
+	{
+		RcuSlot* slot = slot_owner.slot;
+
+		if (slot)
+		{
+			slot->epoch.store(0, std::memory_order_release);
+		}
+		else
+		{
+			overflow_readers.fetch_sub(1, std::memory_order_release);
+		}
+	}
+
+	void Rcu::synchronize()
+	{
+		uint64_t epoch = global_epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+
+		for (int i = 0; i < Rcu::MAX_READERS; i++)
+		{
+			while (true)
+			{
+				uint64_t reader_epoch = slots[i].epoch.load(std::memory_order_seq_cst);
+
+				if ((reader_epoch == 0) || (reader_epoch >= epoch))
+					break;
+
+				std::this_thread::yield();
+			}
+		}
+
+		while (overflow_readers.load(std::memory_order_seq_cst) != 0)
+		{
+			std::this_thread::yield();
+		}
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+
+namespace tunmode
+{
+	/*
+	 * Epoch based read-copy-update.
+	 *
+	 * Readers publish the epoch they entered with in a per-thread slot
+	 * and never block. Writers swap the published pointer, advance the
+	 * epoch and wait until every reader that could still see the old
+	 * pointer has left its read section before freeing it.
+	 */
+	class Rcu
+	{
+	public:
+		static constexpr int MAX_READERS = 256;
+
+		static void read_lock();
+		static void read_unlock();
+
+		static void synchronize();
+	};
+
+	class RcuReadGuard
+	{
+	public:
+		RcuReadGuard() { Rcu::read_lock(); }
+		~RcuReadGuard() { Rcu::read_unlock(); }
+	};
+
+	template <typename T>
+	class RcuPointer
+	{
+	public:
+		RcuPointer() : ptr{nullptr} {}
+
+		/* Only valid inside a read section */
+		const T* get() const
+		{
+			return this->ptr.load(std::memory_order_seq_cst);
+		}
+
+		/* Serialized against other writers; `make` receives the current value */
+		template <typename F>
+		void update(F make)
+		{
+			std::lock_guard<std::mutex> lock(this->writer_mtx);
+
+			T* next = make(this->ptr.load(std::memory_order_relaxed));
+			T* prev = this->ptr.exchange(next, std::memory_order_seq_cst);
+
+			if (prev)
+			{
+				Rcu::synchronize();
+				delete prev;
+			}
+		}
+
+	private:
+		std::atomic<T*> ptr;
+		std::mutex writer_mtx;
+	};
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace tunmode
+{
+	/*
+	 * Bounded queue between exactly one producer thread and one consumer
+	 * thread. Neither side locks or makes a system call; each keeps a
+	 * cached copy of the other's index and only reloads it when the
+	 * queue looks full (or empty).
+	 *
+	 * push() reports whether the consumer had drained the queue, so the
+	 * producer can wake it on that transition only: both sides fence
+	 * between storing their own index and loading the other's, so either
+	 * the consumer sees the new entry before going idle or the producer
+	 * sees the queue as empty.
+	 */
+	template <typename T>
+	class SpscRing
+	{
+	public:
+		/* `capacity` is rounded up to a power of two */
+		SpscRing(size_t capacity)
+		{
+			size_t size = 1;
+
+			while (size < capacity)
+				size <<= 1;
+
+			this->slots = new T[size];
+			this->mask = size - 1;
+			this->head.store(0, std::memory_order_relaxed);
+			this->tail.store(0, std::memory_order_relaxed);
+			this->cached_tail = 0;
+			this->cached_head = 0;
+		}
+
+		~SpscRing()
+		{
+			delete[] this->slots;
+		}
+
+		SpscRing(const SpscRing&) = delete;
+		SpscRing& operator=(const SpscRing&) = delete;
+
+		/* Producer: false when full */
+		bool push(const T& value, bool& was_empty)
+		{
+			size_t t = this->tail.load(std::memory_order_relaxed);
+
+			if (t - this->cached_head > this->mask)
+			{
+				this->cached_head = this->head.load(std::memory_order_acquire);
+
+				if (t - this->cached_head > this->mask)
+					return false;
+			}
+
+			this->slots[t & this->mask] = value;
+			this->tail.store(t + 1, std::memory_order_release);
+
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			this->cached_head = this->head.load(std::memory_order_acquire);
+			was_empty = (this->cached_head == t);
+
+			return true;
+		}
+
+		/* Consumer: false when empty */
+		bool pop(T& value)
+		{
+			size_t h = this->head.load(std::memory_order_relaxed);
+
+			if (h == this->cached_tail)
+			{
+				this->cached_tail = this->tail.load(std::memory_order_acquire);
+
+				if (h == this->cached_tail)
+				{
+					// Pairs with the fence in push(): going idle only if the producer will see it
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+					this->cached_tail = this->tail.load(std::memory_order_acquire);
+
+					if (h == this->cached_tail)
+						return false;
+				}
+			}
+
+			value = this->slots[h & this->mask];
+			this->head.store(h + 1, std::memory_order_release);
+
+			return true;
+		}
+
+		/* Approximate from any thread, exact from either side when the other is idle */
+		size_t get_size() const
+		{
+			return this->tail.load(std::memory_order_acquire) - this->head.load(std::memory_order_acquire);
+		}
+
+		size_t get_capacity() const
+		{
+			return this->mask + 1;
+		}
+
+	private:
+		T*     slots;
+		size_t mask;
+
+		alignas(64) std::atomic<size_t> head;    // consumer
+		size_t cached_tail;
+		alignas(64) std::atomic<size_t> tail;    // producer
+		size_t cached_head;
+	};
+}
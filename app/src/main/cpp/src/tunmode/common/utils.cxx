@@ -72,6 +72,103 @@ namespace tunmode::utils
 		packet->set_size(28);
 	}
 
+	/*
+	 * Stateless RST answering `packet` as its destination would (RFC 793,
+	 * reset generation for a closed port). Returns false for a RST, which
+	 * must never be answered.
+	 */
+	bool build_tcp_reset(const Packet* packet, Packet* reset)
+	{
+		ip* ip_header;
+		tcphdr* tcp_header;
+		point_headers_tcp(packet, &ip_header, &tcp_header);
+
+		uint8_t pkt_flags = tcp_header->th_flags;
+
+		if (pkt_flags & TH_RST)
+			return false;
+
+		in_addr client_addr = ip_header->ip_src;
+		in_addr server_addr = ip_header->ip_dst;
+		u_short client_port = tcp_header->th_sport;
+		u_short server_port = tcp_header->th_dport;
+		uint32_t pkt_seq = tcp_header->th_seq;
+		uint32_t pkt_ack = tcp_header->th_ack;
+
+		// SYN and FIN each take up one sequence number
+		uint32_t seg_len = (uint32_t)packet->get_data().get_size()
+			+ ((pkt_flags & TH_SYN) ? 1 : 0) + ((pkt_flags & TH_FIN) ? 1 : 0);
+
+		reset->set_protocol(TUNMODE_PROTOCOL_TCP);
+		build_tcp_packet(reset);
+		point_headers_tcp(reset, &ip_header, &tcp_header);
+
+		ip_header->ip_src = server_addr;
+		tcp_header->th_sport = server_port;
+		ip_header->ip_dst = client_addr;
+		tcp_header->th_dport = client_port;
+
+		if (pkt_flags & TH_ACK)
+		{
+			tcp_header->th_flags = TH_RST;
+			tcp_header->th_seq = pkt_ack;
+			tcp_header->th_ack = 0;
+		}
+		else
+		{
+			tcp_header->th_flags = TH_RST | TH_ACK;
+			tcp_header->th_seq = 0;
+			tcp_header->th_ack = htonl(ntohl(pkt_seq) + seg_len);
+		}
+
+		tcp_header->th_win = 0;
+		finalize_packet_tcp(reset);
+		return true;
+	}
+
+	/*
+	 * ICMP destination unreachable for `packet`, quoting its IP header
+	 * and the first 8 bytes of payload (RFC 792). Sent as if from the
+	 * blocked destination. Returns false if `packet` is too short.
+	 */
+	bool build_icmp_unreachable(const Packet* packet, Packet* reply, uint8_t code)
+	{
+		const ip* pkt_ip_header = (const ip*)packet->get_buffer();
+		size_t pkt_header_size = pkt_ip_header->ip_hl * 4;
+
+		if ((pkt_header_size < 20) || (packet->get_size() < pkt_header_size + 8))
+			return false;
+
+		size_t quote_size = pkt_header_size + 8;
+
+		ip* ip_header = (ip*)reply->get_buffer();
+		icmphdr* icmp_header = (icmphdr*)((uintptr_t)reply->get_buffer() + 20);
+
+		ip_header->ip_hl = 5;
+		ip_header->ip_v = 4;
+		ip_header->ip_tos = 0;
+		ip_header->ip_id = (uint16_t)rand();
+		ip_header->ip_off = 0;
+		ip_header->ip_ttl = 128;
+		ip_header->ip_p = IPPROTO_ICMP;
+		ip_header->ip_src = pkt_ip_header->ip_dst;
+		ip_header->ip_dst = pkt_ip_header->ip_src;
+
+		icmp_header->type = ICMP_DEST_UNREACH;
+		icmp_header->code = code;
+		icmp_header->un.gateway = 0;
+
+		memcpy((void*)(icmp_header + 1), packet->get_buffer(), quote_size);
+
+		reply->set_protocol(TUNMODE_PROTOCOL_UNKNOWN);
+		reply->set_size(20 + sizeof(icmphdr) + quote_size);
+
+		ip_header->ip_len = htons(reply->get_size());
+		ip_header->ip_sum = cksumIp((struct iphdr*)ip_header);
+		icmp_header->checksum = cksumIcmp((struct iphdr*)ip_header, icmp_header);
+		return true;
+	}
+
 	void point_headers_tcp(const Packet* packet, ip** ip_header, tcphdr** tcp_header)
 	{
 		*ip_header = (ip*)(packet->get_buffer());
@@ -6,6 +6,7 @@
 #include <netinet/ip.h>
 #include <netinet/tcp.h>
 #include <netinet/udp.h>
+#include <netinet/ip_icmp.h>
 #include <cstdint>
 
 namespace tunmode::utils
@@ -15,6 +16,8 @@ namespace tunmode::utils
 
 	void     build_tcp_packet(Packet* packet);
 	void     build_udp_packet(Packet* packet);
+	bool     build_tcp_reset(const Packet* packet, Packet* reset);
+	bool     build_icmp_unreachable(const Packet* packet, Packet* reply, uint8_t code);
 
 	void     point_headers_tcp(const Packet* packet, ip** ip_header, tcphdr** tcp_header);
 	void     point_headers_udp(const Packet* packet, ip** ip_header, udphdr** udp_header);
@@ -5,4 +5,13 @@
 
 #define TUNMODE_PROTOCOL_TCP 6
 #define TUNMODE_PROTOCOL_UDP 17
-#define TUNMODE_PROTOCOL_UNKNOWN -1
\ No newline at end of file
+#define TUNMODE_PROTOCOL_UNKNOWN -1
+
+#define TUNMODE_TUN_BURST 32    // packets read from the TUN per wakeup
+
+#define TUNMODE_TCP_QUEUE   128     // client segments queued per TCP session, sizes its advertised window
+#define TUNMODE_UDP_QUEUE   64      // client datagrams queued per UDP session, dropped beyond
+#define TUNMODE_PACKET_POOL 8192    // packets out of the tunnel thread at once
+
+#define TUNMODE_REACTOR_MAX_LOOPS 8     // event loop threads, one per core up to this many
+#define TUNMODE_REACTOR_EVENTS    64    // epoll events handled per wakeup
\ No newline at end of file
@@ -0,0 +1,206 @@
+#include <tunmode/dns/dnscache.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace tunmode
+{
+	static inline uint64_t _now_ms()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static inline uint32_t _read32(const uint8_t* p)
+	{
+		return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+	}
+
+	static inline void _write32(uint8_t* p, uint32_t value)
+	{
+		p[0] = (uint8_t)(value >> 24);
+		p[1] = (uint8_t)(value >> 16);
+		p[2] = (uint8_t)(value >> 8);
+		p[3] = (uint8_t)value;
+	}
+
+	DnsCache::DnsCache(size_t max_entries, size_t max_bytes)
+	{
+		this->max_entries = max_entries;
+		this->max_bytes = max_bytes;
+		this->bytes = 0;
+	}
+
+	size_t DnsCache::entry_size(const Entry& entry)
+	{
+		return sizeof(Entry) + entry.key.size() * 2 + entry.response.size()
+			+ entry.ttl_offsets.size() * (sizeof(uint16_t) + sizeof(uint32_t));
+	}
+
+	void DnsCache::erase(std::list<Entry>::iterator it)
+	{
+		this->bytes -= entry_size(*it);
+		this->index.erase(it->key);
+		this->entries.erase(it);
+	}
+
+	size_t DnsCache::lookup(in_addr server, const uint8_t* query, const dns::Question& question, uint8_t* out, size_t capacity)
+	{
+		return this->lookup(server, query, question, out, capacity, _now_ms());
+	}
+
+	size_t DnsCache::lookup(in_addr server, const uint8_t* query, const dns::Question& question, uint8_t* out, size_t capacity, uint64_t now_ms)
+	{
+		std::string key = dns::make_key(question, server);
+		std::lock_guard<std::mutex> lock(this->mtx);
+
+		auto found = this->index.find(key);
+
+		if (found == this->index.end())
+			return 0;
+
+		std::list<Entry>::iterator it = found->second;
+
+		if (now_ms >= it->expires_ms)
+		{
+			this->erase(it);
+			return 0;
+		}
+
+		size_t size = dns::rewrite_answer(it->response.data(), it->response.size(), query, question, out, capacity);
+
+		if (size == 0)
+			return 0;
+
+		this->entries.splice(this->entries.begin(), this->entries, it);
+
+		uint32_t elapsed = (uint32_t)((now_ms - it->stored_ms) / 1000);
+
+		for (size_t i = 0; i < it->ttl_offsets.size(); i++)
+		{
+			uint32_t ttl = it->ttls[i];
+			_write32(out + it->ttl_offsets[i], ttl > elapsed ? ttl - elapsed : 0);
+		}
+
+		return size;
+	}
+
+	bool DnsCache::insert(in_addr server, const uint8_t* response, size_t size)
+	{
+		return this->insert(server, response, size, _now_ms());
+	}
+
+	bool DnsCache::insert(in_addr server, const uint8_t* response, size_t size, uint64_t now_ms)
+	{
+		dns::Question question;
+		std::vector<dns::Record> records;
+
+		if (!dns::parse_response(response, size, question) || dns::is_truncated(response))
+			return false;
+
+		if (!dns::parse_records(response, size, question, records))
+			return false;
+
+		uint8_t rcode = dns::get_rcode(response);
+		bool has_answer = false;
+		uint32_t lifetime = UINT32_MAX;
+
+		if ((rcode != TUNMODE_DNS_RCODE_NOERROR) && (rcode != TUNMODE_DNS_RCODE_NXDOMAIN))
+			return false;
+
+		for (const dns::Record& record : records)
+		{
+			if (record.section == 0)
+			{
+				has_answer = true;
+				lifetime = std::min(lifetime, record.ttl);
+			}
+		}
+
+		if ((rcode == TUNMODE_DNS_RCODE_NOERROR) && has_answer)
+		{
+			lifetime = std::min(lifetime, MAX_TTL);
+		}
+		else
+		{
+			// Negative answer: cached for the SOA minimum, never without one
+			lifetime = UINT32_MAX;
+
+			for (const dns::Record& record : records)
+			{
+				if ((record.section == 1) && (record.type == TUNMODE_DNS_TYPE_SOA) && (record.rdata_length >= 20))
+				{
+					uint32_t minimum = _read32(response + record.rdata_offset + record.rdata_length - 4);
+					lifetime = std::min({lifetime, record.ttl, minimum});
+				}
+			}
+
+			if (lifetime == UINT32_MAX)
+				return false;
+
+			lifetime = std::min(lifetime, MAX_NEGATIVE_TTL);
+		}
+
+		if (lifetime == 0)
+			return false;
+
+		Entry entry;
+		entry.key = dns::make_key(question, server);
+		entry.response.assign(response, response + size);
+		entry.stored_ms = now_ms;
+		entry.expires_ms = now_ms + (uint64_t)lifetime * 1000;
+
+		for (const dns::Record& record : records)
+		{
+			// The OPT pseudo-record uses the TTL field for flags
+			if (record.type == TUNMODE_DNS_TYPE_OPT)
+				continue;
+
+			entry.ttl_offsets.push_back((uint16_t)record.ttl_offset);
+			entry.ttls.push_back(std::min(record.ttl, lifetime));
+		}
+
+		size_t added = entry_size(entry);
+
+		if (added > this->max_bytes)
+			return false;
+
+		std::lock_guard<std::mutex> lock(this->mtx);
+
+		auto found = this->index.find(entry.key);
+
+		if (found != this->index.end())
+			this->erase(found->second);
+
+		while (!this->entries.empty() && ((this->entries.size() >= this->max_entries) || (this->bytes + added > this->max_bytes)))
+			this->erase(std::prev(this->entries.end()));
+
+		this->entries.push_front(std::move(entry));
+		this->index.emplace(this->entries.front().key, this->entries.begin());
+		this->bytes += added;
+
+		return true;
+	}
+
+	void DnsCache::clear()
+	{
+		std::lock_guard<std::mutex> lock(this->mtx);
+
+		this->index.clear();
+		this->entries.clear();
+		this->bytes = 0;
+	}
+
+	size_t DnsCache::get_entry_count()
+	{
+		std::lock_guard<std::mutex> lock(this->mtx);
+		return this->entries.size();
+	}
+
+	size_t DnsCache::get_memory_usage()
+	{
+		std::lock_guard<std::mutex> lock(this->mtx);
+		return this->bytes;
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "dnsmessage.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace tunmode
+{
+	/*
+	 * Cache of upstream DNS responses keyed by (server, name, type,
+	 * class), so an answer from one resolver is never served to a query
+	 * sent to another.
+	 *
+	 * Entries live as long as the smallest TTL in the response, capped
+	 * at MAX_TTL. NXDOMAIN and empty answers are cached for the SOA
+	 * minimum (RFC 2308), capped at MAX_NEGATIVE_TTL, and not at all
+	 * without an SOA. Served copies carry the query's ID and question
+	 * and TTLs reduced by the time spent in the cache.
+	 *
+	 * Bounded by entry count and bytes, least recently used first out.
+	 * Filled from session threads and read by the tunnel thread under
+	 * one mutex; the critical section is a hash lookup and a memcpy.
+	 */
+	class DnsCache
+	{
+	public:
+		static constexpr uint32_t MAX_TTL          = 3600;
+		static constexpr uint32_t MAX_NEGATIVE_TTL = 300;
+
+		DnsCache(size_t max_entries = 1024, size_t max_bytes = 256 * 1024);
+
+		/* Writes the answer `server` gave to `query` into `out`; 0 on a miss */
+		size_t lookup(in_addr server, const uint8_t* query, const dns::Question& question, uint8_t* out, size_t capacity);
+		size_t lookup(in_addr server, const uint8_t* query, const dns::Question& question, uint8_t* out, size_t capacity, uint64_t now_ms);
+
+		/* Stores a response from `server`; false if it is not cacheable */
+		bool insert(in_addr server, const uint8_t* response, size_t size);
+		bool insert(in_addr server, const uint8_t* response, size_t size, uint64_t now_ms);
+
+		void clear();
+
+		size_t get_entry_count();
+		size_t get_memory_usage();
+
+	private:
+		typedef struct __DNS_CACHE_ENTRY__ {
+			std::string           key;
+			std::vector<uint8_t>  response;
+			std::vector<uint16_t> ttl_offsets;    // records whose TTL is aged on the way out
+			std::vector<uint32_t> ttls;           // as received, capped to the lifetime
+			uint64_t              stored_ms;
+			uint64_t              expires_ms;
+		} Entry;
+
+		std::mutex mtx;
+		std::list<Entry> entries;    // most recently used first
+		std::unordered_map<std::string, std::list<Entry>::iterator> index;
+
+		size_t max_entries;
+		size_t max_bytes;
+		size_t bytes;
+
+		static size_t entry_size(const Entry& entry);
+
+		void erase(std::list<Entry>::iterator it);
+	};
+}
@@ -0,0 +1,111 @@
+#include <tunmode/dns/dnsinflight.hpp>
+
+#include <chrono>
+
+namespace tunmode
+{
+	static inline uint64_t _now_ms()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	DnsInflight::DnsInflight()
+	{
+		this->last_sweep_ms = 0;
+	}
+
+	bool DnsInflight::join(in_addr server, const uint8_t* packet, size_t size, const dns::Question& question)
+	{
+		return this->join(server, packet, size, question, _now_ms());
+	}
+
+	bool DnsInflight::join(in_addr server, const uint8_t* packet, size_t size, const dns::Question& question, uint64_t now_ms)
+	{
+		std::string key = dns::make_key(question, server);
+		std::lock_guard<std::mutex> lock(this->mtx);
+
+		auto found = this->pending.find(key);
+
+		if (found == this->pending.end())
+		{
+			// First of its kind: it goes upstream and later ones wait for it
+			if (this->pending.size() < MAX_PENDING)
+				this->pending.emplace(std::move(key), Pending{now_ms, {}});
+
+			return false;
+		}
+
+		Pending& entry = found->second;
+
+		if ((now_ms - entry.started_ms >= WAIT_MS) || (entry.waiters.size() >= MAX_WAITERS))
+			return false;
+
+		entry.waiters.emplace_back(packet, packet + size);
+		return true;
+	}
+
+	std::vector<DnsInflight::Waiter> DnsInflight::complete(in_addr server, const uint8_t* response, size_t size)
+	{
+		dns::Question question;
+
+		if (!dns::parse_response(response, size, question))
+			return {};
+
+		std::string key = dns::make_key(question, server);
+		std::lock_guard<std::mutex> lock(this->mtx);
+
+		auto found = this->pending.find(key);
+
+		if (found == this->pending.end())
+			return {};
+
+		std::vector<Waiter> waiters = std::move(found->second.waiters);
+		this->pending.erase(found);
+		return waiters;
+	}
+
+	std::vector<DnsInflight::Waiter> DnsInflight::expire()
+	{
+		return this->expire(_now_ms());
+	}
+
+	std::vector<DnsInflight::Waiter> DnsInflight::expire(uint64_t now_ms)
+	{
+		std::vector<Waiter> expired;
+		std::lock_guard<std::mutex> lock(this->mtx);
+
+		if (this->pending.empty() || (now_ms - this->last_sweep_ms < SWEEP_MS))
+			return expired;
+
+		this->last_sweep_ms = now_ms;
+
+		for (auto it = this->pending.begin(); it != this->pending.end();)
+		{
+			if (now_ms - it->second.started_ms < WAIT_MS)
+			{
+				it++;
+				continue;
+			}
+
+			for (Waiter& waiter : it->second.waiters)
+				expired.push_back(std::move(waiter));
+
+			it = this->pending.erase(it);
+		}
+
+		return expired;
+	}
+
+	bool DnsInflight::is_empty()
+	{
+		std::lock_guard<std::mutex> lock(this->mtx);
+		return this->pending.empty();
+	}
+
+	void DnsInflight::clear()
+	{
+		std::lock_guard<std::mutex> lock(this->mtx);
+		this->pending.clear();
+	}
+}
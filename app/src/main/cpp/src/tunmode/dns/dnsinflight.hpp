@@ -0,0 +1,64 @@
+#pragma once
+
+#include "dnsmessage.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace tunmode
+{
+	/*
+	 * Queries forwarded upstream and not yet answered, keyed by
+	 * (server, name, type, class): queries to different resolvers are
+	 * never merged.
+	 *
+	 * The first query for a key goes upstream; identical queries that
+	 * arrive before its answer are parked here as raw IP packets and
+	 * answered from that one response. If no response comes within
+	 * WAIT_MS the parked queries are handed back to be forwarded on
+	 * their own.
+	 *
+	 * Joined and expired by the tunnel thread, completed by session
+	 * threads.
+	 */
+	class DnsInflight
+	{
+	public:
+		static constexpr uint64_t WAIT_MS     = 1000;
+		static constexpr size_t   MAX_WAITERS = 32;      // per key
+		static constexpr size_t   MAX_PENDING = 256;
+		static constexpr uint64_t SWEEP_MS    = 100;     // expire() does nothing more often than this
+
+		typedef std::vector<uint8_t> Waiter;    // the parked query packet
+
+		DnsInflight();
+
+		/* True if `packet` was parked behind an identical outstanding query to `server` */
+		bool join(in_addr server, const uint8_t* packet, size_t size, const dns::Question& question);
+		bool join(in_addr server, const uint8_t* packet, size_t size, const dns::Question& question, uint64_t now_ms);
+
+		/* Closes the entry `server` answered with `response` and returns its waiters */
+		std::vector<Waiter> complete(in_addr server, const uint8_t* response, size_t size);
+
+		/* Closes entries older than WAIT_MS and returns their waiters */
+		std::vector<Waiter> expire();
+		std::vector<Waiter> expire(uint64_t now_ms);
+
+		bool   is_empty();
+		void   clear();
+
+	private:
+		typedef struct __DNS_PENDING__ {
+			uint64_t            started_ms;
+			std::vector<Waiter> waiters;
+		} Pending;
+
+		std::mutex mtx;
+		std::unordered_map<std::string, Pending> pending;
+		uint64_t last_sweep_ms;
+	};
+}
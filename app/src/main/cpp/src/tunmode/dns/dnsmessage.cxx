@@ -0,0 +1,274 @@
+#include <tunmode/dns/dnsmessage.hpp>
+
+#include <cstring>
+
+namespace tunmode::dns
+{
+	static inline uint16_t _read16(const uint8_t* p)
+	{
+		return (uint16_t)((p[0] << 8) | p[1]);
+	}
+
+	static inline void _write16(uint8_t* p, uint16_t value)
+	{
+		p[0] = (uint8_t)(value >> 8);
+		p[1] = (uint8_t)value;
+	}
+
+	static bool _parse_question(const uint8_t* data, size_t size, Question& question)
+	{
+		size_t pos = TUNMODE_DNS_HEADER_SIZE;
+		size_t length = 0;
+
+		while (true)
+		{
+			if (pos >= size)
+				return false;
+
+			uint8_t label = data[pos++];
+
+			if (label == 0)
+				break;
+
+			// Queries carry no compression pointers
+			if ((label > 63) || (pos + label > size))
+				return false;
+
+			if (length + (length ? 1 : 0) + label > TUNMODE_DNS_MAX_NAME)
+				return false;
+
+			if (length)
+				question.name[length++] = '.';
+
+			memcpy(question.name + length, data + pos, label);
+			length += label;
+			pos += label;
+		}
+
+		if (pos + 4 > size)
+			return false;
+
+		question.name[length] = '\0';
+		question.name_length = length;
+		question.type = _read16(data + pos);
+		question.klass = _read16(data + pos + 2);
+		question.end = pos + 4;
+
+		return length > 0;
+	}
+
+	bool parse_query(const uint8_t* data, size_t size, Question& question)
+	{
+		if (size < TUNMODE_DNS_HEADER_SIZE)
+			return false;
+
+		// QR = 0, OPCODE = QUERY
+		if (data[2] & 0xF8)
+			return false;
+
+		if ((_read16(data + 4) != 1) || _read16(data + 6) || _read16(data + 8))
+			return false;
+
+		return _parse_question(data, size, question);
+	}
+
+	bool parse_response(const uint8_t* data, size_t size, Question& question)
+	{
+		if (size < TUNMODE_DNS_HEADER_SIZE)
+			return false;
+
+		// QR = 1, OPCODE = QUERY
+		if ((data[2] & 0xF8) != 0x80)
+			return false;
+
+		if (_read16(data + 4) != 1)
+			return false;
+
+		return _parse_question(data, size, question);
+	}
+
+	bool read_name(const uint8_t* data, size_t size, size_t pos, char* out, size_t& out_length)
+	{
+		size_t length = 0;
+
+		// Bounds pointer loops
+		for (int jumps = 0; jumps < 32;)
+		{
+			if (pos >= size)
+				return false;
+
+			uint8_t label = data[pos];
+
+			if (label == 0)
+			{
+				out[length] = '\0';
+				out_length = length;
+				return true;
+			}
+
+			if ((label & 0xC0) == 0xC0)
+			{
+				if (pos + 2 > size)
+					return false;
+
+				pos = (size_t)(_read16(data + pos) & 0x3FFF);
+				jumps++;
+				continue;
+			}
+
+			if ((label > 63) || (pos + 1 + label > size))
+				return false;
+
+			if (length + (length ? 1 : 0) + label > TUNMODE_DNS_MAX_NAME)
+				return false;
+
+			if (length)
+				out[length++] = '.';
+
+			memcpy(out + length, data + pos + 1, label);
+			length += label;
+			pos += 1 + label;
+		}
+
+		return false;
+	}
+
+	std::string make_key(const Question& question)
+	{
+		std::string key(question.name, question.name_length);
+
+		for (char& c : key)
+		{
+			if ((c >= 'A') && (c <= 'Z'))
+				c += 'a' - 'A';
+		}
+
+		key.push_back('\0');
+		key.push_back((char)(question.type >> 8));
+		key.push_back((char)question.type);
+		key.push_back((char)(question.klass >> 8));
+		key.push_back((char)question.klass);
+		return key;
+	}
+
+	std::string make_key(const Question& question, in_addr server)
+	{
+		std::string key = make_key(question);
+		key.append((const char*)&server.s_addr, sizeof(server.s_addr));
+		return key;
+	}
+
+	static bool _skip_name(const uint8_t* data, size_t size, size_t& pos)
+	{
+		while (pos < size)
+		{
+			uint8_t label = data[pos];
+
+			if (label == 0)
+			{
+				pos++;
+				return true;
+			}
+
+			// A compression pointer ends the name
+			if ((label & 0xC0) == 0xC0)
+			{
+				pos += 2;
+				return pos <= size;
+			}
+
+			if (label > 63)
+				return false;
+
+			pos += 1 + label;
+		}
+
+		return false;
+	}
+
+	bool parse_records(const uint8_t* data, size_t size, const Question& question, std::vector<Record>& records)
+	{
+		uint16_t counts[3] = {_read16(data + 6), _read16(data + 8), _read16(data + 10)};
+		size_t pos = question.end;
+
+		records.clear();
+
+		for (uint8_t section = 0; section < 3; section++)
+		{
+			for (uint16_t i = 0; i < counts[section]; i++)
+			{
+				if (!_skip_name(data, size, pos) || (pos + 10 > size))
+					return false;
+
+				Record record;
+				record.type = _read16(data + pos);
+				record.klass = _read16(data + pos + 2);
+				record.ttl = ((uint32_t)_read16(data + pos + 4) << 16) | _read16(data + pos + 6);
+				record.ttl_offset = pos + 4;
+				record.rdata_length = _read16(data + pos + 8);
+				record.rdata_offset = pos + 10;
+				record.section = section;
+
+				pos = record.rdata_offset + record.rdata_length;
+
+				if (pos > size)
+					return false;
+
+				records.push_back(record);
+			}
+		}
+
+		return true;
+	}
+
+	size_t build_answer(const uint8_t* query, const Question& question, uint8_t rcode,
+	                    const void* address, size_t address_size, uint32_t ttl,
+	                    uint8_t* out, size_t capacity)
+	{
+		size_t size = question.end + (address ? 12 + address_size : 0);
+
+		if (size > capacity)
+			return 0;
+
+		memcpy(out, query, question.end);
+
+		out[2] = 0x80 | (query[2] & 0x01);    // QR, keep RD
+		out[3] = 0x80 | (rcode & 0x0F);       // RA
+
+		_write16(out + 6, address ? 1 : 0);
+		_write16(out + 8, 0);
+		_write16(out + 10, 0);                // EDNS OPT is not echoed
+
+		if (address)
+		{
+			uint8_t* record = out + question.end;
+
+			_write16(record, 0xC000 | TUNMODE_DNS_HEADER_SIZE);    // points at the question name
+			_write16(record + 2, question.type);
+			_write16(record + 4, question.klass);
+			_write16(record + 6, (uint16_t)(ttl >> 16));
+			_write16(record + 8, (uint16_t)ttl);
+			_write16(record + 10, (uint16_t)address_size);
+			memcpy(record + 12, address, address_size);
+		}
+
+		return size;
+	}
+
+	size_t rewrite_answer(const uint8_t* response, size_t size, const uint8_t* query, const Question& question,
+	                      uint8_t* out, size_t capacity)
+	{
+		if ((size > capacity) || (size < question.end))
+			return 0;
+
+		// Same name up to case, so the question has the same length
+		memcpy(out, response, size);
+		memcpy(out + TUNMODE_DNS_HEADER_SIZE, query + TUNMODE_DNS_HEADER_SIZE, question.end - TUNMODE_DNS_HEADER_SIZE);
+
+		out[0] = query[0];
+		out[1] = query[1];
+		out[2] = (out[2] & ~0x01) | (query[2] & 0x01);
+
+		return size;
+	}
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define TUNMODE_DNS_PORT        53
+#define TUNMODE_DNS_HEADER_SIZE 12
+#define TUNMODE_DNS_MAX_NAME    253
+
+#define TUNMODE_DNS_TYPE_A      1
+#define TUNMODE_DNS_TYPE_CNAME  5
+#define TUNMODE_DNS_TYPE_SOA    6
+#define TUNMODE_DNS_TYPE_AAAA   28
+#define TUNMODE_DNS_TYPE_OPT    41
+#define TUNMODE_DNS_CLASS_IN    1
+
+#define TUNMODE_DNS_RCODE_NOERROR  0
+#define TUNMODE_DNS_RCODE_SERVFAIL 2
+#define TUNMODE_DNS_RCODE_NXDOMAIN 3
+
+namespace tunmode::dns
+{
+	typedef struct __DNS_QUESTION__ {
+		char     name[TUNMODE_DNS_MAX_NAME + 1];    // dotted, no trailing dot, as sent
+		size_t   name_length;
+		uint16_t type;
+		uint16_t klass;
+		size_t   end;                               // offset just past the question
+	} Question;
+
+	typedef struct __DNS_RECORD__ {
+		uint16_t type;
+		uint16_t klass;
+		uint32_t ttl;
+		size_t   ttl_offset;
+		size_t   rdata_offset;
+		uint16_t rdata_length;
+		uint8_t  section;                           // 0 answer, 1 authority, 2 additional
+	} Record;
+
+	inline uint16_t get_id(const uint8_t* data)    { return (uint16_t)((data[0] << 8) | data[1]); }
+	inline uint8_t  get_rcode(const uint8_t* data) { return data[3] & 0x0F; }
+	inline bool     is_truncated(const uint8_t* data) { return data[2] & 0x02; }
+
+	// Parses a standard query with exactly one question (RFC 1035 4.1).
+	// Compressed names, responses and other opcodes are rejected.
+	bool parse_query(const uint8_t* data, size_t size, Question& question);
+
+	// Same for a response to such a query.
+	bool parse_response(const uint8_t* data, size_t size, Question& question);
+
+	// Decodes the possibly compressed name at `pos` into dotted form.
+	bool read_name(const uint8_t* data, size_t size, size_t pos, char* out, size_t& out_length);
+
+	// Lowercased name, type and class: equal for questions sharing an answer.
+	std::string make_key(const Question& question);
+
+	// The same, scoped to the resolver asked: servers may answer differently.
+	std::string make_key(const Question& question, in_addr server);
+
+	// Walks the answer, authority and additional records that follow the
+	// question. False if the message is malformed or truncated.
+	bool parse_records(const uint8_t* data, size_t size, const Question& question, std::vector<Record>& records);
+
+	// Answer to `query` holding its header and question. With `address`
+	// set (4 bytes for A, 16 for AAAA) one record of that type is added,
+	// otherwise the answer section is empty and `rcode` is reported.
+	// Returns the answer size, 0 if `capacity` is too small.
+	size_t build_answer(const uint8_t* query, const Question& question, uint8_t rcode,
+	                    const void* address, size_t address_size, uint32_t ttl,
+	                    uint8_t* out, size_t capacity);
+
+	// Copy of `response` as an answer to `query`, an identical question
+	// up to case: takes the query's ID, RD bit and spelling of the name.
+	// Returns the answer size, 0 if `capacity` is too small.
+	size_t rewrite_answer(const uint8_t* response, size_t size, const uint8_t* query, const Question& question,
+	                      uint8_t* out, size_t capacity);
+}
@@ -0,0 +1,457 @@
+#include <tunmode/filter/domainset.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace tunmode
+{
+	namespace
+	{
+		constexpr size_t   BUCKET_SIZE   = 5;       // average names per pilot
+		constexpr size_t   LOAD_PERCENT  = 97;
+		constexpr uint32_t MAX_PILOT     = 0xFFFF;
+		constexpr int      MAX_ATTEMPTS  = 16;      // seeds tried before giving up
+
+		constexpr uint64_t PILOT_FACTOR  = 0x9E3779B97F4A7C15ull;
+
+		inline size_t _fastrange(uint64_t value, size_t range)
+		{
+			return (size_t)(((unsigned __int128)value * range) >> 64);
+		}
+
+		inline bool _is_name_char(char c)
+		{
+			return ((c >= 'a') && (c <= 'z')) || ((c >= '0') && (c <= '9')) || (c == '-') || (c == '_');
+		}
+	}
+
+	DomainSet::DomainSet()
+	{
+		this->pilots = nullptr;
+		this->slots = nullptr;
+		this->names = nullptr;
+		this->bucket_count = 0;
+		this->slot_count = 0;
+		this->names_size = 0;
+		this->entry_count = 0;
+		this->seed = 0;
+	}
+
+	uint64_t DomainSet::mix(uint64_t value)
+	{
+		value ^= value >> 33;
+		value *= 0xFF51AFD7ED558CCDull;
+		value ^= value >> 33;
+		value *= 0xC4CEB9FE1A85EC53ull;
+		value ^= value >> 33;
+		return value;
+	}
+
+	uint64_t DomainSet::hash(const char* name, size_t length)
+	{
+		uint64_t h = 0x9E3779B97F4A7C15ull ^ length;
+
+		for (; length >= 8; name += 8, length -= 8)
+		{
+			uint64_t word;
+			memcpy(&word, name, 8);
+			h = (h ^ word) * 0xD6E8FEB86659FD93ull;
+			h ^= h >> 32;
+		}
+
+		if (length)
+		{
+			uint64_t word = 0;
+			memcpy(&word, name, length);
+			h = (h ^ word) * 0xD6E8FEB86659FD93ull;
+			h ^= h >> 32;
+		}
+
+		return mix(h);
+	}
+
+	uint32_t DomainSet::fingerprint(uint64_t hash)
+	{
+		return (uint32_t)(hash >> 24);
+	}
+
+	size_t DomainSet::bucket(uint64_t hash, size_t bucket_count)
+	{
+		return _fastrange(hash, bucket_count);
+	}
+
+	size_t DomainSet::position(uint64_t hash, uint16_t pilot, size_t slot_count)
+	{
+		return _fastrange(mix(hash ^ ((pilot + 1ull) * PILOT_FACTOR)), slot_count);
+	}
+
+	bool DomainSet::contains_hash(uint64_t hash, const char* name, size_t length) const
+	{
+		uint64_t seeded = mix(hash ^ this->seed);
+		uint16_t pilot = this->pilots[bucket(seeded, this->bucket_count)];
+		uint64_t slot = this->slots[position(seeded, pilot, this->slot_count)];
+
+		if (((uint32_t)slot == 0) || ((uint32_t)(slot >> 32) != fingerprint(hash)))
+			return false;
+
+		// Every name outside the set lands on some other name's slot: compare it
+		size_t offset = (uint32_t)slot - 1;
+
+		if ((offset + 1 + length > this->names_size) || (this->names[offset] != length))
+			return false;
+
+		return memcmp(this->names + offset + 1, name, length) == 0;
+	}
+
+	bool DomainSet::normalize(const char* name, size_t length, char* out, size_t& out_length)
+	{
+		if ((length >= 2) && (name[0] == '*') && (name[1] == '.'))
+		{
+			name += 2;
+			length -= 2;
+		}
+		else if (length && (name[0] == '.'))
+		{
+			name++;
+			length--;
+		}
+
+		if (length && (name[length - 1] == '.'))
+			length--;
+
+		if ((length == 0) || (length > TUNMODE_DOMAIN_MAX_LENGTH))
+			return false;
+
+		size_t label = 0;
+
+		for (size_t i = 0; i < length; i++)
+		{
+			char c = name[i];
+
+			if ((c >= 'A') && (c <= 'Z'))
+				c += 'a' - 'A';
+
+			if (c == '.')
+			{
+				if ((label == 0) || (label > 63))
+					return false;
+
+				label = 0;
+			}
+			else if (_is_name_char(c))
+				label++;
+			else
+				return false;
+
+			out[i] = c;
+		}
+
+		if ((label == 0) || (label > 63))
+			return false;
+
+		out_length = length;
+		return true;
+	}
+
+	bool DomainSet::contains(const char* name, size_t length) const
+	{
+		char normalized[TUNMODE_DOMAIN_MAX_LENGTH];
+		size_t normalized_length;
+
+		if (this->is_empty() || !normalize(name, length, normalized, normalized_length))
+			return false;
+
+		// The name itself, then every parent domain
+		for (size_t i = 0; (i < normalized_length) && this->entry_count; i++)
+		{
+			if ((i == 0) || (normalized[i - 1] == '.'))
+			{
+				const char* suffix = normalized + i;
+				size_t suffix_length = normalized_length - i;
+
+				if (this->contains_hash(hash(suffix, suffix_length), suffix, suffix_length))
+					return true;
+			}
+		}
+
+		return this->patterns && this->patterns->matches(normalized, normalized_length);
+	}
+
+	bool DomainSet::is_empty() const
+	{
+		return (this->entry_count == 0) && !this->patterns;
+	}
+
+	size_t DomainSet::get_entry_count() const
+	{
+		return this->entry_count;
+	}
+
+	size_t DomainSet::get_memory_usage() const
+	{
+		return this->bucket_count * sizeof(uint16_t)
+			+ this->slot_count * sizeof(uint64_t)
+			+ this->names_size
+			+ (this->patterns ? this->patterns->get_memory_usage() : 0);
+	}
+
+	double DomainSet::get_bytes_per_entry() const
+	{
+		return this->entry_count ? (double)this->get_memory_usage() / this->entry_count : 0;
+	}
+
+	const PatternSet* DomainSet::get_patterns() const
+	{
+		return this->patterns.get();
+	}
+
+	bool DomainSet::save(const char* path) const
+	{
+		RuleFileWriter writer(RULEFILE_KIND_DOMAIN);
+
+		writer.set_entry_count((uint32_t)this->entry_count);
+		writer.set_param(0, (uint32_t)this->seed);
+		writer.set_param(1, (uint32_t)(this->seed >> 32));
+		writer.add_section(this->pilots, this->bucket_count * sizeof(uint16_t));
+		writer.add_section(this->slots, this->slot_count * sizeof(uint64_t));
+		writer.add_section(this->names, this->names_size);
+
+		if (this->patterns)
+			this->patterns->save(writer);
+
+		return writer.write(path);
+	}
+
+	DomainSet* DomainSet::load(const char* path, bool verify)
+	{
+		std::shared_ptr<RuleFile> file = RuleFile::open(path, RULEFILE_KIND_DOMAIN, verify);
+
+		// Three sections of names, then five of patterns if there are any
+		if (!file || ((file->get_header().section_count != 3) && (file->get_header().section_count != 8)))
+			return nullptr;
+
+		const RuleFileHeader& header = file->get_header();
+		size_t pilots_size, slots_size, names_size;
+		const void* pilots = file->get_section(0, pilots_size);
+		const void* slots = file->get_section(1, slots_size);
+		const void* names = file->get_section(2, names_size);
+
+		// Name offsets are checked on lookup, so mapped names are only read when probed
+		if ((pilots_size % sizeof(uint16_t))
+			|| (slots_size % sizeof(uint64_t))
+			|| ((pilots_size == 0) != (slots_size == 0))
+			|| (header.entry_count > slots_size / sizeof(uint64_t)))
+		{
+			return nullptr;
+		}
+
+		std::unique_ptr<PatternSet> patterns;
+
+		if (header.section_count == 8)
+		{
+			patterns.reset(PatternSet::load(*file, 3));
+
+			if (!patterns)
+				return nullptr;
+
+			if (patterns->get_state_count() == 0)
+				patterns.reset();
+		}
+
+		DomainSet* set = new DomainSet();
+
+		set->patterns = std::move(patterns);
+		set->pilots = (const uint16_t*)pilots;
+		set->slots = (const uint64_t*)slots;
+		set->names = (const uint8_t*)names;
+		set->bucket_count = pilots_size / sizeof(uint16_t);
+		set->slot_count = slots_size / sizeof(uint64_t);
+		set->names_size = names_size;
+		set->entry_count = set->slot_count ? header.entry_count : 0;
+		set->seed = ((uint64_t)header.params[1] << 32) | header.params[0];
+		set->file = std::move(file);
+
+		return set;
+	}
+
+	DomainSetBuilder::DomainSetBuilder() {}
+
+	bool DomainSetBuilder::add(const char* name, size_t length)
+	{
+		if (PatternSetBuilder::is_pattern(name, length))
+			return this->patterns.add(name, length);
+
+		char normalized[TUNMODE_DOMAIN_MAX_LENGTH];
+		size_t normalized_length;
+
+		if (!DomainSet::normalize(name, length, normalized, normalized_length))
+			return false;
+
+		// Offsets are stored plus one in 32 bits
+		if (this->names.size() + 1 + normalized_length >= 0xFFFFFFFF)
+			return false;
+
+		this->keys.push_back({DomainSet::hash(normalized, normalized_length), (uint32_t)this->names.size()});
+		this->names.push_back((uint8_t)normalized_length);
+		this->names.insert(this->names.end(), normalized, normalized + normalized_length);
+		return true;
+	}
+
+	size_t DomainSetBuilder::get_count() const
+	{
+		return this->keys.size() + this->patterns.get_count();
+	}
+
+	size_t DomainSetBuilder::get_pattern_count() const
+	{
+		return this->patterns.get_count();
+	}
+
+	DomainSet* DomainSetBuilder::build()
+	{
+		std::vector<Key> keys = std::move(this->keys);
+		std::vector<uint8_t> names = std::move(this->names);
+		this->keys.clear();
+		this->names.clear();
+
+		std::sort(keys.begin(), keys.end(), [](const Key& a, const Key& b) {
+			return a.hash < b.hash;
+		});
+
+		keys.erase(std::unique(keys.begin(), keys.end(), [](const Key& a, const Key& b) {
+			return a.hash == b.hash;
+		}), keys.end());
+
+		DomainSet* set = new DomainSet();
+
+		// Repeated names are left out, in hash order
+		for (Key& key : keys)
+		{
+			size_t length = names[key.offset];
+			uint32_t offset = (uint32_t)set->name_storage.size();
+
+			set->name_storage.insert(set->name_storage.end(), names.begin() + key.offset, names.begin() + key.offset + 1 + length);
+			key.offset = offset;
+		}
+
+		if (this->patterns.get_count())
+		{
+			set->patterns.reset(this->patterns.build());
+
+			if (set->patterns && (set->patterns->get_state_count() == 0))
+				set->patterns.reset();
+		}
+
+		if (keys.empty())
+			return set;
+
+		size_t n = keys.size();
+		size_t bucket_count = n / BUCKET_SIZE + 1;
+		size_t slot_count = n * 100 / LOAD_PERCENT + 1;
+
+		std::vector<uint64_t> seeded(n);
+		std::vector<uint32_t> order(n);
+		std::vector<uint32_t> starts(bucket_count + 1);
+		std::vector<uint32_t> buckets(bucket_count);
+		std::vector<size_t>   positions;
+
+		for (int attempt = 0; attempt < MAX_ATTEMPTS; attempt++)
+		{
+			uint64_t seed = DomainSet::mix(0x2545F4914F6CDD1Dull + attempt);
+
+			// Counting sort of the keys by bucket
+			std::fill(starts.begin(), starts.end(), 0);
+
+			for (size_t i = 0; i < n; i++)
+			{
+				seeded[i] = DomainSet::mix(keys[i].hash ^ seed);
+				starts[DomainSet::bucket(seeded[i], bucket_count) + 1]++;
+			}
+
+			for (size_t b = 0; b < bucket_count; b++)
+				starts[b + 1] += starts[b];
+
+			{
+				std::vector<uint32_t> fill(starts.begin(), starts.end() - 1);
+
+				for (uint32_t i = 0; i < n; i++)
+					order[fill[DomainSet::bucket(seeded[i], bucket_count)]++] = i;
+			}
+
+			// Largest buckets first, while the table is still empty
+			for (uint32_t b = 0; b < bucket_count; b++)
+				buckets[b] = b;
+
+			std::stable_sort(buckets.begin(), buckets.end(), [&](uint32_t a, uint32_t b) {
+				return starts[a + 1] - starts[a] > starts[b + 1] - starts[b];
+			});
+
+			set->pilot_storage.assign(bucket_count, 0);
+			set->slot_storage.assign(slot_count, 0);
+
+			uint16_t* pilots = set->pilot_storage.data();
+			uint64_t* slots = set->slot_storage.data();
+			bool failed = false;
+
+			for (uint32_t b : buckets)
+			{
+				uint32_t begin = starts[b];
+				uint32_t end = starts[b + 1];
+
+				if (begin == end)
+					break;
+
+				uint32_t pilot = 0;
+
+				for (; pilot <= MAX_PILOT; pilot++)
+				{
+					positions.clear();
+
+					for (uint32_t k = begin; k < end; k++)
+					{
+						size_t pos = DomainSet::position(seeded[order[k]], (uint16_t)pilot, slot_count);
+
+						if (slots[pos] || (std::find(positions.begin(), positions.end(), pos) != positions.end()))
+							break;
+
+						positions.push_back(pos);
+					}
+
+					if (positions.size() == end - begin)
+						break;
+				}
+
+				if (pilot > MAX_PILOT)
+				{
+					failed = true;
+					break;
+				}
+
+				pilots[b] = (uint16_t)pilot;
+
+				for (uint32_t k = begin; k < end; k++)
+				{
+					const Key& key = keys[order[k]];
+					slots[positions[k - begin]] = ((uint64_t)DomainSet::fingerprint(key.hash) << 32) | (key.offset + 1);
+				}
+			}
+
+			if (failed)
+				continue;
+
+			set->pilots = pilots;
+			set->slots = slots;
+			set->names = set->name_storage.data();
+			set->bucket_count = bucket_count;
+			set->slot_count = slot_count;
+			set->names_size = set->name_storage.size();
+			set->entry_count = n;
+			set->seed = seed;
+
+			return set;
+		}
+
+		delete set;
+		return nullptr;
+	}
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "rulefile.hpp"
+#include "patternset.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#define TUNMODE_DOMAIN_MAX_LENGTH 253
+
+namespace tunmode
+{
+	/*
+	 * Compact set of blocked domain names answering "is this name or
+	 * any parent domain in the set?".
+	 *
+	 * Names are placed by a perfect hash function (PTHash-style: one
+	 * 16-bit pilot per bucket of about five names) into slots holding a
+	 * 32-bit fingerprint and the offset of the name itself. A probe
+	 * touches two cache lines; only a fingerprint match reads the stored
+	 * name, which is compared in full, so a name that is not in the set
+	 * never matches.
+	 *
+	 * About 10 bytes per name plus its length; the tables can run
+	 * directly on top of a mapped rule file (see save() / load()).
+	 *
+	 * Wildcard rules such as "ads*.example.*" go to a PatternSet instead
+	 * and are checked in the same call.
+	 */
+	class DomainSet
+	{
+	public:
+		DomainSet();
+
+		/* `name` may be mixed case and end in a dot */
+		bool contains(const char* name, size_t length) const;
+
+		bool   is_empty() const;
+		size_t get_entry_count() const;    // exact names only
+		size_t get_memory_usage() const;
+		double get_bytes_per_entry() const;
+
+		const PatternSet* get_patterns() const;    // nullptr if there are none
+
+		bool save(const char* path) const;
+		static DomainSet* load(const char* path, bool verify = true);
+
+		/* Lowercases and strips a leading "*." / "." and a trailing "."; false if not a host name */
+		static bool normalize(const char* name, size_t length, char* out, size_t& out_length);
+
+	private:
+		const uint16_t* pilots;
+		const uint64_t* slots;    // fingerprint << 32 | name offset + 1, 0 = empty
+		const uint8_t*  names;    // per name: length byte, then the normalized name
+		size_t          bucket_count;
+		size_t          slot_count;
+		size_t          names_size;
+		size_t          entry_count;
+		uint64_t        seed;
+
+		std::vector<uint16_t> pilot_storage;
+		std::vector<uint64_t> slot_storage;
+		std::vector<uint8_t>  name_storage;
+		std::shared_ptr<RuleFile> file;
+		std::unique_ptr<PatternSet> patterns;
+
+		/* `name` is normalized and hashes to `hash` */
+		bool contains_hash(uint64_t hash, const char* name, size_t length) const;
+
+		static uint64_t hash(const char* name, size_t length);
+		static uint64_t mix(uint64_t value);
+		static uint32_t fingerprint(uint64_t hash);
+		static size_t   bucket(uint64_t hash, size_t bucket_count);
+		static size_t   position(uint64_t hash, uint16_t pilot, size_t slot_count);
+
+		friend class DomainSetBuilder;
+	};
+
+	class DomainSetBuilder
+	{
+	public:
+		DomainSetBuilder();
+
+		/* Names with wildcards go to the pattern automaton */
+		bool add(const char* name, size_t length);
+
+		size_t get_count() const;            // names and patterns
+		size_t get_pattern_count() const;
+
+		/*
+		 * nullptr only if no seed yields a perfect placement, which in
+		 * practice never happens. Patterns beyond the automaton budget are
+		 * left out (see PatternSetBuilder::build()).
+		 */
+		DomainSet* build();
+
+	private:
+		typedef struct __DOMAIN_KEY__ {
+			uint64_t hash;      // of the normalized name, before seeding
+			uint32_t offset;    // into `names`
+		} Key;
+
+		std::vector<Key>     keys;
+		std::vector<uint8_t> names;    // same layout as DomainSet::names
+		PatternSetBuilder patterns;
+	};
+}
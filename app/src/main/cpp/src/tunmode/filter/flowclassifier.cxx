@@ -0,0 +1,305 @@
+#include <tunmode/filter/flowclassifier.hpp>
+#include <tunmode/filter/ipparser.hpp>
+#include <tunmode/definitions.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <map>
+#include <string_view>
+#include <tuple>
+
+namespace tunmode
+{
+	FlowClassifier::FlowClassifier() {}
+
+	size_t FlowClassifier::hash(uint8_t protocol, uint32_t src, uint32_t dst, uint16_t port)
+	{
+		uint64_t h = ((uint64_t)src << 32) | dst;
+		h ^= ((uint64_t)port << 8 | protocol) * 0xC2B2AE3D27D4EB4Full;
+		h *= 0x9E3779B97F4A7C15ull;
+		return (size_t)(h ^ (h >> 29));
+	}
+
+	uint32_t FlowClassifier::lookup(uint8_t protocol, uint32_t src, uint32_t dst, uint16_t port) const
+	{
+		uint32_t best = NO_MATCH;
+
+		for (const Tuple& tuple : this->tuples)
+		{
+			// Every later tuple ranks worse than what we already have
+			if (tuple.best_rank >= best)
+				break;
+
+			uint8_t  p = protocol & tuple.protocol_mask;
+			uint32_t s = src & tuple.src_mask;
+			uint32_t d = dst & tuple.dst_mask;
+			uint16_t o = port & tuple.port_mask;
+
+			size_t index = hash(p, s, d, o) & tuple.mask;
+
+			while (tuple.entries[index].used)
+			{
+				const Entry& entry = tuple.entries[index];
+
+				if ((entry.src == s) && (entry.dst == d) && (entry.port == o) && (entry.protocol == p))
+				{
+					best = std::min(best, entry.rank);
+					break;
+				}
+
+				index = (index + 1) & tuple.mask;
+			}
+		}
+
+		return (best == NO_MATCH) ? NO_MATCH : this->ranked[best];
+	}
+
+	size_t FlowClassifier::get_rule_count() const
+	{
+		return this->rules.size();
+	}
+
+	const FlowRule& FlowClassifier::get_rule(uint32_t index) const
+	{
+		return this->rules[index];
+	}
+
+	size_t FlowClassifier::get_tuple_count() const
+	{
+		return this->tuples.size();
+	}
+
+	FlowClassifierBuilder::FlowClassifierBuilder() {}
+
+	bool FlowClassifierBuilder::add(const FlowRule& rule)
+	{
+		if ((rule.verdict != VERDICT_ALLOW) && (rule.verdict != VERDICT_BLOCK))
+			return false;
+
+		if ((rule.src_prefix > 32) || (rule.dst_prefix > 32) || (rule.port_min > rule.port_max))
+			return false;
+
+		FlowRule normalized = rule;
+		normalized.src_addr &= ipparser::prefix_mask(rule.src_prefix);
+		normalized.dst_addr &= ipparser::prefix_mask(rule.dst_prefix);
+
+		this->rules.push_back(normalized);
+		return true;
+	}
+
+	static bool _parse_address(std::string_view token, uint32_t& addr, uint8_t& prefix)
+	{
+		if (token == "any")
+		{
+			addr = 0;
+			prefix = 0;
+			return true;
+		}
+
+		return ipparser::parse_cidr(token.data(), token.data() + token.size(), addr, prefix);
+	}
+
+	template <typename T>
+	static bool _parse_number(std::string_view token, T& value)
+	{
+		auto result = std::from_chars(token.data(), token.data() + token.size(), value);
+		return (result.ec == std::errc()) && (result.ptr == token.data() + token.size());
+	}
+
+	static bool _parse_ports(std::string_view token, uint16_t& min, uint16_t& max)
+	{
+		size_t dash = token.find('-');
+
+		if (dash == std::string_view::npos)
+		{
+			if (!_parse_number(token, min))
+				return false;
+
+			max = min;
+			return true;
+		}
+
+		return _parse_number(token.substr(0, dash), min) && _parse_number(token.substr(dash + 1), max);
+	}
+
+	bool FlowClassifierBuilder::add(const char* text, size_t length)
+	{
+		std::vector<std::string_view> tokens;
+		std::string_view line(text, length);
+
+		line = line.substr(0, line.find('#'));
+
+		for (size_t pos = 0; pos < line.size();)
+		{
+			size_t begin = line.find_first_not_of(" \t\r", pos);
+
+			if (begin == std::string_view::npos)
+				break;
+
+			size_t end = line.find_first_of(" \t\r", begin);
+
+			if (end == std::string_view::npos)
+				end = line.size();
+
+			tokens.push_back(line.substr(begin, end - begin));
+			pos = end;
+		}
+
+		if (tokens.empty())
+			return false;
+
+		FlowRule rule{0, VERDICT_NONE, 0, 0, 0, 0, 0, 0, 0xFFFF};
+
+		if (tokens[0] == "block")
+			rule.verdict = VERDICT_BLOCK;
+		else if (tokens[0] == "allow")
+			rule.verdict = VERDICT_ALLOW;
+		else
+			return false;
+
+		for (size_t i = 1; i < tokens.size(); i++)
+		{
+			std::string_view token = tokens[i];
+			bool has_value = i + 1 < tokens.size();
+
+			if (token == "tcp")
+				rule.protocol = TUNMODE_PROTOCOL_TCP;
+			else if (token == "udp")
+				rule.protocol = TUNMODE_PROTOCOL_UDP;
+			else if (token == "any")
+				rule.protocol = 0;
+			else if ((token == "from") && has_value)
+			{
+				if (!_parse_address(tokens[++i], rule.src_addr, rule.src_prefix))
+					return false;
+			}
+			else if ((token == "to") && has_value)
+			{
+				if (!_parse_address(tokens[++i], rule.dst_addr, rule.dst_prefix))
+					return false;
+			}
+			else if ((token == "port") && has_value)
+			{
+				if (!_parse_ports(tokens[++i], rule.port_min, rule.port_max))
+					return false;
+			}
+			else if ((token == "priority") && has_value)
+			{
+				if (!_parse_number(tokens[++i], rule.priority))
+					return false;
+			}
+			else
+				return false;
+		}
+
+		return this->add(rule);
+	}
+
+	size_t FlowClassifierBuilder::get_count() const
+	{
+		return this->rules.size();
+	}
+
+	FlowClassifier* FlowClassifierBuilder::build()
+	{
+		typedef FlowClassifier::Entry Entry;
+		typedef FlowClassifier::Tuple Tuple;
+
+		FlowClassifier* classifier = new FlowClassifier();
+		classifier->rules = std::move(this->rules);
+		this->rules.clear();
+
+		const std::vector<FlowRule>& rules = classifier->rules;
+
+		classifier->ranked.resize(rules.size());
+
+		for (uint32_t i = 0; i < rules.size(); i++)
+			classifier->ranked[i] = i;
+
+		std::stable_sort(classifier->ranked.begin(), classifier->ranked.end(), [&](uint32_t a, uint32_t b) {
+			return rules[a].priority > rules[b].priority;
+		});
+
+		// (protocol mask, src prefix, dst prefix, port prefix) -> pending entries
+		std::map<std::tuple<uint8_t, uint8_t, uint8_t, uint8_t>, std::vector<Entry>> groups;
+
+		for (uint32_t rank = 0; rank < classifier->ranked.size(); rank++)
+		{
+			const FlowRule& rule = rules[classifier->ranked[rank]];
+			uint8_t protocol_mask = rule.protocol ? 0xFF : 0;
+
+			// Split the port range into prefix-aligned blocks
+			uint32_t low = rule.port_min;
+			uint32_t high = rule.port_max;
+
+			while (low <= high)
+			{
+				uint32_t size = low ? (low & (0 - low)) : 0x10000;
+				uint8_t port_prefix = 16;
+
+				while (low + size - 1 > high)
+					size >>= 1;
+
+				for (uint32_t s = size; s > 1; s >>= 1)
+					port_prefix--;
+
+				groups[{protocol_mask, rule.src_prefix, rule.dst_prefix, port_prefix}].push_back(
+					{rule.src_addr, rule.dst_addr, (uint16_t)low, rule.protocol, 1, rank});
+
+				low += size;
+			}
+		}
+
+		for (auto& group : groups)
+		{
+			std::vector<Entry>& pending = group.second;
+			Tuple tuple;
+
+			tuple.protocol_mask = std::get<0>(group.first);
+			tuple.src_mask = ipparser::prefix_mask(std::get<1>(group.first));
+			tuple.dst_mask = ipparser::prefix_mask(std::get<2>(group.first));
+			tuple.port_mask = (uint16_t)(ipparser::prefix_mask(std::get<3>(group.first)) >> 16);
+			tuple.best_rank = pending.front().rank;
+
+			// Keep the load factor at or below 3/4
+			size_t size = 4;
+
+			while (size < pending.size() + pending.size() / 3 + 1)
+				size <<= 1;
+
+			tuple.mask = size - 1;
+			tuple.entries.assign(size, Entry{0, 0, 0, 0, 0, 0});
+
+			// Pending entries are in rank order, so the first of a key wins
+			for (const Entry& entry : pending)
+			{
+				size_t index = FlowClassifier::hash(entry.protocol, entry.src, entry.dst, entry.port) & tuple.mask;
+				bool duplicate = false;
+
+				while (tuple.entries[index].used)
+				{
+					const Entry& other = tuple.entries[index];
+
+					if ((other.src == entry.src) && (other.dst == entry.dst) && (other.port == entry.port) && (other.protocol == entry.protocol))
+					{
+						duplicate = true;
+						break;
+					}
+
+					index = (index + 1) & tuple.mask;
+				}
+
+				if (!duplicate)
+					tuple.entries[index] = entry;
+			}
+
+			classifier->tuples.push_back(std::move(tuple));
+		}
+
+		std::sort(classifier->tuples.begin(), classifier->tuples.end(), [](const Tuple& a, const Tuple& b) {
+			return a.best_rank < b.best_rank;
+		});
+
+		return classifier;
+	}
+}
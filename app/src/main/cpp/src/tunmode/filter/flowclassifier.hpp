@@ -0,0 +1,96 @@
+#pragma once
+
+#include "verdictcache.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace tunmode
+{
+	typedef struct __FLOW_RULE__ {
+		int32_t  priority;      // higher wins, ties go to the earlier rule
+		uint8_t  verdict;       // VERDICT_ALLOW or VERDICT_BLOCK
+		uint8_t  protocol;      // TUNMODE_PROTOCOL_*, 0 = any
+		uint8_t  src_prefix;
+		uint8_t  dst_prefix;
+		uint32_t src_addr;      // host byte order, host bits cleared
+		uint32_t dst_addr;
+		uint16_t port_min;      // destination port range, inclusive
+		uint16_t port_max;
+	} FlowRule;
+
+	/*
+	 * Multi-field classifier over (protocol, source prefix, destination
+	 * prefix, destination port range) using tuple space search.
+	 *
+	 * Rules are grouped by their mask combination; each group is one
+	 * exact-match hash table. Port ranges are split into prefix-aligned
+	 * blocks. Groups are probed best rank first and the search stops as
+	 * soon as no remaining group can beat the current match, so lookup
+	 * cost follows the number of distinct masks, not the number of rules.
+	 */
+	class FlowClassifier
+	{
+	public:
+		static constexpr uint32_t NO_MATCH = 0xFFFFFFFF;
+
+		FlowClassifier();
+
+		/* Addresses in host byte order; returns the rule index or NO_MATCH */
+		uint32_t lookup(uint8_t protocol, uint32_t src, uint32_t dst, uint16_t port) const;
+
+		size_t          get_rule_count() const;
+		const FlowRule& get_rule(uint32_t index) const;
+		size_t          get_tuple_count() const;
+
+	private:
+		typedef struct __FLOW_ENTRY__ {
+			uint32_t src;
+			uint32_t dst;
+			uint16_t port;
+			uint8_t  protocol;
+			uint8_t  used;
+			uint32_t rank;    // position in priority order, lower is better
+		} Entry;
+
+		typedef struct __FLOW_TUPLE__ {
+			uint32_t src_mask;
+			uint32_t dst_mask;
+			uint16_t port_mask;
+			uint8_t  protocol_mask;
+			uint32_t best_rank;
+			size_t   mask;
+			std::vector<Entry> entries;
+		} Tuple;
+
+		std::vector<FlowRule> rules;
+		std::vector<uint32_t> ranked;    // rank -> rule index
+		std::vector<Tuple>    tuples;    // best rank first
+
+		static size_t hash(uint8_t protocol, uint32_t src, uint32_t dst, uint16_t port);
+
+		friend class FlowClassifierBuilder;
+	};
+
+	class FlowClassifierBuilder
+	{
+	public:
+		FlowClassifierBuilder();
+
+		bool add(const FlowRule& rule);
+
+		/*
+		 * One rule per line:
+		 *   block|allow [tcp|udp|any] [from CIDR|any] [to CIDR|any] [port N[-M]] [priority N]
+		 */
+		bool add(const char* text, size_t length);
+
+		size_t get_count() const;
+
+		FlowClassifier* build();
+
+	private:
+		std::vector<FlowRule> rules;
+	};
+}
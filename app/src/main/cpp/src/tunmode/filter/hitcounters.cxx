@@ -0,0 +1,284 @@
+#include <tunmode/filter/hitcounters.hpp>
+
+#include <atomic>
+#include <algorithm>
+#include <unordered_map>
+
+namespace tunmode
+{
+	namespace
+	{
+		constexpr size_t SKETCH_ROWS  = 4;
+		constexpr size_t SKETCH_BITS  = 10;
+		constexpr size_t SKETCH_WIDTH = 1 << SKETCH_BITS;
+		constexpr size_t RULE_PROBES  = 16;
+
+		constexpr uint64_t SKETCH_SEEDS[SKETCH_ROWS] = {
+			0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull, 0xD6E8FEB86659FD93ull
+		};
+
+		// Single writer per shard: a relaxed load and store, never a locked add
+		inline void bump(std::atomic<uint64_t>& counter, uint64_t value)
+		{
+			counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+		}
+
+		typedef struct __RULE_COUNTER__ {
+			std::atomic<uint64_t> key{0};        // 1 << 40 | addr << 8 | prefix, 0 = free
+			std::atomic<uint64_t> packets{0};
+			std::atomic<uint64_t> bytes{0};
+		} RuleCounter;
+
+		typedef struct __HITTER_SLOT__ {
+			std::atomic<uint64_t> key{0};        // 1 << 32 | addr, 0 = free
+			std::atomic<uint64_t> packets{0};
+			std::atomic<uint64_t> bytes{0};
+		} HitterSlot;
+
+		class TopK
+		{
+		public:
+			void add(uint32_t addr, uint32_t bytes)
+			{
+				uint64_t packets_estimate = UINT64_MAX;
+				uint64_t bytes_estimate = UINT64_MAX;
+
+				for (size_t r = 0; r < SKETCH_ROWS; r++)
+				{
+					size_t index = (size_t)(((uint64_t)addr * SKETCH_SEEDS[r]) >> (64 - SKETCH_BITS));
+
+					this->packets[r][index] += 1;
+					this->bytes[r][index] += bytes;
+
+					packets_estimate = std::min<uint64_t>(packets_estimate, this->packets[r][index]);
+					bytes_estimate = std::min<uint64_t>(bytes_estimate, this->bytes[r][index]);
+				}
+
+				uint64_t key = (1ull << 32) | addr;
+				size_t victim = 0;
+				uint64_t victim_packets = UINT64_MAX;
+
+				for (size_t i = 0; i < HitCounters::TOP_K; i++)
+				{
+					uint64_t slot_key = this->slots[i].key.load(std::memory_order_relaxed);
+
+					if (slot_key == key)
+					{
+						this->slots[i].packets.store(packets_estimate, std::memory_order_relaxed);
+						this->slots[i].bytes.store(bytes_estimate, std::memory_order_relaxed);
+						return;
+					}
+
+					uint64_t slot_packets = slot_key ? this->slots[i].packets.load(std::memory_order_relaxed) : 0;
+
+					if (slot_packets < victim_packets)
+					{
+						victim = i;
+						victim_packets = slot_packets;
+					}
+				}
+
+				// Space-saving style eviction of the weakest candidate
+				if (packets_estimate > victim_packets)
+				{
+					this->slots[victim].key.store(key, std::memory_order_relaxed);
+					this->slots[victim].packets.store(packets_estimate, std::memory_order_relaxed);
+					this->slots[victim].bytes.store(bytes_estimate, std::memory_order_relaxed);
+				}
+			}
+
+			void collect(std::unordered_map<uint32_t, HeavyHitter>& out) const
+			{
+				for (size_t i = 0; i < HitCounters::TOP_K; i++)
+				{
+					uint64_t key = this->slots[i].key.load(std::memory_order_relaxed);
+
+					if (key == 0)
+						continue;
+
+					HeavyHitter& hitter = out.try_emplace((uint32_t)key, HeavyHitter{(uint32_t)key, 0, 0}).first->second;
+					hitter.packets += this->slots[i].packets.load(std::memory_order_relaxed);
+					hitter.bytes += this->slots[i].bytes.load(std::memory_order_relaxed);
+				}
+			}
+
+		private:
+			// Owner thread only
+			uint64_t packets[SKETCH_ROWS][SKETCH_WIDTH] = {};
+			uint64_t bytes[SKETCH_ROWS][SKETCH_WIDTH] = {};
+
+			HitterSlot slots[HitCounters::TOP_K];
+		};
+
+		typedef struct alignas(64) __HIT_SHARD__ {
+			std::atomic<bool>     used{false};
+			std::atomic<uint64_t> untracked{0};
+			RuleCounter           rules[HitCounters::RULE_SLOTS];
+			TopK                  blocked;
+			TopK                  allowed;
+		} HitShard;
+
+		// Shards outlive their threads so that counts are kept; a new thread reuses a released one
+		std::atomic<HitShard*> shards[HitCounters::MAX_SHARDS];
+
+		class ShardOwner
+		{
+		public:
+			ShardOwner() : shard{nullptr}
+			{
+				for (int i = 0; i < HitCounters::MAX_SHARDS; i++)
+				{
+					HitShard* candidate = shards[i].load(std::memory_order_acquire);
+
+					if (candidate == nullptr)
+					{
+						HitShard* fresh = new HitShard();
+
+						if (shards[i].compare_exchange_strong(candidate, fresh, std::memory_order_acq_rel))
+							candidate = fresh;
+						else
+							delete fresh;
+					}
+
+					bool expected = false;
+
+					if (candidate->used.compare_exchange_strong(expected, true))
+					{
+						this->shard = candidate;
+						break;
+					}
+				}
+			}
+
+			~ShardOwner()
+			{
+				if (this->shard)
+				{
+					this->shard->used.store(false, std::memory_order_release);
+				}
+			}
+
+			HitShard* shard;
+		};
+
+		thread_local ShardOwner shard_owner;
+
+		template <typename T>
+		void _sort_by_packets(std::vector<T>& items)
+		{
+			std::sort(items.begin(), items.end(), [](const T& a, const T& b) {
+				return a.packets > b.packets;
+			});
+		}
+
+		std::vector<HeavyHitter> _top(const std::unordered_map<uint32_t, HeavyHitter>& merged, size_t k)
+		{
+			std::vector<HeavyHitter> top;
+			top.reserve(merged.size());
+
+			for (const auto& it : merged)
+			{
+				top.push_back(it.second);
+			}
+
+			_sort_by_packets(top);
+
+			if (top.size() > k)
+				top.resize(k);
+
+			return top;
+		}
+	}
+
+	void HitCounters::count_block(uint32_t addr, uint8_t prefix, uint32_t dst, uint32_t bytes)
+	{
+		HitShard* shard = shard_owner.shard;
+
+		if (!shard)
+			return;
+
+		uint64_t key = (1ull << 40) | ((uint64_t)addr << 8) | prefix;
+		size_t index = (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & (RULE_SLOTS - 1);
+
+		for (size_t probe = 0; probe < RULE_PROBES; probe++)
+		{
+			RuleCounter& counter = shard->rules[(index + probe) & (RULE_SLOTS - 1)];
+			uint64_t slot_key = counter.key.load(std::memory_order_relaxed);
+
+			if (slot_key == 0)
+			{
+				counter.key.store(key, std::memory_order_relaxed);
+				slot_key = key;
+			}
+
+			if (slot_key == key)
+			{
+				bump(counter.packets, 1);
+				bump(counter.bytes, bytes);
+				shard->blocked.add(dst, bytes);
+				return;
+			}
+		}
+
+		bump(shard->untracked, 1);
+		shard->blocked.add(dst, bytes);
+	}
+
+	void HitCounters::count_allow(uint32_t dst, uint32_t bytes)
+	{
+		HitShard* shard = shard_owner.shard;
+
+		if (shard)
+		{
+			shard->allowed.add(dst, bytes);
+		}
+	}
+
+	HitSnapshot HitCounters::snapshot(size_t k)
+	{
+		std::unordered_map<uint64_t, RuleHits> rules;
+		std::unordered_map<uint32_t, HeavyHitter> blocked;
+		std::unordered_map<uint32_t, HeavyHitter> allowed;
+		HitSnapshot snapshot{{}, {}, {}, 0};
+
+		for (int i = 0; i < MAX_SHARDS; i++)
+		{
+			const HitShard* shard = shards[i].load(std::memory_order_acquire);
+
+			if (!shard)
+				break;
+
+			for (size_t j = 0; j < RULE_SLOTS; j++)
+			{
+				const RuleCounter& counter = shard->rules[j];
+				uint64_t key = counter.key.load(std::memory_order_relaxed);
+
+				if (key == 0)
+					continue;
+
+				RuleHits& hits = rules.try_emplace(key, RuleHits{(uint32_t)(key >> 8), (uint8_t)key, 0, 0}).first->second;
+				hits.packets += counter.packets.load(std::memory_order_relaxed);
+				hits.bytes += counter.bytes.load(std::memory_order_relaxed);
+			}
+
+			snapshot.untracked += shard->untracked.load(std::memory_order_relaxed);
+
+			shard->blocked.collect(blocked);
+			shard->allowed.collect(allowed);
+		}
+
+		snapshot.rules.reserve(rules.size());
+
+		for (const auto& it : rules)
+		{
+			snapshot.rules.push_back(it.second);
+		}
+
+		_sort_by_packets(snapshot.rules);
+
+		snapshot.blocked = _top(blocked, k);
+		snapshot.allowed = _top(allowed, k);
+
+		return snapshot;
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace tunmode
+{
+	typedef struct __RULE_HITS__ {
+		uint32_t addr;      // host byte order
+		uint8_t  prefix;
+		uint64_t packets;
+		uint64_t bytes;
+	} RuleHits;
+
+	typedef struct __HEAVY_HITTER__ {
+		uint32_t addr;      // host byte order
+		uint64_t packets;   // count-min estimates, never below the true value
+		uint64_t bytes;
+	} HeavyHitter;
+
+	typedef struct __HIT_SNAPSHOT__ {
+		std::vector<RuleHits>    rules;       // most packets first
+		std::vector<HeavyHitter> blocked;     // most hit blocked destinations
+		std::vector<HeavyHitter> allowed;     // most active allowed destinations
+		uint64_t                 untracked;   // rule hits that found no free counter
+	} HitSnapshot;
+
+	/*
+	 * Per-rule and per-destination traffic counters.
+	 *
+	 * Every datapath thread counts into a shard of its own using plain
+	 * loads and stores, so the hot path has no read-modify-write and no
+	 * shared cache lines. snapshot() merges the shards on the reading
+	 * thread; a value read mid-update may miss the in-flight packet.
+	 *
+	 * Rules are counted by address and prefix, so counts survive rule
+	 * reloads. Destinations go through a count-min sketch with a small
+	 * candidate list per shard, which bounds memory however many
+	 * addresses pass through.
+	 */
+	class HitCounters
+	{
+	public:
+		static constexpr int    MAX_SHARDS = 64;
+		static constexpr size_t RULE_SLOTS = 2048;    // per shard
+		static constexpr size_t TOP_K      = 32;      // candidates per shard and direction
+
+		static void count_block(uint32_t addr, uint8_t prefix, uint32_t dst, uint32_t bytes);
+		static void count_allow(uint32_t dst, uint32_t bytes);
+
+		static HitSnapshot snapshot(size_t k = TOP_K);
+	};
+}
@@ -0,0 +1,263 @@
+#include <tunmode/filter/hostfilter.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace tunmode
+{
+	namespace
+	{
+		constexpr int      MAX_ATTEMPTS       = 64;        // seeds tried before giving up
+		constexpr uint32_t MAX_SEGMENT_LENGTH = 262144;
+
+		inline uint64_t _mulhi(uint64_t a, uint64_t b)
+		{
+			return (uint64_t)(((unsigned __int128)a * b) >> 64);
+		}
+
+		inline uint64_t _mix(uint64_t value)
+		{
+			value ^= value >> 33;
+			value *= 0xFF51AFD7ED558CCDull;
+			value ^= value >> 33;
+			value *= 0xC4CEB9FE1A85EC53ull;
+			value ^= value >> 33;
+			return value;
+		}
+
+		// Sizing from the reference implementation; construction speed is sensitive to it
+		void _layout(size_t count, HostFilterInfo& info)
+		{
+			double n = (double)std::max<size_t>(count, 2);
+			uint32_t segment_length = (uint32_t)1 << (int)std::floor(std::log(n) / std::log(3.33) + 2.25);
+			double size_factor = std::max(1.125, 0.875 + 0.25 * std::log(1000000.0) / std::log(n));
+			size_t capacity = (size_t)std::round(n * size_factor);
+
+			segment_length = std::min(segment_length, MAX_SEGMENT_LENGTH);
+
+			size_t segments = (capacity + segment_length - 1) / segment_length;
+			size_t segment_count = (segments > 2) ? segments - 2 : 1;
+
+			info.entry_count = (uint32_t)count;
+			info.segment_length = segment_length;
+			info.segment_count_length = (uint32_t)(segment_count * segment_length);
+			info.array_length = (uint32_t)((segment_count + 2) * segment_length);
+		}
+	}
+
+	HostFilter::HostFilter()
+	{
+		this->info = {0, 0, 0, 0, 0};
+		this->fingerprints = nullptr;
+	}
+
+	uint64_t HostFilter::hash(uint32_t addr, uint64_t seed)
+	{
+		return _mix(addr + seed);
+	}
+
+	uint8_t HostFilter::fingerprint(uint64_t hash)
+	{
+		return (uint8_t)(hash ^ (hash >> 32));
+	}
+
+	/* One position in each of three consecutive segments */
+	void HostFilter::positions(uint64_t hash, uint32_t (&out)[3]) const
+	{
+		uint32_t mask = this->info.segment_length - 1;
+		uint32_t h0 = (uint32_t)_mulhi(hash, this->info.segment_count_length);
+		uint32_t h1 = h0 + this->info.segment_length;
+		uint32_t h2 = h1 + this->info.segment_length;
+
+		out[0] = h0;
+		out[1] = h1 ^ ((uint32_t)(hash >> 18) & mask);
+		out[2] = h2 ^ ((uint32_t)hash & mask);
+	}
+
+	bool HostFilter::may_contain(uint32_t addr) const
+	{
+		if (this->info.entry_count == 0)
+			return false;
+
+		uint64_t h = hash(addr, this->info.seed);
+		uint32_t p[3];
+
+		this->positions(h, p);
+
+		return (fingerprint(h) ^ this->fingerprints[p[0]] ^ this->fingerprints[p[1]] ^ this->fingerprints[p[2]]) == 0;
+	}
+
+	void HostFilter::prefetch(uint32_t addr) const
+	{
+		if (this->info.entry_count == 0)
+			return;
+
+		uint32_t p[3];
+
+		this->positions(hash(addr, this->info.seed), p);
+
+		__builtin_prefetch(this->fingerprints + p[0]);
+		__builtin_prefetch(this->fingerprints + p[1]);
+		__builtin_prefetch(this->fingerprints + p[2]);
+	}
+
+	size_t HostFilter::get_entry_count() const
+	{
+		return this->info.entry_count;
+	}
+
+	size_t HostFilter::get_memory_usage() const
+	{
+		return this->info.entry_count ? this->info.array_length : 0;
+	}
+
+	/*
+	 * Peels the 3-hypergraph of (address -> three slots): a slot used by
+	 * exactly one address is assigned last, after the addresses that
+	 * remain once it is removed. Fails (and is retried with another seed)
+	 * if some core of addresses never comes apart.
+	 *
+	 * Takes about 14 bytes per address while building.
+	 */
+	HostFilter* HostFilter::build(const uint32_t* addrs, size_t count)
+	{
+		HostFilter* filter = new HostFilter();
+
+		if (count == 0)
+			return filter;
+
+		_layout(count, filter->info);
+
+		size_t length = filter->info.array_length;
+
+		std::vector<uint8_t>  counts(length);
+		std::vector<uint64_t> xors(length);
+		std::vector<uint32_t> alone;
+		std::vector<uint32_t> order;    // peeled slots; xors[slot] still holds its address hash
+
+		alone.reserve(length);
+		order.reserve(count);
+
+		for (int attempt = 0; attempt < MAX_ATTEMPTS; attempt++)
+		{
+			filter->info.seed = _mix(0x9E3779B97F4A7C15ull + attempt);
+
+			std::fill(counts.begin(), counts.end(), 0);
+			std::fill(xors.begin(), xors.end(), 0);
+			alone.clear();
+			order.clear();
+
+			bool overflow = false;
+
+			for (size_t i = 0; i < count; i++)
+			{
+				uint64_t h = hash(addrs[i], filter->info.seed);
+				uint32_t p[3];
+
+				filter->positions(h, p);
+
+				for (uint32_t slot : p)
+				{
+					overflow |= (counts[slot] == 0xFF);
+					counts[slot]++;
+					xors[slot] ^= h;
+				}
+			}
+
+			if (overflow)
+				continue;
+
+			for (uint32_t slot = 0; slot < length; slot++)
+			{
+				if (counts[slot] == 1)
+					alone.push_back(slot);
+			}
+
+			while (!alone.empty())
+			{
+				uint32_t slot = alone.back();
+				alone.pop_back();
+
+				if (counts[slot] != 1)
+					continue;
+
+				uint64_t h = xors[slot];
+				uint32_t p[3];
+
+				filter->positions(h, p);
+				order.push_back(slot);
+				counts[slot] = 0;
+
+				for (uint32_t other : p)
+				{
+					if (other == slot)
+						continue;
+
+					xors[other] ^= h;
+
+					if (--counts[other] == 1)
+						alone.push_back(other);
+				}
+			}
+
+			if (order.size() != count)
+				continue;
+
+			filter->fingerprint_storage.assign(length, 0);
+			uint8_t* fingerprints = filter->fingerprint_storage.data();
+
+			for (size_t i = order.size(); i-- > 0;)
+			{
+				uint32_t slot = order[i];
+				uint64_t h = xors[slot];
+				uint32_t p[3];
+
+				filter->positions(h, p);
+
+				// fingerprints[slot] is still 0 here
+				fingerprints[slot] = fingerprint(h) ^ fingerprints[p[0]] ^ fingerprints[p[1]] ^ fingerprints[p[2]];
+			}
+
+			filter->fingerprints = fingerprints;
+			return filter;
+		}
+
+		delete filter;
+		return nullptr;
+	}
+
+	void HostFilter::save(RuleFileWriter& writer) const
+	{
+		writer.add_section(&this->info, sizeof(HostFilterInfo));
+		writer.add_section(this->fingerprints, this->get_memory_usage());
+	}
+
+	HostFilter* HostFilter::load(const RuleFile& file, uint32_t first_section)
+	{
+		size_t info_size, fingerprints_size;
+		const HostFilterInfo* info = (const HostFilterInfo*)file.get_section(first_section, info_size);
+		const uint8_t* fingerprints = (const uint8_t*)file.get_section(first_section + 1, fingerprints_size);
+
+		if (!info || (info_size != sizeof(HostFilterInfo)))
+			return nullptr;
+
+		uint32_t segment_length = info->segment_length;
+
+		// Every position stays inside the table, even for a file loaded without verification
+		if (info->entry_count
+			&& ((segment_length == 0) || (segment_length & (segment_length - 1)) || (segment_length > MAX_SEGMENT_LENGTH)
+				|| (info->segment_count_length % segment_length)
+				|| ((uint64_t)info->segment_count_length + 2ull * segment_length != info->array_length)
+				|| (fingerprints_size != info->array_length)))
+		{
+			return nullptr;
+		}
+
+		HostFilter* filter = new HostFilter();
+
+		filter->info = *info;
+		filter->fingerprints = fingerprints;
+
+		return filter;
+	}
+}
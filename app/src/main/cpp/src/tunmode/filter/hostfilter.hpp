@@ -0,0 +1,60 @@
+#pragma once
+
+#include "rulefile.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace tunmode
+{
+	typedef struct __HOST_FILTER_INFO__ {
+		uint64_t seed;
+		uint32_t entry_count;
+		uint32_t segment_length;          // power of two
+		uint32_t segment_count_length;    // segment_count * segment_length
+		uint32_t array_length;            // fingerprints
+	} HostFilterInfo;
+
+	/*
+	 * Static approximate membership filter over IPv4 addresses: a 3-wise
+	 * binary fuse filter with 8-bit fingerprints (Graf & Lemire), about
+	 * 9 bits per address for large sets.
+	 *
+	 * A query reads three bytes from three neighbouring segments and
+	 * answers "maybe" for every address in the set and for about 1 in 256
+	 * of the others. Callers confirm a "maybe" against an exact list.
+	 *
+	 * The table can run directly on top of a mapped rule file (see
+	 * save() / load()).
+	 */
+	class HostFilter
+	{
+	public:
+		HostFilter();
+
+		bool may_contain(uint32_t addr) const;    // host byte order
+		void prefetch(uint32_t addr) const;       // lines may_contain() will read
+
+		size_t get_entry_count() const;
+		size_t get_memory_usage() const;
+
+		/* `addrs` must be free of duplicates; nullptr if no seed works, which in practice never happens */
+		static HostFilter* build(const uint32_t* addrs, size_t count);
+
+		/* Appends two sections to `writer` */
+		void save(RuleFileWriter& writer) const;
+		/* Table points into `file`, which must outlive the filter */
+		static HostFilter* load(const RuleFile& file, uint32_t first_section);
+
+	private:
+		HostFilterInfo info;
+		const uint8_t* fingerprints;
+
+		std::vector<uint8_t> fingerprint_storage;
+
+		static uint64_t hash(uint32_t addr, uint64_t seed);
+		static uint8_t  fingerprint(uint64_t hash);
+		void positions(uint64_t hash, uint32_t (&out)[3]) const;
+	};
+}
@@ -0,0 +1,252 @@
+#include <tunmode/filter/hostpeek.hpp>
+
+namespace tunmode::hostpeek
+{
+	namespace
+	{
+		// Bounds-checked big-endian reader over one buffer
+		class Reader
+		{
+		public:
+			Reader(const uint8_t* data, size_t size) : data{data}, size{size}, pos{0} {}
+
+			bool read8(size_t& value)
+			{
+				if (this->pos + 1 > this->size)
+					return false;
+
+				value = this->data[this->pos];
+				this->pos += 1;
+				return true;
+			}
+
+			bool read16(size_t& value)
+			{
+				if (this->pos + 2 > this->size)
+					return false;
+
+				value = ((size_t)this->data[this->pos] << 8) | this->data[this->pos + 1];
+				this->pos += 2;
+				return true;
+			}
+
+			bool read24(size_t& value)
+			{
+				if (this->pos + 3 > this->size)
+					return false;
+
+				value = ((size_t)this->data[this->pos] << 16) | ((size_t)this->data[this->pos + 1] << 8) | this->data[this->pos + 2];
+				this->pos += 3;
+				return true;
+			}
+
+			bool skip(size_t count)
+			{
+				if (this->pos + count > this->size)
+					return false;
+
+				this->pos += count;
+				return true;
+			}
+
+			/* Narrows the reader to the next `count` bytes */
+			bool sub(size_t count, Reader& out)
+			{
+				if (this->pos + count > this->size)
+					return false;
+
+				out = Reader(this->data + this->pos, count);
+				this->pos += count;
+				return true;
+			}
+
+			const uint8_t* here() const { return this->data + this->pos; }
+			bool at_end() const { return this->pos >= this->size; }
+
+		private:
+			const uint8_t* data;
+			size_t size;
+			size_t pos;
+		};
+
+		inline char _lower(char c)
+		{
+			return ((c >= 'A') && (c <= 'Z')) ? (char)(c + ('a' - 'A')) : c;
+		}
+	}
+
+	bool tls_server_name(const uint8_t* data, size_t size, const char*& name, size_t& length)
+	{
+		Reader record(data, size);
+		size_t type, version, record_length;
+
+		// Handshake record, TLS 1.0 - 1.3 record version
+		if (!record.read8(type) || (type != 22) || !record.read16(version) || ((version >> 8) != 3))
+			return false;
+
+		Reader hello(nullptr, 0);
+		size_t handshake_type, hello_length;
+
+		// The whole hello must sit in this one record and segment
+		if (!record.read16(record_length) || !record.sub(record_length, hello))
+			return false;
+
+		if (!hello.read8(handshake_type) || (handshake_type != 1) || !hello.read24(hello_length))
+			return false;
+
+		Reader body(nullptr, 0);
+		size_t session_id_length, cipher_suites_length, compression_length, extensions_length;
+
+		if (!hello.sub(hello_length, body))
+			return false;
+
+		// client_version, random, session_id, cipher_suites, compression_methods
+		if (!body.skip(2 + 32)
+			|| !body.read8(session_id_length) || !body.skip(session_id_length)
+			|| !body.read16(cipher_suites_length) || !body.skip(cipher_suites_length)
+			|| !body.read8(compression_length) || !body.skip(compression_length))
+		{
+			return false;
+		}
+
+		Reader extensions(nullptr, 0);
+
+		if (!body.read16(extensions_length) || !body.sub(extensions_length, extensions))
+			return false;
+
+		while (!extensions.at_end())
+		{
+			size_t extension_type, extension_length;
+			Reader extension(nullptr, 0);
+
+			if (!extensions.read16(extension_type) || !extensions.read16(extension_length)
+				|| !extensions.sub(extension_length, extension))
+			{
+				return false;
+			}
+
+			if (extension_type != 0)
+				continue;
+
+			size_t list_length;
+			Reader list(nullptr, 0);
+
+			if (!extension.read16(list_length) || !extension.sub(list_length, list))
+				return false;
+
+			while (!list.at_end())
+			{
+				size_t name_type, name_length;
+
+				if (!list.read8(name_type) || !list.read16(name_length))
+					return false;
+
+				const uint8_t* start = list.here();
+
+				if (!list.skip(name_length))
+					return false;
+
+				if ((name_type == 0) && (name_length > 0))
+				{
+					name = (const char*)start;
+					length = name_length;
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		return false;
+	}
+
+	size_t tls_record_size(const uint8_t* data, size_t size)
+	{
+		if ((size == 0) || (data[0] != 22))
+			return 0;
+
+		// Length not in yet: at least the header
+		if (size < 5)
+			return 5;
+
+		return 5 + (((size_t)data[3] << 8) | data[4]);
+	}
+
+	bool http_host(const uint8_t* data, size_t size, const char*& name, size_t& length)
+	{
+		const char* text = (const char*)data;
+		const char* end = text + size;
+		const char* p = text;
+
+		// Request line starts with an upper case method token
+		while ((p < end) && (*p >= 'A') && (*p <= 'Z'))
+			p++;
+
+		if ((p == text) || (p >= end) || (*p != ' '))
+			return false;
+
+		while (p < end)
+		{
+			// Start of the next header line
+			while ((p < end) && (*p != '\n'))
+				p++;
+
+			if (++p >= end)
+				return false;
+
+			// Blank line: end of the headers without a Host
+			if ((*p == '\r') || (*p == '\n'))
+				return false;
+
+			static const char host[] = "host:";
+
+			if (end - p < 5)
+				return false;
+
+			bool match = true;
+
+			for (int i = 0; i < 5; i++)
+			{
+				if (_lower(p[i]) != host[i])
+				{
+					match = false;
+					break;
+				}
+			}
+
+			if (!match)
+				continue;
+
+			p += 5;
+
+			while ((p < end) && ((*p == ' ') || (*p == '\t')))
+				p++;
+
+			const char* value = p;
+
+			while ((p < end) && (*p != '\r') && (*p != '\n') && (*p != ':') && (*p != ' '))
+				p++;
+
+			// Cut short by the segment, or an IPv6 literal
+			if ((p == end) || (p == value) || (*value == '['))
+				return false;
+
+			name = value;
+			length = p - value;
+			return true;
+		}
+
+		return false;
+	}
+
+	bool server_name(const uint8_t* data, size_t size, const char*& name, size_t& length)
+	{
+		if (size == 0)
+			return false;
+
+		if (data[0] == 22)
+			return tls_server_name(data, size, name, length);
+
+		return http_host(data, size, name, length);
+	}
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace tunmode::hostpeek
+{
+	// Server name from the SNI extension of a TLS ClientHello at the start
+	// of `data` (RFC 8446 4.1.2, RFC 6066 3). `name` points into `data`.
+	// False if the hello is not complete within `data`.
+	bool tls_server_name(const uint8_t* data, size_t size, const char*& name, size_t& length);
+
+	// Bytes from `data` to the end of the TLS handshake record it starts,
+	// header included; 0 if it does not start one. A ClientHello may take
+	// more segments than the first (post-quantum key shares do).
+	size_t tls_record_size(const uint8_t* data, size_t size);
+
+	// Host header of an HTTP/1.x request at the start of `data`, without
+	// the port. `name` points into `data`.
+	bool http_host(const uint8_t* data, size_t size, const char*& name, size_t& length);
+
+	// Either of the above. Looks at no more than `size` bytes, allocates nothing.
+	bool server_name(const uint8_t* data, size_t size, const char*& name, size_t& length);
+}
@@ -0,0 +1,454 @@
+#include <tunmode/filter/ipclassifier.hpp>
+#include <tunmode/filter/ipclassifiereditor.hpp>
+#include <tunmode/filter/ipparser.hpp>
+
+#include <arpa/inet.h>
+#include <algorithm>
+
+namespace tunmode
+{
+	IPClassifier::IPClassifier()
+	{
+		this->root_storage.assign(65536, 0);
+		this->shard_storage.assign(HOST_SHARDS, 0);
+
+		this->rules = nullptr;
+		this->root = this->root_storage.data();
+		this->chunks = nullptr;
+		this->host_shards = this->shard_storage.data();
+		this->hosts = nullptr;
+		this->rule_count = 0;
+		this->chunk_count = 0;
+		this->host_slot_count = 0;
+		this->filter_hosts = nullptr;
+		this->filter_starts = nullptr;
+		this->filter_count = 0;
+		this->filter_rule = 0;
+		this->edit_token = 0;
+	}
+
+	uint64_t IPClassifier::host_hash(uint32_t addr)
+	{
+		return (uint64_t)addr * 0x9E3779B97F4A7C15ull;
+	}
+
+	uint32_t IPClassifier::lookup(in_addr addr) const
+	{
+		return this->lookup(ntohl(addr.s_addr));
+	}
+
+	uint32_t IPClassifier::lookup(uint32_t addr) const
+	{
+		uint32_t entry = this->root[addr >> 16];
+
+		if (entry & ENTRY_HOSTS)
+		{
+			uint32_t rule = this->lookup_host(addr);
+
+			if (rule != NO_MATCH)
+				return rule;
+
+			entry &= ~ENTRY_HOSTS;
+		}
+
+		if (entry & ENTRY_CHUNK)
+		{
+			entry = this->chunks[((entry & ~ENTRY_CHUNK) << 8) | ((addr >> 8) & 0xFF)];
+
+			if (entry & ENTRY_CHUNK)
+			{
+				entry = this->chunks[((entry & ~ENTRY_CHUNK) << 8) | (addr & 0xFF)];
+			}
+		}
+
+		return entry ? (entry & ENTRY_RULE) - 1 : NO_MATCH;
+	}
+
+	void IPClassifier::lookup_batch(const uint32_t* addrs, uint32_t* results, size_t count) const
+	{
+		for (size_t begin = 0; begin < count; begin += BATCH)
+		{
+			size_t end = std::min(count, begin + BATCH);
+			uint32_t entries[BATCH];
+
+			for (size_t i = begin; i < end; i++)
+			{
+				__builtin_prefetch(this->root + (addrs[i] >> 16));
+			}
+
+			// Second level: host shard / filter slots, first chunk row
+			for (size_t i = begin; i < end; i++)
+			{
+				uint32_t addr = addrs[i];
+				uint32_t entry = this->root[addr >> 16];
+
+				entries[i - begin] = entry;
+
+				if (entry & ENTRY_HOSTS)
+				{
+					if (this->host_filter)
+					{
+						this->host_filter->prefetch(addr);
+						__builtin_prefetch(this->filter_starts + (addr >> 16));
+					}
+					else
+					{
+						__builtin_prefetch(this->host_shards + (host_hash(addr) >> (64 - HOST_SHARD_BITS)));
+					}
+				}
+
+				if (entry & ENTRY_CHUNK)
+					__builtin_prefetch(this->chunks + (((entry & ~ENTRY_HOSTS & ~ENTRY_CHUNK) << 8) | ((addr >> 8) & 0xFF)));
+			}
+
+			// Third level: host slots, second chunk row
+			for (size_t i = begin; i < end; i++)
+			{
+				uint32_t addr = addrs[i];
+				uint32_t entry = entries[i - begin];
+
+				if ((entry & ENTRY_HOSTS) && this->host_filter)
+				{
+					// Middle of the /16's run, where the binary search starts
+					const uint32_t* starts = this->filter_starts + (addr >> 16);
+					__builtin_prefetch(this->filter_hosts + (starts[0] + starts[1]) / 2);
+				}
+				else if (entry & ENTRY_HOSTS)
+				{
+					uint64_t h = host_hash(addr);
+					uint64_t shard = this->host_shards[h >> (64 - HOST_SHARD_BITS)];
+					uint32_t bits = (uint32_t)(shard & 0xFF);
+
+					if (bits)
+						__builtin_prefetch(this->hosts + (shard >> 8) + ((h >> (64 - HOST_SHARD_BITS - bits)) & (((size_t)1 << bits) - 1)));
+				}
+
+				if (entry & ENTRY_CHUNK)
+				{
+					entry = this->chunks[((entry & ~ENTRY_HOSTS & ~ENTRY_CHUNK) << 8) | ((addr >> 8) & 0xFF)];
+
+					if (entry & ENTRY_CHUNK)
+						__builtin_prefetch(this->chunks + (((entry & ~ENTRY_CHUNK) << 8) | (addr & 0xFF)));
+				}
+			}
+
+			// Everything is in flight or cached by now
+			for (size_t i = begin; i < end; i++)
+			{
+				results[i] = this->lookup(addrs[i]);
+			}
+		}
+	}
+
+	uint32_t IPClassifier::lookup_host(uint32_t addr) const
+	{
+		if (this->host_filter)
+			return this->lookup_filter(addr);
+
+		uint64_t h = host_hash(addr);
+		uint64_t shard = this->host_shards[h >> (64 - HOST_SHARD_BITS)];
+		uint32_t bits = (uint32_t)(shard & 0xFF);
+
+		if (bits == 0)
+			return NO_MATCH;
+
+		const uint64_t* slots = this->hosts + (shard >> 8);
+		size_t mask = ((size_t)1 << bits) - 1;
+		size_t index = (size_t)(h >> (64 - HOST_SHARD_BITS - bits)) & mask;
+
+		while (true)
+		{
+			uint64_t slot = slots[index];
+
+			if (slot == 0)
+				return NO_MATCH;
+
+			if ((uint32_t)slot == addr)
+				return (uint32_t)(slot >> 32) - 1;
+
+			index = (index + 1) & mask;
+		}
+	}
+
+	uint32_t IPClassifier::lookup_filter(uint32_t addr) const
+	{
+		if (!this->host_filter->may_contain(addr))
+			return NO_MATCH;
+
+		// Exact check, only for the ~1/256 of misses that get past the filter and for real hits
+		const uint32_t* begin = this->filter_hosts + this->filter_starts[addr >> 16];
+		const uint32_t* end = this->filter_hosts + this->filter_starts[(addr >> 16) + 1];
+		const uint32_t* host = std::lower_bound(begin, end, addr);
+
+		return ((host != end) && (*host == addr)) ? this->filter_rule : NO_MATCH;
+	}
+
+	size_t IPClassifier::get_rule_count() const
+	{
+		return this->rule_count;
+	}
+
+	const IPRule& IPClassifier::get_rule(uint32_t index) const
+	{
+		return this->rules[index];
+	}
+
+	bool IPClassifier::is_removed(uint32_t index) const
+	{
+		if (this->rules[index].flags & IPRULE_REMOVED)
+			return true;
+
+		return ((index >> 6) < this->removed_storage.size())
+			&& ((this->removed_storage[index >> 6] >> (index & 63)) & 1);
+	}
+
+	size_t IPClassifier::get_memory_usage() const
+	{
+		return this->rule_count * sizeof(IPRule)
+			+ 65536 * sizeof(uint32_t)
+			+ this->chunk_count * 256 * sizeof(uint32_t)
+			+ HOST_SHARDS * sizeof(uint64_t)
+			+ this->removed_storage.size() * sizeof(uint64_t)
+			+ this->host_slot_count * sizeof(uint64_t)
+			+ (this->host_filter ? this->host_filter->get_memory_usage() + 65537 * sizeof(uint32_t) : 0)
+			+ this->filter_count * sizeof(uint32_t);
+	}
+
+	const HostFilter* IPClassifier::get_host_filter() const
+	{
+		return this->host_filter.get();
+	}
+
+	const uint32_t* IPClassifier::get_filter_hosts(size_t& count) const
+	{
+		count = this->filter_count;
+		return this->filter_hosts;
+	}
+
+	size_t IPClassifier::get_entry_count() const
+	{
+		return this->host_filter ? this->rule_count - 1 + this->filter_count : this->rule_count;
+	}
+
+	/*
+	 * Sections: rules, root, chunks, host shards, host slots, then the
+	 * two of the host filter, the /16 starts and, unchecked, the filter
+	 * hosts if there is one.
+	 */
+	bool IPClassifier::save(const char* path) const
+	{
+		RuleFileWriter writer(RULEFILE_KIND_IP);
+
+		// Retired ids are only marked in the file, where nothing else shares the rules
+		std::vector<IPRule> marked;
+
+		if (!this->removed_storage.empty())
+		{
+			marked.assign(this->rules, this->rules + this->rule_count);
+
+			for (uint32_t i = 0; i < this->rule_count; i++)
+			{
+				if (this->is_removed(i))
+					marked[i].flags |= IPRULE_REMOVED;
+			}
+		}
+
+		writer.set_entry_count((uint32_t)this->rule_count);
+		writer.set_param(0, this->filter_rule);
+		writer.set_param(1, (uint32_t)this->filter_count);
+		writer.add_section(marked.empty() ? this->rules : marked.data(), this->rule_count * sizeof(IPRule));
+		writer.add_section(this->root, 65536 * sizeof(uint32_t));
+		writer.add_section(this->chunks, this->chunk_count * 256 * sizeof(uint32_t));
+		writer.add_section(this->host_shards, HOST_SHARDS * sizeof(uint64_t));
+		writer.add_section(this->hosts, this->host_slot_count * sizeof(uint64_t));
+
+		if (this->host_filter)
+		{
+			this->host_filter->save(writer);
+			writer.add_section(this->filter_starts, 65537 * sizeof(uint32_t));
+			writer.add_section(this->filter_hosts, this->filter_count * sizeof(uint32_t), false);
+		}
+
+		return writer.write(path);
+	}
+
+	IPClassifier* IPClassifier::load(const char* path, bool verify)
+	{
+		std::shared_ptr<RuleFile> file = RuleFile::open(path, RULEFILE_KIND_IP, verify);
+
+		if (!file || ((file->get_header().section_count != 5) && (file->get_header().section_count != 9)))
+			return nullptr;
+
+		size_t rules_size, root_size, chunks_size, shards_size, hosts_size;
+		const void* rules = file->get_section(0, rules_size);
+		const void* root = file->get_section(1, root_size);
+		const void* chunks = file->get_section(2, chunks_size);
+		const void* shards = file->get_section(3, shards_size);
+		const void* hosts = file->get_section(4, hosts_size);
+
+		if ((rules_size % sizeof(IPRule))
+			|| (root_size != 65536 * sizeof(uint32_t))
+			|| (chunks_size % (256 * sizeof(uint32_t)))
+			|| (shards_size != HOST_SHARDS * sizeof(uint64_t))
+			|| (hosts_size % sizeof(uint64_t)))
+		{
+			return nullptr;
+		}
+
+		const uint64_t* shard_table = (const uint64_t*)shards;
+		size_t host_slot_count = hosts_size / sizeof(uint64_t);
+
+		for (uint32_t i = 0; i < HOST_SHARDS; i++)
+		{
+			uint32_t bits = (uint32_t)(shard_table[i] & 0xFF);
+
+			if (bits && ((bits > 32) || ((shard_table[i] >> 8) + ((size_t)1 << bits) > host_slot_count)))
+				return nullptr;
+		}
+
+		const RuleFileHeader& header = file->get_header();
+		size_t rule_count = rules_size / sizeof(IPRule);
+		size_t chunk_count = chunks_size / (256 * sizeof(uint32_t));
+		const uint32_t* root_table = (const uint32_t*)root;
+		const uint32_t* chunk_table = (const uint32_t*)chunks;
+		const uint64_t* host_slots = (const uint64_t*)hosts;
+
+		// Every table read stays inside the tables, even for a file loaded without verification
+		for (uint32_t i = 0; i < 65536; i++)
+		{
+			uint32_t entry = root_table[i] & ~ENTRY_HOSTS;
+
+			if ((entry & ENTRY_CHUNK) ? ((entry & ~ENTRY_CHUNK) >= chunk_count) : ((entry & ENTRY_RULE) > rule_count))
+				return nullptr;
+		}
+
+		for (size_t i = 0; i < chunk_count * 256; i++)
+		{
+			uint32_t entry = chunk_table[i];
+
+			if ((entry & ENTRY_CHUNK) ? ((entry & ~ENTRY_CHUNK) >= chunk_count) : ((entry & ENTRY_RULE) > rule_count))
+				return nullptr;
+		}
+
+		for (size_t i = 0; i < host_slot_count; i++)
+		{
+			uint64_t rule = host_slots[i] >> 32;
+
+			if (host_slots[i] && ((rule == 0) || (rule > rule_count)))
+				return nullptr;
+		}
+
+		std::unique_ptr<HostFilter> host_filter;
+		const uint32_t* filter_starts = nullptr;
+		const uint32_t* filter_hosts = nullptr;
+
+		if (header.section_count == 9)
+		{
+			size_t starts_size, filter_hosts_size;
+
+			host_filter.reset(HostFilter::load(*file, 5));
+			filter_starts = (const uint32_t*)file->get_section(7, starts_size);
+			filter_hosts = (const uint32_t*)file->get_section(8, filter_hosts_size);
+
+			// The hosts themselves are only sized here: reading them would page them all in
+			if (!host_filter || (header.params[0] >= rule_count)
+				|| !(((const IPRule*)rules)[header.params[0]].flags & IPRULE_FILTER)
+				|| (host_filter->get_entry_count() != header.params[1])
+				|| (filter_hosts_size != (size_t)header.params[1] * sizeof(uint32_t))
+				|| (starts_size != 65537 * sizeof(uint32_t))
+				|| (filter_starts[0] != 0) || (filter_starts[65536] != header.params[1]))
+			{
+				return nullptr;
+			}
+
+			for (uint32_t i = 0; i < 65536; i++)
+			{
+				if (filter_starts[i] > filter_starts[i + 1])
+					return nullptr;
+			}
+		}
+
+		IPClassifier* classifier = new IPClassifier();
+
+		classifier->root_storage.clear();
+		classifier->root_storage.shrink_to_fit();
+		classifier->shard_storage.clear();
+		classifier->shard_storage.shrink_to_fit();
+
+		classifier->rules = (const IPRule*)rules;
+		classifier->root = root_table;
+		classifier->chunks = chunk_table;
+		classifier->host_shards = shard_table;
+		classifier->hosts = host_slots;
+		classifier->rule_count = rule_count;
+		classifier->chunk_count = chunk_count;
+		classifier->host_slot_count = host_slot_count;
+		classifier->host_filter = std::move(host_filter);
+		classifier->filter_hosts = filter_hosts;
+		classifier->filter_starts = filter_starts;
+		classifier->filter_count = classifier->host_filter ? header.params[1] : 0;
+		classifier->filter_rule = classifier->host_filter ? header.params[0] : 0;
+		classifier->backing.push_back(std::move(file));
+
+		return classifier;
+	}
+
+	IPClassifierBuilder::IPClassifierBuilder()
+	{
+		this->host_storage = IPHOSTS_AUTO;
+	}
+
+	bool IPClassifierBuilder::add(uint32_t addr, uint8_t prefix)
+	{
+		if ((prefix > 32) || (this->rules.size() >= IPClassifier::MAX_RULES))
+			return false;
+
+		this->rules.push_back({addr & ipparser::prefix_mask(prefix), prefix, 0, {0, 0}});
+		return true;
+	}
+
+	bool IPClassifierBuilder::add(const char* text, size_t length)
+	{
+		uint32_t addr;
+		uint8_t prefix;
+
+		if (!ipparser::parse_cidr(text, text + length, addr, prefix))
+			return false;
+
+		return this->add(addr, prefix);
+	}
+
+	void IPClassifierBuilder::set_host_storage(IPHostStorage storage)
+	{
+		this->host_storage = storage;
+	}
+
+	size_t IPClassifierBuilder::get_count() const
+	{
+		return this->rules.size();
+	}
+
+	const std::vector<IPRule>& IPClassifierBuilder::get_rules() const
+	{
+		return this->rules;
+	}
+
+	IPClassifier* IPClassifierBuilder::build()
+	{
+		IPClassifierEditor editor;
+		bool filter = this->host_storage == IPHOSTS_FILTER;
+
+		if (this->host_storage == IPHOSTS_AUTO)
+		{
+			size_t host_count = std::count_if(this->rules.begin(), this->rules.end(), [](const IPRule& rule) {
+				return rule.prefix == 32;
+			});
+
+			filter = host_count >= TUNMODE_HOST_FILTER_MIN;
+		}
+
+		IPClassifier* classifier = editor.build(this->rules, filter);
+		this->rules.clear();
+		return classifier;
+	}
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "rulefile.hpp"
+#include "hostfilter.hpp"
+
+#include <netinet/in.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#define TUNMODE_HOST_FILTER_MIN 65536
+
+namespace tunmode
+{
+	enum IPRuleFlags : uint8_t {
+		IPRULE_REMOVED = 1,    // id retired by an incremental update (rule files only, see is_removed())
+		IPRULE_FILTER = 2      // stands for every host of the filter, see get_filter_hosts()
+	};
+
+	enum IPHostStorage : uint8_t {
+		IPHOSTS_AUTO = 0,      // filter from TUNMODE_HOST_FILTER_MIN hosts on
+		IPHOSTS_TABLE = 1,
+		IPHOSTS_FILTER = 2
+	};
+
+	typedef struct __IP_RULE__ {
+		uint32_t addr;      // host byte order, host bits cleared
+		uint8_t  prefix;    // 0..32
+		uint8_t  flags;
+		uint8_t  reserved[2];
+	} IPRule;
+
+	/*
+	 * Longest-prefix-match table over IPv4 prefixes.
+	 *
+	 * Prefixes up to /31 are expanded into a 16-8-8 stride table
+	 * (at most three table reads). /32 entries live in a host table
+	 * split into 4096 independently sized open-addressing shards, which
+	 * is only probed when the /16 root entry says it holds hosts.
+	 *
+	 * For very large host lists the /32 entries can instead go to a
+	 * HostFilter (about 9 bits per host) backed by a sorted array of
+	 * the host addresses: only a filter hit binary searches it, so a
+	 * false positive of the filter never blocks anything. The hosts all
+	 * match one shared IPRULE_FILTER rule instead of a rule each. In a
+	 * rule file the array sits past the checksummed part, so a mapped
+	 * file only pages it in on filter hits.
+	 *
+	 * Lookups return the index of the matched rule or NO_MATCH.
+	 *
+	 * The tables are plain arrays so a classifier can also run directly
+	 * on top of a mapped rule file (see save() / load()), or share
+	 * unchanged chunks and shards with the snapshot it was edited from
+	 * (see IPClassifierEditor).
+	 */
+	class IPClassifier
+	{
+	public:
+		static constexpr uint32_t NO_MATCH = 0xFFFFFFFF;
+		static constexpr uint32_t MAX_RULES = 0x00FFFFFF;
+
+		IPClassifier();
+
+		uint32_t lookup(in_addr addr) const;
+		uint32_t lookup(uint32_t addr) const;    // host byte order
+
+		/*
+		 * `results[i] = lookup(addrs[i])`. Walks the batch one table level
+		 * at a time, prefetching the next level for every address before
+		 * reading any of it, so the cache misses of a burst overlap.
+		 */
+		void lookup_batch(const uint32_t* addrs, uint32_t* results, size_t count) const;
+
+		size_t        get_rule_count() const;
+		const IPRule& get_rule(uint32_t index) const;
+		bool          is_removed(uint32_t index) const;    // retired ids still count in get_rule_count()
+		size_t        get_memory_usage() const;
+
+		const HostFilter* get_host_filter() const;    // nullptr unless hosts are kept in a filter
+		/* Hosts kept in the filter, sorted; they aren't in the rules */
+		const uint32_t*   get_filter_hosts(size_t& count) const;
+		/* Rules plus filter hosts, without the rule they share */
+		size_t            get_entry_count() const;
+
+		bool save(const char* path) const;
+		static IPClassifier* load(const char* path, bool verify = true);
+
+	private:
+		static constexpr uint32_t ENTRY_CHUNK  = 0x80000000;    // low bits: chunk index
+		static constexpr uint32_t ENTRY_HOSTS  = 0x40000000;    // root only: /16 holds /32 hosts
+		static constexpr uint32_t ENTRY_RULE   = 0x00FFFFFF;    // leaf: rule index + 1
+		static constexpr uint32_t PREFIX_SHIFT = 24;            // leaf: prefix length
+
+		static constexpr size_t   BATCH = 16;    // addresses in flight per lookup_batch() round
+
+		static constexpr uint32_t HOST_SHARD_BITS = 12;
+		static constexpr uint32_t HOST_SHARDS = 1 << HOST_SHARD_BITS;
+
+		const IPRule*   rules;
+		const uint32_t* root;           // 65536 entries, indexed by addr >> 16
+		const uint32_t* chunks;         // 256 entries per chunk
+		const uint64_t* host_shards;    // slot offset << 8 | log2(slots), 0 = empty
+		const uint64_t* hosts;          // (rule + 1) << 32 | addr, 0 = empty
+		size_t          rule_count;
+		size_t          chunk_count;
+		size_t          host_slot_count;
+
+		// Filter backend: its hosts sorted by address, all matching rule `filter_rule`
+		std::unique_ptr<HostFilter> host_filter;
+		const uint32_t* filter_hosts;
+		const uint32_t* filter_starts;    // 65537 entries: first host of each /16
+		size_t          filter_count;
+		uint32_t        filter_rule;
+		std::vector<uint32_t> filter_host_storage;
+		std::vector<uint32_t> filter_start_storage;
+
+		// Backing storage: arenas shared with other snapshots, or a mapped rule file
+		std::vector<uint32_t> root_storage;
+		std::vector<uint64_t> shard_storage;
+		std::vector<uint64_t> removed_storage;    // bit per retired id; the shared rules are never written
+		std::vector<std::shared_ptr<const void>> backing;
+		uint64_t edit_token;
+
+		static uint64_t host_hash(uint32_t addr);
+
+		uint32_t lookup_host(uint32_t addr) const;
+		uint32_t lookup_filter(uint32_t addr) const;
+
+		friend class IPClassifierEditor;
+	};
+
+	class IPClassifierBuilder
+	{
+	public:
+		IPClassifierBuilder();
+
+		bool add(uint32_t addr, uint8_t prefix);    // host byte order
+		bool add(const char* text, size_t length);  // `a.b.c.d[/nn]`
+
+		void set_host_storage(IPHostStorage storage);
+
+		size_t                     get_count() const;
+		const std::vector<IPRule>& get_rules() const;
+
+		IPClassifier* build();
+
+	private:
+		std::vector<IPRule> rules;
+		IPHostStorage host_storage;
+	};
+}
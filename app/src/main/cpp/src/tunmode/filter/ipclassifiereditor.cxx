@@ -0,0 +1,604 @@
+#include <tunmode/filter/ipclassifiereditor.hpp>
+#include <tunmode/filter/ipparser.hpp>
+
+#include <algorithm>
+#include <atomic>
+
+namespace tunmode
+{
+	static std::atomic<uint64_t> _next_token{1};
+
+	IPClassifierEditor::IPClassifierEditor()
+	{
+		this->reset(0, 0, 0);
+	}
+
+	uint32_t IPClassifierEditor::shard_of(uint32_t addr)
+	{
+		return (uint32_t)(IPClassifier::host_hash(addr) >> (64 - IPClassifier::HOST_SHARD_BITS));
+	}
+
+	uint32_t IPClassifierEditor::leaf(uint8_t prefix, uint32_t rule)
+	{
+		return ((uint32_t)prefix << IPClassifier::PREFIX_SHIFT) | (rule + 1);
+	}
+
+	uint64_t IPClassifierEditor::key(uint32_t addr, uint8_t prefix)
+	{
+		return ((uint64_t)addr << 8) | prefix;
+	}
+
+	size_t IPClassifierEditor::get_live_count() const
+	{
+		return this->index.size();
+	}
+
+	void IPClassifierEditor::reset(size_t rule_capacity, size_t chunk_capacity, size_t slot_capacity)
+	{
+		this->token = _next_token.fetch_add(1);
+
+		this->rules = std::make_shared<Arena<IPRule>>(std::max<size_t>(rule_capacity, 64));
+		this->chunks = std::make_shared<Arena<uint32_t>>(std::max<size_t>(chunk_capacity, 16) * 256);
+		this->hosts = std::make_shared<Arena<uint64_t>>(std::max<size_t>(slot_capacity, 256));
+		this->root.assign(65536, 0);
+		this->shards.assign(IPClassifier::HOST_SHARDS, 0);
+		this->host_counts.assign(65536, 0);
+		this->removed.clear();
+		this->index.clear();
+
+		this->fresh_chunks = 0;
+		this->garbage_rules = 0;
+		this->garbage_chunks = 0;
+		this->garbage_slots = 0;
+		this->live_slots = 0;
+	}
+
+	IPClassifier* IPClassifierEditor::build(const std::vector<IPRule>& rules, bool filter_hosts)
+	{
+		// Shorter prefixes first so that longer ones overwrite them while expanding
+		std::vector<IPRule> sorted(rules);
+
+		std::sort(sorted.begin(), sorted.end(), [](const IPRule& a, const IPRule& b) {
+			return (a.prefix != b.prefix) ? (a.prefix < b.prefix) : (a.addr < b.addr);
+		});
+
+		size_t host_count = 0;
+
+		for (const IPRule& rule : sorted)
+		{
+			if (rule.prefix == 32)
+				host_count++;
+		}
+
+		if (filter_hosts)
+		{
+			this->reset(sorted.size() - host_count + 1, sorted.size() / 64, 0);
+			this->index.reserve(sorted.size() - host_count);
+
+			std::vector<HostEdit> edits;
+			auto hosts = sorted.end() - host_count;
+
+			for (auto it = sorted.begin(); it != hosts; it++)
+			{
+				this->add_rule(*it, edits);
+			}
+
+			return this->place_in_filter(hosts, sorted.end());
+		}
+
+		this->reset(sorted.size(), sorted.size() / 64, host_count * 2);
+		this->index.reserve(sorted.size());
+
+		std::vector<HostEdit> edits;
+		edits.reserve(host_count);
+
+		for (const IPRule& rule : sorted)
+		{
+			this->add_rule(rule, edits);
+		}
+
+		this->rewrite_hosts(edits);
+		return this->snapshot();
+	}
+
+	/*
+	 * Puts the /32 rules [begin, end), sorted by address, in a HostFilter
+	 * instead of the host shards. They become one shared IPRULE_FILTER
+	 * rule and are left out of the index, so the snapshot gets no edit
+	 * token and the next delta adopts it.
+	 */
+	IPClassifier* IPClassifierEditor::place_in_filter(std::vector<IPRule>::const_iterator begin, std::vector<IPRule>::const_iterator end)
+	{
+		std::vector<uint32_t> addrs;
+		addrs.reserve(end - begin);
+
+		for (auto it = begin; it != end; it++)
+		{
+			if (addrs.empty() || (addrs.back() != it->addr))
+				addrs.push_back(it->addr);
+		}
+
+		for (uint32_t addr : addrs)
+		{
+			this->host_counts[addr >> 16]++;
+			this->root[addr >> 16] |= IPClassifier::ENTRY_HOSTS;
+		}
+
+		HostFilter* filter = HostFilter::build(addrs.data(), addrs.size());
+
+		// No seed peeled the set: fall back to host shards, with a rule per host
+		if (!filter)
+		{
+			std::vector<HostEdit> edits;
+			edits.reserve(addrs.size());
+
+			for (uint32_t addr : addrs)
+			{
+				if (this->rules->get_size() >= IPClassifier::MAX_RULES)
+					break;
+
+				uint32_t id = (uint32_t)Arena<IPRule>::append(this->rules, 1);
+				this->rules->get_data()[id] = {addr, 32, 0, {0, 0}};
+				edits.push_back({addr, id + 1});
+			}
+
+			this->rewrite_hosts(edits);
+
+			IPClassifier* classifier = this->snapshot();
+			classifier->edit_token = 0;
+			return classifier;
+		}
+
+		uint32_t rule = (uint32_t)Arena<IPRule>::append(this->rules, 1);
+		this->rules->get_data()[rule] = {0, 32, IPRULE_FILTER, {0, 0}};
+
+		IPClassifier* classifier = this->snapshot();
+
+		// Counting pass over the sorted run
+		classifier->filter_start_storage.assign(65537, 0);
+		uint32_t* starts = classifier->filter_start_storage.data();
+
+		for (uint32_t addr : addrs)
+		{
+			starts[(addr >> 16) + 1]++;
+		}
+
+		for (size_t i = 0; i < 65536; i++)
+		{
+			starts[i + 1] += starts[i];
+		}
+
+		classifier->filter_count = addrs.size();
+		classifier->filter_host_storage = std::move(addrs);
+		classifier->filter_hosts = classifier->filter_host_storage.data();
+		classifier->filter_starts = starts;
+		classifier->filter_rule = rule;
+		classifier->host_filter.reset(filter);
+		classifier->edit_token = 0;
+
+		return classifier;
+	}
+
+	IPClassifier* IPClassifierEditor::apply(const IPClassifier& base, const std::vector<IPRule>& add, const std::vector<IPRule>& remove)
+	{
+		if (base.edit_token != this->token)
+			this->adopt(base);
+
+		// Everything that exists now is referenced by `base`
+		this->fresh_chunks = this->chunks->get_size() >> 8;
+
+		std::vector<HostEdit> edits;
+
+		for (const IPRule& rule : remove)
+		{
+			this->remove_rule(rule, edits);
+		}
+
+		for (const IPRule& rule : add)
+		{
+			this->add_rule(rule, edits);
+		}
+
+		this->rewrite_hosts(edits);
+
+		if (this->needs_compaction())
+		{
+			std::vector<IPRule> live;
+			live.reserve(this->index.size());
+
+			for (const auto& it : this->index)
+			{
+				live.push_back(this->rules->get_data()[it.second]);
+			}
+
+			return this->build(live);
+		}
+
+		return this->snapshot();
+	}
+
+	/* Takes over a snapshot made elsewhere (a full rebuild or a mapped rule file) */
+	void IPClassifierEditor::adopt(const IPClassifier& base)
+	{
+		this->reset(base.rule_count + base.filter_count, base.chunk_count, base.host_slot_count + base.filter_count * 2);
+
+		Arena<IPRule>::append(this->rules, base.rule_count);
+		Arena<uint32_t>::append(this->chunks, base.chunk_count * 256);
+		Arena<uint64_t>::append(this->hosts, base.host_slot_count);
+
+		std::copy(base.rules, base.rules + base.rule_count, this->rules->get_data());
+		std::copy(base.chunks, base.chunks + base.chunk_count * 256, this->chunks->get_data());
+		std::copy(base.hosts, base.hosts + base.host_slot_count, this->hosts->get_data());
+		std::copy(base.root, base.root + 65536, this->root.data());
+		std::copy(base.host_shards, base.host_shards + IPClassifier::HOST_SHARDS, this->shards.data());
+
+		this->index.reserve(base.rule_count + base.filter_count);
+
+		for (uint32_t i = 0; i < base.rule_count; i++)
+		{
+			const IPRule& rule = base.rules[i];
+
+			// The filter's shared rule retires once its hosts get rules of their own
+			if (base.is_removed(i) || (rule.flags & IPRULE_FILTER))
+			{
+				this->removed.resize(std::max<size_t>(this->removed.size(), (i >> 6) + 1), 0);
+				this->removed[i >> 6] |= (uint64_t)1 << (i & 63);
+				this->garbage_rules++;
+				continue;
+			}
+
+			this->index[key(rule.addr, rule.prefix)] = i;
+
+			if (rule.prefix == 32)
+				this->host_counts[rule.addr >> 16]++;
+		}
+
+		for (uint64_t shard : this->shards)
+		{
+			if (shard & 0xFF)
+				this->live_slots += (size_t)1 << (shard & 0xFF);
+		}
+
+		this->garbage_slots = base.host_slot_count - this->live_slots;
+
+		// Hosts of a filter go back into shards, which can be edited
+		std::vector<HostEdit> edits;
+		edits.reserve(base.filter_count);
+
+		for (size_t i = 0; i < base.filter_count; i++)
+		{
+			this->add_rule({base.filter_hosts[i], 32, 0, {0, 0}}, edits);
+		}
+
+		this->rewrite_hosts(edits);
+	}
+
+	bool IPClassifierEditor::needs_compaction() const
+	{
+		size_t chunk_count = this->chunks->get_size() >> 8;
+
+		return (this->garbage_rules * 2 > this->rules->get_size() + 1024)
+			|| (this->garbage_chunks * 2 > chunk_count + 256)
+			|| (this->garbage_slots > this->live_slots + 8192);
+	}
+
+	bool IPClassifierEditor::add_rule(const IPRule& rule, std::vector<HostEdit>& edits)
+	{
+		if ((rule.prefix > 32) || (this->rules->get_size() >= IPClassifier::MAX_RULES))
+			return false;
+
+		uint32_t addr = rule.addr & ipparser::prefix_mask(rule.prefix);
+
+		if (!this->index.emplace(key(addr, rule.prefix), (uint32_t)this->rules->get_size()).second)
+			return false;
+
+		uint32_t id = (uint32_t)Arena<IPRule>::append(this->rules, 1);
+		this->rules->get_data()[id] = {addr, rule.prefix, 0, {0, 0}};
+
+		if (rule.prefix == 32)
+		{
+			this->host_counts[addr >> 16]++;
+			edits.push_back({addr, id + 1});
+			return true;
+		}
+
+		uint32_t next = leaf(rule.prefix, id);
+		uint8_t prefix = rule.prefix;
+
+		this->apply_range(addr, prefix, [next, prefix](uint32_t entry) {
+			return ((entry == 0) || ((entry >> IPClassifier::PREFIX_SHIFT) <= prefix)) ? next : entry;
+		});
+
+		return true;
+	}
+
+	bool IPClassifierEditor::remove_rule(const IPRule& rule, std::vector<HostEdit>& edits)
+	{
+		if (rule.prefix > 32)
+			return false;
+
+		uint32_t addr = rule.addr & ipparser::prefix_mask(rule.prefix);
+		auto it = this->index.find(key(addr, rule.prefix));
+
+		if (it == this->index.end())
+			return false;
+
+		uint32_t id = it->second;
+		this->index.erase(it);
+
+		// The rule itself may be shared with live snapshots: only the next one sees it retired
+		this->removed.resize(std::max<size_t>(this->removed.size(), (id >> 6) + 1), 0);
+		this->removed[id >> 6] |= (uint64_t)1 << (id & 63);
+		this->garbage_rules++;
+
+		if (rule.prefix == 32)
+		{
+			this->host_counts[addr >> 16]--;
+			edits.push_back({addr, 0});
+			return true;
+		}
+
+		// Whatever this prefix shadowed takes its place again
+		uint32_t previous = leaf(rule.prefix, id);
+		uint32_t next = this->cover(addr, rule.prefix);
+
+		this->apply_range(addr, rule.prefix, [previous, next](uint32_t entry) {
+			return (entry == previous) ? next : entry;
+		});
+
+		return true;
+	}
+
+	/* Leaf of the longest live rule strictly shorter than `prefix` covering `addr` */
+	uint32_t IPClassifierEditor::cover(uint32_t addr, uint8_t prefix) const
+	{
+		for (int q = (int)prefix - 1; q >= 0; q--)
+		{
+			auto it = this->index.find(key(addr & ipparser::prefix_mask((uint8_t)q), (uint8_t)q));
+
+			if (it != this->index.end())
+				return leaf((uint8_t)q, it->second);
+		}
+
+		return 0;
+	}
+
+	uint32_t* IPClassifierEditor::chunk_slot(uint32_t chunk, uint32_t index)
+	{
+		return this->chunks->get_data() + ((size_t)chunk << 8) + index;
+	}
+
+	uint32_t IPClassifierEditor::alloc_chunk(uint32_t fill)
+	{
+		uint32_t chunk = (uint32_t)(Arena<uint32_t>::append(this->chunks, 256) >> 8);
+		std::fill_n(this->chunk_slot(chunk, 0), 256, fill);
+		return chunk;
+	}
+
+	/* Copy-on-write: chunks visible to a published snapshot are never modified */
+	uint32_t IPClassifierEditor::writable(uint32_t chunk)
+	{
+		if (chunk >= this->fresh_chunks)
+			return chunk;
+
+		uint32_t copy = this->alloc_chunk(0);
+		std::copy_n(this->chunk_slot(chunk, 0), 256, this->chunk_slot(copy, 0));
+		this->garbage_chunks++;
+		return copy;
+	}
+
+	uint32_t IPClassifierEditor::descend(uint32_t entry)
+	{
+		if (entry & IPClassifier::ENTRY_CHUNK)
+			return IPClassifier::ENTRY_CHUNK | this->writable(entry & ~IPClassifier::ENTRY_CHUNK);
+
+		return IPClassifier::ENTRY_CHUNK | this->alloc_chunk(entry);
+	}
+
+	/* Maps every leaf under `entry` through `f`, copying only chunks that change */
+	template <typename F>
+	uint32_t IPClassifierEditor::transform(uint32_t entry, const F& f)
+	{
+		if (!(entry & IPClassifier::ENTRY_CHUNK))
+			return f(entry);
+
+		uint32_t chunk = entry & ~IPClassifier::ENTRY_CHUNK;
+
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t current = *this->chunk_slot(chunk, i);
+			uint32_t next = this->transform(current, f);
+
+			if (next != current)
+			{
+				chunk = this->writable(chunk);
+				*this->chunk_slot(chunk, i) = next;
+			}
+		}
+
+		return IPClassifier::ENTRY_CHUNK | chunk;
+	}
+
+	template <typename F>
+	void IPClassifierEditor::apply_range(uint32_t addr, uint8_t prefix, const F& f)
+	{
+		constexpr uint32_t HOSTS = IPClassifier::ENTRY_HOSTS;
+
+		uint32_t top = addr >> 16;
+
+		if (prefix <= 16)
+		{
+			uint32_t span = 1u << (16 - prefix);
+
+			for (uint32_t i = top; i < top + span; i++)
+			{
+				this->root[i] = (this->root[i] & HOSTS) | this->transform(this->root[i] & ~HOSTS, f);
+			}
+
+			return;
+		}
+
+		uint32_t level1 = this->descend(this->root[top] & ~HOSTS);
+		this->root[top] = (this->root[top] & HOSTS) | level1;
+
+		uint32_t chunk1 = level1 & ~IPClassifier::ENTRY_CHUNK;
+		uint32_t mid = (addr >> 8) & 0xFF;
+
+		if (prefix <= 24)
+		{
+			uint32_t span = 1u << (24 - prefix);
+
+			for (uint32_t i = mid; i < mid + span; i++)
+			{
+				uint32_t next = this->transform(*this->chunk_slot(chunk1, i), f);
+				*this->chunk_slot(chunk1, i) = next;
+			}
+
+			return;
+		}
+
+		uint32_t level2 = this->descend(*this->chunk_slot(chunk1, mid));
+		*this->chunk_slot(chunk1, mid) = level2;
+
+		uint32_t chunk2 = level2 & ~IPClassifier::ENTRY_CHUNK;
+		uint32_t low = addr & 0xFF;
+		uint32_t span = 1u << (32 - prefix);
+
+		for (uint32_t i = low; i < low + span; i++)
+		{
+			*this->chunk_slot(chunk2, i) = f(*this->chunk_slot(chunk2, i));
+		}
+	}
+
+	/* Rebuilds every host shard named in `edits` into fresh slots */
+	void IPClassifierEditor::rewrite_hosts(std::vector<HostEdit>& edits)
+	{
+		if (edits.empty())
+			return;
+
+		std::stable_sort(edits.begin(), edits.end(), [](const HostEdit& a, const HostEdit& b) {
+			return shard_of(a.addr) < shard_of(b.addr);
+		});
+
+		std::vector<HostEdit> entries;
+
+		for (size_t begin = 0; begin < edits.size();)
+		{
+			uint32_t shard = shard_of(edits[begin].addr);
+			size_t end = begin;
+
+			while ((end < edits.size()) && (shard_of(edits[end].addr) == shard))
+				end++;
+
+			entries.clear();
+
+			uint64_t descriptor = this->shards[shard];
+			uint32_t bits = (uint32_t)(descriptor & 0xFF);
+
+			if (bits)
+			{
+				size_t size = (size_t)1 << bits;
+				const uint64_t* slots = this->hosts->get_data() + (descriptor >> 8);
+
+				for (size_t i = 0; i < size; i++)
+				{
+					if (slots[i])
+						entries.push_back({(uint32_t)slots[i], (uint32_t)(slots[i] >> 32)});
+				}
+
+				this->garbage_slots += size;
+				this->live_slots -= size;
+			}
+
+			entries.insert(entries.end(), edits.begin() + begin, edits.begin() + end);
+
+			// Later entries win; removals drop out
+			std::stable_sort(entries.begin(), entries.end(), [](const HostEdit& a, const HostEdit& b) {
+				return a.addr < b.addr;
+			});
+
+			size_t count = 0;
+
+			for (size_t i = 0; i < entries.size(); i++)
+			{
+				if ((i + 1 < entries.size()) && (entries[i + 1].addr == entries[i].addr))
+					continue;
+
+				if (entries[i].rule)
+					entries[count++] = entries[i];
+			}
+
+			entries.resize(count);
+			this->shards[shard] = this->write_shard(entries);
+
+			begin = end;
+		}
+
+		for (const HostEdit& edit : edits)
+		{
+			uint32_t top = edit.addr >> 16;
+
+			if (this->host_counts[top])
+				this->root[top] |= IPClassifier::ENTRY_HOSTS;
+			else
+				this->root[top] &= ~IPClassifier::ENTRY_HOSTS;
+		}
+	}
+
+	uint64_t IPClassifierEditor::write_shard(const std::vector<HostEdit>& entries)
+	{
+		if (entries.empty())
+			return 0;
+
+		// Keep the load factor at or below 3/4
+		uint32_t bits = 1;
+
+		while (((size_t)1 << bits) < entries.size() + entries.size() / 3 + 1)
+			bits++;
+
+		size_t size = (size_t)1 << bits;
+		size_t offset = Arena<uint64_t>::append(this->hosts, size);
+		uint64_t* slots = this->hosts->get_data() + offset;
+
+		std::fill_n(slots, size, 0);
+
+		for (const HostEdit& entry : entries)
+		{
+			uint64_t h = IPClassifier::host_hash(entry.addr);
+			size_t index = (size_t)(h >> (64 - IPClassifier::HOST_SHARD_BITS - bits)) & (size - 1);
+
+			while (slots[index])
+				index = (index + 1) & (size - 1);
+
+			slots[index] = ((uint64_t)entry.rule << 32) | entry.addr;
+		}
+
+		this->live_slots += size;
+		return ((uint64_t)offset << 8) | bits;
+	}
+
+	IPClassifier* IPClassifierEditor::snapshot() const
+	{
+		IPClassifier* classifier = new IPClassifier();
+
+		classifier->root_storage = this->root;
+		classifier->shard_storage = this->shards;
+		classifier->removed_storage = this->removed;
+
+		classifier->rules = this->rules->get_data();
+		classifier->root = classifier->root_storage.data();
+		classifier->chunks = this->chunks->get_data();
+		classifier->host_shards = classifier->shard_storage.data();
+		classifier->hosts = this->hosts->get_data();
+		classifier->rule_count = this->rules->get_size();
+		classifier->chunk_count = this->chunks->get_size() >> 8;
+		classifier->host_slot_count = this->hosts->get_size();
+
+		classifier->backing.push_back(this->rules);
+		classifier->backing.push_back(this->chunks);
+		classifier->backing.push_back(this->hosts);
+		classifier->edit_token = this->token;
+
+		return classifier;
+	}
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "ipclassifier.hpp"
+#include "../common/arena.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace tunmode
+{
+	/*
+	 * Produces IPClassifier snapshots and applies add/remove deltas to them.
+	 *
+	 * Snapshots made by the same editor share its rule, chunk and host
+	 * arenas. A delta copies only the chunks on the paths it touches and
+	 * rewrites only the host shards it touches; everything else is shared
+	 * with the previous snapshot, which stays valid for its readers.
+	 *
+	 * A snapshot built with its hosts in a HostFilter can't be patched in
+	 * place; the first delta against it moves them back into host shards.
+	 *
+	 * Not thread-safe: callers serialise edits (the rule set writer lock
+	 * does this for the global editor).
+	 */
+	class IPClassifierEditor
+	{
+	public:
+		IPClassifierEditor();
+
+		IPClassifier* build(const std::vector<IPRule>& rules, bool filter_hosts = false);
+
+		/* Removals are applied before additions */
+		IPClassifier* apply(const IPClassifier& base, const std::vector<IPRule>& add, const std::vector<IPRule>& remove);
+
+		size_t get_live_count() const;
+
+	private:
+		typedef struct __HOST_EDIT__ {
+			uint32_t addr;
+			uint32_t rule;    // rule index + 1, 0 = remove
+		} HostEdit;
+
+		uint64_t token;
+
+		std::shared_ptr<Arena<IPRule>>   rules;
+		std::shared_ptr<Arena<uint32_t>> chunks;
+		std::shared_ptr<Arena<uint64_t>> hosts;
+		std::vector<uint32_t> root;
+		std::vector<uint64_t> shards;
+		std::vector<uint32_t> host_counts;    // live /32 rules per /16
+		std::vector<uint64_t> removed;        // bit per retired rule id, copied into each snapshot
+
+		std::unordered_map<uint64_t, uint32_t> index;    // addr << 8 | prefix -> live rule
+
+		size_t fresh_chunks;    // chunks at or above this index are not shared yet
+		size_t garbage_rules;
+		size_t garbage_chunks;
+		size_t garbage_slots;
+		size_t live_slots;
+
+		void reset(size_t rule_capacity, size_t chunk_capacity, size_t slot_capacity);
+		void adopt(const IPClassifier& base);
+		bool needs_compaction() const;
+
+		bool add_rule(const IPRule& rule, std::vector<HostEdit>& edits);
+		bool remove_rule(const IPRule& rule, std::vector<HostEdit>& edits);
+
+		uint32_t* chunk_slot(uint32_t chunk, uint32_t index);
+		uint32_t  alloc_chunk(uint32_t fill);
+		uint32_t  writable(uint32_t chunk);
+		uint32_t  descend(uint32_t entry);
+		uint32_t  cover(uint32_t addr, uint8_t prefix) const;
+
+		template <typename F>
+		uint32_t transform(uint32_t entry, const F& f);
+
+		template <typename F>
+		void apply_range(uint32_t addr, uint8_t prefix, const F& f);
+
+		void     rewrite_hosts(std::vector<HostEdit>& edits);
+		IPClassifier* place_in_filter(std::vector<IPRule>::const_iterator begin, std::vector<IPRule>::const_iterator end);
+		uint64_t write_shard(const std::vector<HostEdit>& entries);
+
+		IPClassifier* snapshot() const;
+
+		static uint32_t shard_of(uint32_t addr);
+		static uint32_t leaf(uint8_t prefix, uint32_t rule);
+		static uint64_t key(uint32_t addr, uint8_t prefix);
+	};
+}
@@ -0,0 +1,115 @@
+#include <tunmode/filter/ipparser.hpp>
+
+namespace tunmode::ipparser
+{
+	uint32_t prefix_mask(uint8_t prefix)
+	{
+		return prefix == 0 ? 0 : (0xFFFFFFFFu << (32 - prefix));
+	}
+
+	bool parse_cidr(const char* begin, const char* end, uint32_t& addr, uint8_t& prefix)
+	{
+		const char* p = begin;
+		uint32_t result = 0;
+
+		for (int octet = 0; octet < 4; octet++)
+		{
+			if (octet > 0)
+			{
+				if ((p == end) || (*p != '.'))
+					return false;
+				p++;
+			}
+
+			uint32_t value = 0;
+			int digits = 0;
+
+			while ((p != end) && ((unsigned)(*p - '0') < 10) && (digits < 3))
+			{
+				value = value * 10 + (uint32_t)(*p - '0');
+				p++;
+				digits++;
+			}
+
+			if ((digits == 0) || (value > 255))
+				return false;
+
+			result = (result << 8) | value;
+		}
+
+		uint32_t plen = 32;
+
+		if ((p != end) && (*p == '/'))
+		{
+			p++;
+			plen = 0;
+			int digits = 0;
+
+			while ((p != end) && ((unsigned)(*p - '0') < 10) && (digits < 2))
+			{
+				plen = plen * 10 + (uint32_t)(*p - '0');
+				p++;
+				digits++;
+			}
+
+			if ((digits == 0) || (plen > 32))
+				return false;
+		}
+
+		if (p != end)
+			return false;
+
+		prefix = (uint8_t)plen;
+		addr = result & prefix_mask(prefix);
+		return true;
+	}
+
+	bool parse_cidr_fast(const char* begin, const char* end, uint32_t& addr, uint8_t& prefix)
+	{
+		// Longest valid input is "255.255.255.255/32"
+		uint32_t bad = (begin == end) | ((end - begin) > 18);
+
+		uint32_t result = 0;
+		uint32_t value = 0;
+		uint32_t digits = 0;
+		uint32_t dots = 0;
+		uint32_t slash = 0;
+
+		for (const char* p = begin; p < end; p++)
+		{
+			uint32_t c = (uint8_t)*p;
+			uint32_t d = c - '0';
+			uint32_t is_digit = d < 10;
+			uint32_t is_dot = c == '.';
+			uint32_t is_slash = c == '/';
+			uint32_t is_sep = is_dot | is_slash;
+
+			bad |= !(is_digit | is_sep);
+			bad |= is_sep & ((digits == 0) | (value > 255));
+			bad |= is_dot & (slash | (dots >= 3));
+			bad |= is_slash & (slash | (dots != 3));
+
+			result = is_sep ? ((result << 8) | value) : result;
+			dots += is_dot;
+			slash |= is_slash;
+
+			value = is_digit ? (value * 10 + d) : 0;
+			digits = is_digit ? (digits + 1) : 0;
+			bad |= digits > 3;
+		}
+
+		bad |= (digits == 0) | (dots != 3);
+
+		// Without a slash the last octet is still open
+		uint32_t plen = slash ? value : 32;
+		bad |= slash ? ((digits > 2) | (value > 32)) : (value > 255);
+		result = slash ? result : ((result << 8) | value);
+
+		if (bad)
+			return false;
+
+		prefix = (uint8_t)plen;
+		addr = result & prefix_mask(prefix);
+		return true;
+	}
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace tunmode::ipparser
+{
+	// Parses `a.b.c.d` or `a.b.c.d/nn` from [begin, end).
+	// `addr` is returned in host byte order with host bits cleared.
+	bool parse_cidr(const char* begin, const char* end, uint32_t& addr, uint8_t& prefix);
+
+	// Same contract as parse_cidr(), written for bulk list ingest:
+	// one pass, per-character work is select/or only.
+	bool parse_cidr_fast(const char* begin, const char* end, uint32_t& addr, uint8_t& prefix);
+
+	uint32_t prefix_mask(uint8_t prefix);
+}
\ No newline at end of file
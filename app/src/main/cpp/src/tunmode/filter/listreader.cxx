@@ -0,0 +1,276 @@
+#include <tunmode/filter/listreader.hpp>
+#include <tunmode/filter/ipparser.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <strings.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	#include <arm_neon.h>
+#elif defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+
+namespace tunmode
+{
+	static inline const char* _find_newline(const char* p, const char* end)
+	{
+#if defined(__aarch64__) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+		const uint8x16_t newline = vdupq_n_u8('\n');
+
+		for (; p + 16 <= end; p += 16)
+		{
+			uint8x16_t eq = vceqq_u8(vld1q_u8((const uint8_t*)p), newline);
+
+			if (vmaxvq_u8(eq))
+			{
+				// Narrow the 0x00/0xFF lanes to one nibble each
+				uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+				return p + (__builtin_ctzll(mask) >> 2);
+			}
+		}
+#elif defined(__SSE2__)
+		const __m128i newline = _mm_set1_epi8('\n');
+
+		for (; p + 16 <= end; p += 16)
+		{
+			int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)p), newline));
+
+			if (mask)
+				return p + __builtin_ctz(mask);
+		}
+#endif
+		const char* found = (const char*)memchr(p, '\n', end - p);
+		return found ? found : end;
+	}
+
+	static inline bool _is_space(char c)
+	{
+		return (c == ' ') || (c == '\t') || (c == '\r');
+	}
+
+	static bool _is_address_like(const char* begin, const char* end)
+	{
+		for (const char* p = begin; p < end; p++)
+		{
+			if (((*p < '0') || (*p > '9')) && (*p != '.') && (*p != '/'))
+				return false;
+		}
+
+		return true;
+	}
+
+	// Names every hosts file maps for itself; blocking them would break the device
+	static bool _is_local_name(const char* name, size_t length)
+	{
+		static const char* const names[] = {
+			"localhost", "localhost.localdomain", "local", "broadcasthost", "ip6-localhost", "ip6-loopback", "0.0.0.0"
+		};
+
+		for (const char* local : names)
+		{
+			if ((strlen(local) == length) && (strncasecmp(local, name, length) == 0))
+				return true;
+		}
+
+		return false;
+	}
+
+	ListReader::ListReader(IPClassifierBuilder& builder) : builder{builder}
+	{
+		this->line_count = 0;
+		this->domain_count = 0;
+		this->invalid_count = 0;
+	}
+
+	void ListReader::set_domain_callback(DomainCallback callback)
+	{
+		this->domain_callback = std::move(callback);
+	}
+
+	void ListReader::parse_line(const char* begin, const char* end)
+	{
+		this->line_count++;
+
+		while ((begin < end) && _is_space(*begin))
+			begin++;
+
+		for (const char* p = begin; p < end; p++)
+		{
+			if (*p == '#')
+			{
+				end = p;
+				break;
+			}
+		}
+
+		while ((end > begin) && _is_space(end[-1]))
+			end--;
+
+		if (begin == end)
+			return;
+
+		const char* token_end = begin;
+
+		while ((token_end < end) && !_is_space(*token_end))
+			token_end++;
+
+		uint32_t addr;
+		uint8_t prefix;
+
+		if (!ipparser::parse_cidr_fast(begin, token_end, addr, prefix))
+		{
+			// domain list line: a single bare name (a malformed address stays invalid)
+			if (this->domain_callback && (token_end == end) && !_is_address_like(begin, end))
+			{
+				this->domain_count++;
+				this->domain_callback(begin, end - begin);
+			}
+			else
+				this->invalid_count++;
+
+			return;
+		}
+
+		if (token_end == end)
+		{
+			if (!this->builder.add(addr, prefix))
+				this->invalid_count++;
+
+			return;
+		}
+
+		// hosts file line: the address is only a sink, every following token is a name
+		const char* p = token_end;
+
+		while (p < end)
+		{
+			while ((p < end) && _is_space(*p))
+				p++;
+
+			const char* name = p;
+
+			while ((p < end) && !_is_space(*p))
+				p++;
+
+			if ((p > name) && !_is_local_name(name, p - name))
+			{
+				this->domain_count++;
+
+				if (this->domain_callback)
+					this->domain_callback(name, p - name);
+			}
+		}
+	}
+
+	void ListReader::read_buffer(const char* data, size_t size)
+	{
+		const char* p = data;
+		const char* end = data + size;
+
+		while (p < end)
+		{
+			const char* newline = _find_newline(p, end);
+			this->parse_line(p, newline);
+			p = newline + 1;
+		}
+	}
+
+	bool ListReader::read_fd(int fd)
+	{
+		this->chunk.resize(TUNMODE_LIST_CHUNK_SIZE + TUNMODE_LIST_MAX_LINE);
+		char* buffer = this->chunk.data();
+
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+		size_t carry = 0;       // bytes of an unfinished line kept at the start of the buffer
+		bool skipping = false;  // current line exceeded TUNMODE_LIST_MAX_LINE
+
+		while (true)
+		{
+			ssize_t size = ::read(fd, buffer + carry, TUNMODE_LIST_CHUNK_SIZE);
+
+			if (size == -1)
+			{
+				if (errno == EINTR)
+					continue;
+
+				return false;
+			}
+
+			const char* end = buffer + carry + size;
+
+			if (size == 0)
+			{
+				if (carry && !skipping)
+					this->parse_line(buffer, end);
+
+				return true;
+			}
+
+			const char* p = buffer;
+
+			while (true)
+			{
+				const char* newline = _find_newline(p, end);
+
+				if (newline == end)
+					break;
+
+				if (skipping)
+				{
+					skipping = false;
+					this->line_count++;
+					this->invalid_count++;
+				}
+				else
+				{
+					this->parse_line(p, newline);
+				}
+
+				p = newline + 1;
+			}
+
+			carry = end - p;
+
+			if (carry > TUNMODE_LIST_MAX_LINE)
+			{
+				skipping = true;
+				carry = 0;
+			}
+			else if (carry)
+			{
+				memmove(buffer, p, carry);
+			}
+		}
+	}
+
+	bool ListReader::read_path(const char* path)
+	{
+		int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+
+		if (fd == -1)
+			return false;
+
+		bool ok = this->read_fd(fd);
+		::close(fd);
+		return ok;
+	}
+
+	size_t ListReader::get_line_count() const
+	{
+		return this->line_count;
+	}
+
+	size_t ListReader::get_domain_count() const
+	{
+		return this->domain_count;
+	}
+
+	size_t ListReader::get_invalid_count() const
+	{
+		return this->invalid_count;
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "ipclassifier.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#define TUNMODE_LIST_CHUNK_SIZE (256 * 1024)
+#define TUNMODE_LIST_MAX_LINE   1024
+
+namespace tunmode
+{
+	/*
+	 * Streaming reader for text blocklists.
+	 *
+	 * Accepts one entry per line:
+	 *     a.b.c.d
+	 *     a.b.c.d/nn
+	 *     0.0.0.0 host.name [alias ...]    (hosts file, names go to the domain callback)
+	 *     host.name                        (domain list, only with a domain callback)
+	 *     ads*.example.*                   (domain pattern, likewise)
+	 *     # comment / trailing comments
+	 *
+	 * Input is consumed in fixed-size chunks, so memory stays bounded no
+	 * matter how long the list is.
+	 */
+	class ListReader
+	{
+	public:
+		typedef std::function<void(const char* name, size_t length)> DomainCallback;
+
+		ListReader(IPClassifierBuilder& builder);
+
+		void set_domain_callback(DomainCallback callback);
+
+		bool read_fd(int fd);
+		bool read_path(const char* path);
+		void read_buffer(const char* data, size_t size);
+
+		size_t get_line_count() const;
+		size_t get_domain_count() const;
+		size_t get_invalid_count() const;
+
+	private:
+		IPClassifierBuilder& builder;
+		DomainCallback domain_callback;
+
+		size_t line_count;
+		size_t domain_count;
+		size_t invalid_count;
+
+		std::vector<char> chunk;
+
+		void parse_line(const char* begin, const char* end);
+	};
+}
@@ -0,0 +1,612 @@
+#include <tunmode/filter/patternset.hpp>
+
+#include <algorithm>
+#include <map>
+
+namespace tunmode
+{
+	namespace
+	{
+		// a-z, 0-9, '-', '_', '.', then everything else
+		constexpr int      SYMBOL_COUNT  = 40;
+		constexpr int      SYMBOL_DIGIT  = 26;
+		constexpr int      SYMBOL_DOT    = 38;
+		constexpr int      SYMBOL_OTHER  = 39;
+		constexpr uint64_t SYMBOL_ANY    = (1ull << SYMBOL_OTHER) - 1;    // any name character
+		constexpr uint64_t SYMBOL_ALL    = (1ull << SYMBOL_COUNT) - 1;
+
+		constexpr uint32_t NFA_BOUNDARY     = 0;    // start, or just past a subdomain's dot
+		constexpr uint32_t NFA_LABEL        = 1;    // inside a subdomain label
+		constexpr uint32_t NFA_SINK         = 2;    // past a trailing "*": accepts whatever follows
+		constexpr uint32_t NFA_ANYWHERE     = 3;    // a leading "*" before its first literal
+		constexpr uint32_t NFA_FIXED_STATES = 4;
+
+		constexpr size_t   MAX_PATTERN_LENGTH = 253;
+
+		inline int _symbol(uint8_t c)
+		{
+			if ((c >= 'a') && (c <= 'z'))
+				return c - 'a';
+			if ((c >= 'A') && (c <= 'Z'))
+				return c - 'A';
+			if ((c >= '0') && (c <= '9'))
+				return SYMBOL_DIGIT + (c - '0');
+			if (c == '-')
+				return 36;
+			if (c == '_')
+				return 37;
+			if (c == '.')
+				return SYMBOL_DOT;
+
+			return SYMBOL_OTHER;
+		}
+
+		typedef struct __NFA_STATE__ {
+			std::vector<std::pair<uint64_t, uint32_t>> edges;    // (symbols, target)
+			std::vector<uint32_t> epsilon;
+			bool accepting{false};
+		} NfaState;
+
+		/* Expands `states` in place to its epsilon closure, sorted */
+		void _closure(const std::vector<NfaState>& nfa, std::vector<uint32_t>& states,
+			std::vector<uint32_t>& marks, uint32_t& stamp)
+		{
+			stamp++;
+
+			for (uint32_t state : states)
+				marks[state] = stamp;
+
+			for (size_t i = 0; i < states.size(); i++)
+			{
+				for (uint32_t next : nfa[states[i]].epsilon)
+				{
+					if (marks[next] != stamp)
+					{
+						marks[next] = stamp;
+						states.push_back(next);
+					}
+				}
+			}
+
+			std::sort(states.begin(), states.end());
+			states.erase(std::unique(states.begin(), states.end()), states.end());
+		}
+	}
+
+	PatternSet::PatternSet()
+	{
+		this->info = {0, 0, 0, 0};
+		this->automata = nullptr;
+		this->classes = nullptr;
+		this->transitions = nullptr;
+		this->accepting = nullptr;
+		this->transition_count = 0;
+	}
+
+	bool PatternSet::matches(const char* name, size_t length) const
+	{
+		for (uint32_t a = 0; a < this->info.automaton_count; a++)
+		{
+			const PatternAutomaton& automaton = this->automata[a];
+			const uint8_t* classes = this->classes + (size_t)a * 256;
+			const uint16_t* transitions = this->transitions + automaton.first_transition;
+			const size_t class_count = automaton.class_count;
+			uint32_t state = 1;
+
+			for (size_t i = 0; (i < length) && state; i++)
+				state = transitions[state * class_count + classes[(uint8_t)name[i]]];
+
+			if (state && this->accepting[automaton.first_state + state])
+				return true;
+		}
+
+		return false;
+	}
+
+	size_t PatternSet::get_pattern_count() const
+	{
+		return this->info.pattern_count;
+	}
+
+	size_t PatternSet::get_automaton_count() const
+	{
+		return this->info.automaton_count;
+	}
+
+	size_t PatternSet::get_state_count() const
+	{
+		return this->info.state_count;
+	}
+
+	size_t PatternSet::get_memory_usage() const
+	{
+		return this->info.automaton_count * (sizeof(PatternAutomaton) + 256)
+			+ this->transition_count * sizeof(uint16_t) + this->info.state_count;
+	}
+
+	void PatternSet::save(RuleFileWriter& writer) const
+	{
+		writer.add_section(&this->info, sizeof(PatternSetInfo));
+		writer.add_section(this->automata, this->info.automaton_count * sizeof(PatternAutomaton));
+		writer.add_section(this->classes, this->info.automaton_count * 256);
+		writer.add_section(this->transitions, this->transition_count * sizeof(uint16_t));
+		writer.add_section(this->accepting, this->info.state_count);
+	}
+
+	PatternSet* PatternSet::load(const RuleFile& file, uint32_t first_section)
+	{
+		size_t info_size, automata_size, classes_size, transitions_size, accepting_size;
+		const PatternSetInfo* info = (const PatternSetInfo*)file.get_section(first_section, info_size);
+		const PatternAutomaton* automata = (const PatternAutomaton*)file.get_section(first_section + 1, automata_size);
+		const uint8_t* classes = (const uint8_t*)file.get_section(first_section + 2, classes_size);
+		const uint16_t* transitions = (const uint16_t*)file.get_section(first_section + 3, transitions_size);
+		const uint8_t* accepting = (const uint8_t*)file.get_section(first_section + 4, accepting_size);
+
+		if (!info || (info_size != sizeof(PatternSetInfo))
+			|| (info->state_count > TUNMODE_PATTERN_MAX_STATES)
+			|| (automata_size != (size_t)info->automaton_count * sizeof(PatternAutomaton))
+			|| (classes_size != (size_t)info->automaton_count * 256)
+			|| (transitions_size % sizeof(uint16_t))
+			|| (accepting_size != info->state_count))
+		{
+			return nullptr;
+		}
+
+		size_t transition_count = transitions_size / sizeof(uint16_t);
+
+		// Every step stays inside the tables, even for a file loaded without verification
+		for (uint32_t a = 0; a < info->automaton_count; a++)
+		{
+			const PatternAutomaton& automaton = automata[a];
+			size_t cells = (size_t)automaton.state_count * automaton.class_count;
+
+			if ((automaton.state_count < 2) || (automaton.class_count == 0) || (automaton.class_count > SYMBOL_COUNT)
+				|| ((size_t)automaton.first_state + automaton.state_count > info->state_count)
+				|| ((size_t)automaton.first_transition + cells > transition_count))
+			{
+				return nullptr;
+			}
+
+			for (size_t i = 0; i < 256; i++)
+			{
+				if (classes[a * 256 + i] >= automaton.class_count)
+					return nullptr;
+			}
+
+			for (size_t i = 0; i < cells; i++)
+			{
+				if (transitions[automaton.first_transition + i] >= automaton.state_count)
+					return nullptr;
+			}
+		}
+
+		PatternSet* set = new PatternSet();
+
+		set->info = *info;
+		set->automata = automata;
+		set->classes = classes;
+		set->transitions = transitions;
+		set->accepting = accepting;
+		set->transition_count = transition_count;
+
+		return set;
+	}
+
+	PatternSetBuilder::PatternSetBuilder() {}
+
+	bool PatternSetBuilder::is_pattern(const char* name, size_t length)
+	{
+		// A leading "*." is the plain "this domain and below" form
+		if ((length >= 2) && (name[0] == '*') && (name[1] == '.'))
+		{
+			name += 2;
+			length -= 2;
+		}
+
+		for (size_t i = 0; i < length; i++)
+		{
+			char c = name[i];
+
+			if ((c == '*') || (c == '?') || (c == '[') || (c == '+'))
+				return true;
+		}
+
+		return false;
+	}
+
+	bool PatternSetBuilder::add(const char* pattern, size_t length)
+	{
+		if (length && (pattern[length - 1] == '.'))
+			length--;
+
+		if ((length == 0) || (length > MAX_PATTERN_LENGTH))
+			return false;
+
+		std::vector<Atom> atoms;
+		bool literal = false;
+
+		for (size_t i = 0; i < length; i++)
+		{
+			char c = pattern[i];
+
+			if (c == '*')
+			{
+				if (atoms.empty() || !atoms.back().star)
+					atoms.push_back({SYMBOL_ANY, true, false});
+			}
+			else if (c == '?')
+			{
+				atoms.push_back({SYMBOL_ANY, false, false});
+			}
+			else if (c == '[')
+			{
+				uint64_t symbols = 0;
+
+				for (i++; (i < length) && (pattern[i] != ']'); i++)
+				{
+					int first = _symbol(pattern[i]);
+
+					if (first == SYMBOL_OTHER)
+						return false;
+
+					if ((i + 2 < length) && (pattern[i + 1] == '-') && (pattern[i + 2] != ']'))
+					{
+						int last = _symbol(pattern[i + 2]);
+
+						// Ranges stay within the letters or within the digits
+						if ((last < first) || (last >= 36) || ((first < SYMBOL_DIGIT) != (last < SYMBOL_DIGIT)))
+							return false;
+
+						for (int symbol = first; symbol <= last; symbol++)
+							symbols |= 1ull << symbol;
+
+						i += 2;
+					}
+					else
+						symbols |= 1ull << first;
+				}
+
+				if ((i >= length) || (symbols == 0))
+					return false;
+
+				atoms.push_back({symbols, false, false});
+			}
+			else if (c == '+')
+			{
+				if (atoms.empty() || atoms.back().star || atoms.back().plus)
+					return false;
+
+				atoms.back().plus = true;
+			}
+			else
+			{
+				int symbol = _symbol(c);
+
+				if (symbol == SYMBOL_OTHER)
+					return false;
+
+				atoms.push_back({1ull << symbol, false, false});
+				literal = true;
+			}
+		}
+
+		// "*" or "[a-z]+" alone would block nearly everything
+		if (!literal)
+			return false;
+
+		this->patterns.push_back(std::move(atoms));
+		return true;
+	}
+
+	size_t PatternSetBuilder::get_count() const
+	{
+		return this->patterns.size();
+	}
+
+	PatternSet* PatternSetBuilder::build()
+	{
+		PatternSet* set = new PatternSet();
+		size_t count = this->patterns.size();
+		size_t built = 0;
+		size_t begin = 0;
+
+		while (begin < count)
+		{
+			PatternSet probe;
+			size_t max_states = std::min<size_t>(TUNMODE_PATTERN_DFA_STATES, TUNMODE_PATTERN_MAX_STATES - set->info.state_count);
+			size_t remaining = count - begin;
+			size_t fits = 0;
+			size_t fails = remaining + 1;
+
+			// Usually everything fits at once; otherwise gallop, then bisect
+			if (this->build_automaton(begin, count, max_states, &probe))
+				fits = remaining;
+
+			for (size_t size = 1; (fits < remaining) && (size < fails); size <<= 1)
+			{
+				if (this->build_automaton(begin, begin + std::min(size, remaining), max_states, &probe))
+					fits = std::min(size, remaining);
+				else
+					fails = size;
+			}
+
+			fails = std::min(fails, remaining);
+
+			while ((fits < remaining) && (fails - fits > 1))
+			{
+				size_t size = fits + (fails - fits) / 2;
+
+				if (this->build_automaton(begin, begin + size, max_states, &probe))
+					fits = size;
+				else
+					fails = size;
+			}
+
+			if (fits == 0)
+			{
+				// Out of states altogether
+				if (max_states < TUNMODE_PATTERN_DFA_STATES)
+					break;
+
+				// A single pattern too large for an automaton of its own
+				begin++;
+				continue;
+			}
+
+			if (!this->build_automaton(begin, begin + fits, max_states, set))
+				break;
+
+			built += fits;
+			begin += fits;
+		}
+
+		this->patterns.clear();
+
+		set->info.pattern_count = (uint32_t)built;
+		set->automata = set->automaton_storage.data();
+		set->classes = set->class_storage.data();
+		set->transitions = set->transition_storage.data();
+		set->accepting = set->accepting_storage.data();
+		set->transition_count = set->transition_storage.size();
+
+		return set;
+	}
+
+	bool PatternSetBuilder::build_automaton(size_t begin, size_t end, size_t max_states, PatternSet* set) const
+	{
+		// Thompson-style NFA over the fixed states below. Patterns hang off
+		// the shared boundary and anywhere states, so that a DFA state does
+		// not carry one start state per pattern
+		std::vector<NfaState> nfa(NFA_FIXED_STATES);
+
+		nfa[NFA_BOUNDARY].edges.push_back({SYMBOL_ANY, NFA_LABEL});
+		nfa[NFA_LABEL].edges.push_back({SYMBOL_ANY, NFA_LABEL});
+		nfa[NFA_LABEL].edges.push_back({1ull << SYMBOL_DOT, NFA_BOUNDARY});
+		nfa[NFA_SINK].edges.push_back({SYMBOL_ALL, NFA_SINK});
+		nfa[NFA_SINK].accepting = true;
+		nfa[NFA_ANYWHERE].edges.push_back({SYMBOL_ANY, NFA_ANYWHERE});
+
+		bool anywhere = false;
+
+		for (size_t p = begin; p < end; p++)
+		{
+			const std::vector<Atom>& atoms = this->patterns[p];
+			size_t first = atoms[0].star ? 1 : 0;
+			uint32_t entry = first ? NFA_ANYWHERE : NFA_BOUNDARY;
+			uint32_t base = (uint32_t)nfa.size();
+
+			// Position i (atoms before i matched) is the entry state for i == first
+			auto position = [&](size_t i) -> uint32_t {
+				return (i == first) ? entry : base + (uint32_t)(i - first - 1);
+			};
+
+			anywhere |= (first != 0);
+			nfa.resize(nfa.size() + atoms.size() - first);
+
+			for (size_t i = first; i < atoms.size(); i++)
+			{
+				uint32_t state = position(i);
+				const Atom& atom = atoms[i];
+
+				if (atom.star && (i + 1 == atoms.size()))
+				{
+					nfa[state].epsilon.push_back(NFA_SINK);
+				}
+				else if (atom.star)
+				{
+					nfa[state].edges.push_back({atom.symbols, state});
+					nfa[state].epsilon.push_back(position(i + 1));
+				}
+				else
+				{
+					nfa[state].edges.push_back({atom.symbols, position(i + 1)});
+
+					if (atom.plus)
+						nfa[position(i + 1)].edges.push_back({atom.symbols, position(i + 1)});
+				}
+			}
+
+			nfa[position(atoms.size())].accepting = !atoms.back().star;
+		}
+
+		if (anywhere)
+			nfa[NFA_BOUNDARY].epsilon.push_back(NFA_ANYWHERE);
+
+		// Subset construction. DFA state 0 is the empty (dead) set, 1 the start
+		std::vector<std::vector<uint32_t>> sets;
+		std::map<std::vector<uint32_t>, uint32_t> index;
+		std::vector<uint32_t> delta;
+		std::vector<uint8_t> accepting;
+		std::vector<uint32_t> marks(nfa.size(), 0);
+		uint32_t stamp = 0;
+
+		auto intern = [&](std::vector<uint32_t>& states) -> int64_t {
+			_closure(nfa, states, marks, stamp);
+
+			// Past a trailing "*" nothing else matters
+			if (marks[NFA_SINK] == stamp)
+				states.assign(1, NFA_SINK);
+
+			auto found = index.find(states);
+
+			if (found != index.end())
+				return found->second;
+
+			if (sets.size() >= max_states)
+				return -1;
+
+			bool accepts = false;
+
+			for (uint32_t state : states)
+				accepts |= nfa[state].accepting;
+
+			uint32_t id = (uint32_t)sets.size();
+			index.emplace(states, id);
+			sets.push_back(states);
+			accepting.push_back(accepts);
+			return id;
+		};
+
+		std::vector<uint32_t> targets;
+
+		if (max_states < 2)
+			return false;
+
+		intern(targets);
+		targets.assign(1, NFA_BOUNDARY);
+		intern(targets);
+
+		std::vector<std::vector<uint32_t>> moves(SYMBOL_COUNT);
+
+		for (size_t d = 0; d < sets.size(); d++)
+		{
+			for (std::vector<uint32_t>& move : moves)
+				move.clear();
+
+			// One pass over the edges, sorted out by symbol
+			for (uint32_t state : sets[d])
+			{
+				for (const auto& edge : nfa[state].edges)
+				{
+					for (uint64_t symbols = edge.first; symbols; symbols &= symbols - 1)
+						moves[__builtin_ctzll(symbols)].push_back(edge.second);
+				}
+			}
+
+			for (int symbol = 0; symbol < SYMBOL_COUNT; symbol++)
+			{
+				int64_t id = intern(moves[symbol]);
+
+				if (id < 0)
+					return false;
+
+				delta.push_back((uint32_t)id);
+			}
+		}
+
+		// Moore minimisation: split blocks by their successors' blocks until stable
+		size_t n = sets.size();
+		std::vector<uint32_t> block(n), next(n);
+		size_t block_count = 0;
+
+		for (size_t i = 0; i < n; i++)
+			block[i] = accepting[i];
+
+		while (true)
+		{
+			std::map<std::vector<uint32_t>, uint32_t> signatures;
+			std::vector<uint32_t> signature(SYMBOL_COUNT + 1);
+
+			for (size_t i = 0; i < n; i++)
+			{
+				signature[0] = block[i];
+
+				for (int symbol = 0; symbol < SYMBOL_COUNT; symbol++)
+					signature[symbol + 1] = block[delta[i * SYMBOL_COUNT + symbol]];
+
+				next[i] = signatures.emplace(signature, (uint32_t)signatures.size()).first->second;
+			}
+
+			block.swap(next);
+
+			if (signatures.size() == block_count)
+				break;
+
+			block_count = signatures.size();
+		}
+
+		// Patterns always hold a literal, so the start state is never dead
+		if (block[0] == block[1])
+			return false;
+
+		// Renumber so that the dead block is 0 and the start block 1
+		std::vector<int64_t> renumber(block_count, -1);
+		uint32_t state_count = 0;
+
+		renumber[block[0]] = state_count++;
+		renumber[block[1]] = state_count++;
+
+		for (size_t i = 0; i < n; i++)
+		{
+			if (renumber[block[i]] < 0)
+				renumber[block[i]] = state_count++;
+		}
+
+		std::vector<uint16_t> minimal(state_count * SYMBOL_COUNT);
+		std::vector<uint8_t> minimal_accepting(state_count, 0);
+
+		for (size_t i = 0; i < n; i++)
+		{
+			uint32_t state = (uint32_t)renumber[block[i]];
+
+			for (int symbol = 0; symbol < SYMBOL_COUNT; symbol++)
+				minimal[state * SYMBOL_COUNT + symbol] = (uint16_t)renumber[block[delta[i * SYMBOL_COUNT + symbol]]];
+
+			minimal_accepting[state] = accepting[i];
+		}
+
+		// Symbols with identical columns share a class
+		std::map<std::vector<uint16_t>, uint32_t> columns;
+		std::vector<uint32_t> symbol_class(SYMBOL_COUNT);
+		std::vector<int> class_symbol;
+		std::vector<uint16_t> column(state_count);
+
+		for (int symbol = 0; symbol < SYMBOL_COUNT; symbol++)
+		{
+			for (uint32_t state = 0; state < state_count; state++)
+				column[state] = minimal[state * SYMBOL_COUNT + symbol];
+
+			auto inserted = columns.emplace(column, (uint32_t)columns.size());
+
+			if (inserted.second)
+				class_symbol.push_back(symbol);
+
+			symbol_class[symbol] = inserted.first->second;
+		}
+
+		uint32_t class_count = (uint32_t)columns.size();
+
+		PatternAutomaton automaton;
+		automaton.first_state = set->info.state_count;
+		automaton.state_count = state_count;
+		automaton.class_count = class_count;
+		automaton.first_transition = (uint32_t)set->transition_storage.size();
+
+		set->automaton_storage.push_back(automaton);
+
+		for (int b = 0; b < 256; b++)
+			set->class_storage.push_back((uint8_t)symbol_class[_symbol((uint8_t)b)]);
+
+		for (uint32_t state = 0; state < state_count; state++)
+		{
+			for (uint32_t c = 0; c < class_count; c++)
+				set->transition_storage.push_back(minimal[state * SYMBOL_COUNT + class_symbol[c]]);
+		}
+
+		set->accepting_storage.insert(set->accepting_storage.end(), minimal_accepting.begin(), minimal_accepting.end());
+		set->info.automaton_count++;
+		set->info.state_count += state_count;
+
+		return true;
+	}
+}
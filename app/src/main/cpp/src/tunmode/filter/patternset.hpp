@@ -0,0 +1,116 @@
+#pragma once
+
+#include "rulefile.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define TUNMODE_PATTERN_DFA_STATES 4096      // per automaton
+#define TUNMODE_PATTERN_MAX_STATES 65536     // over all automata
+
+namespace tunmode
+{
+	typedef struct __PATTERN_SET_INFO__ {
+		uint32_t pattern_count;
+		uint32_t automaton_count;
+		uint32_t state_count;      // over all automata
+		uint32_t reserved;
+	} PatternSetInfo;
+
+	typedef struct __PATTERN_AUTOMATON__ {
+		uint32_t first_state;          // into the accepting table
+		uint32_t state_count;
+		uint32_t class_count;
+		uint32_t first_transition;     // into the transition table
+	} PatternAutomaton;
+
+	/*
+	 * Host name patterns compiled into minimal DFAs.
+	 *
+	 *     *        any run of characters, dots included
+	 *     ?        any one character
+	 *     [a-z0-9] one character of the class
+	 *     +        one or more of the preceding character, ? or class
+	 *
+	 * Everything else is a literal. A pattern matches the whole name or
+	 * any name below it, so "telemetry[0-9]+.vendor.com" also blocks
+	 * "eu.telemetry7.vendor.com".
+	 *
+	 * All patterns share one automaton and a lookup is one table step per
+	 * character, however many patterns there are. The exception is a set
+	 * with many "*" in the middle of patterns: the DFA then has to track
+	 * every combination of open wildcards, so patterns are packed into as
+	 * few automata of at most TUNMODE_PATTERN_DFA_STATES states as will
+	 * hold them, and a lookup walks each of those once.
+	 *
+	 * Bytes are mapped to classes of characters that every state of an
+	 * automaton treats alike, which keeps rows short.
+	 */
+	class PatternSet
+	{
+	public:
+		PatternSet();
+
+		/* `name` must already be normalized (see DomainSet::normalize) */
+		bool matches(const char* name, size_t length) const;
+
+		size_t get_pattern_count() const;
+		size_t get_automaton_count() const;
+		size_t get_state_count() const;
+		size_t get_memory_usage() const;
+
+		/* Appends five sections to `writer` */
+		void save(RuleFileWriter& writer) const;
+		/* Tables point into `file`, which must outlive the set */
+		static PatternSet* load(const RuleFile& file, uint32_t first_section);
+
+	private:
+		PatternSetInfo          info;
+		const PatternAutomaton* automata;
+		const uint8_t*          classes;         // [automaton * 256 + byte] -> class
+		const uint16_t*         transitions;     // [first_transition + state * class_count + class], 0 = dead, 1 = start
+		const uint8_t*          accepting;       // [first_state + state]
+		size_t                  transition_count;
+
+		std::vector<PatternAutomaton> automaton_storage;
+		std::vector<uint8_t>          class_storage;
+		std::vector<uint16_t>         transition_storage;
+		std::vector<uint8_t>          accepting_storage;
+
+		friend class PatternSetBuilder;
+	};
+
+	class PatternSetBuilder
+	{
+	public:
+		PatternSetBuilder();
+
+		/* True if `pattern` holds at least one wildcard, class or repeat */
+		static bool is_pattern(const char* name, size_t length);
+
+		/* False on a syntax error, or a pattern without any literal character */
+		bool add(const char* pattern, size_t length);
+
+		size_t get_count() const;
+
+		/*
+		 * Patterns whose automata would take the total past
+		 * TUNMODE_PATTERN_MAX_STATES are left out; get_pattern_count() of
+		 * the result says how many made it.
+		 */
+		PatternSet* build();
+
+	private:
+		typedef struct __PATTERN_ATOM__ {
+			uint64_t symbols;    // bit per symbol
+			bool     star;
+			bool     plus;
+		} Atom;
+
+		std::vector<std::vector<Atom>> patterns;
+
+		/* Appends the minimal DFA of patterns [begin, end) to `set`; false if over `max_states` */
+		bool build_automaton(size_t begin, size_t end, size_t max_states, PatternSet* set) const;
+	};
+}
@@ -0,0 +1,433 @@
+#include <tunmode/filter/rangetable.hpp>
+#include <tunmode/filter/ipparser.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace tunmode
+{
+	namespace
+	{
+		inline bool _is_space(char c)
+		{
+			return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n') || (c == ',');
+		}
+
+		bool _parse_number(const char* begin, const char* end, uint32_t& value)
+		{
+			if ((begin == end) || (end - begin > 10))
+				return false;
+
+			uint64_t number = 0;
+
+			for (const char* p = begin; p < end; p++)
+			{
+				if ((*p < '0') || (*p > '9'))
+					return false;
+
+				number = number * 10 + (*p - '0');
+			}
+
+			if (number > 0xFFFFFFFFull)
+				return false;
+
+			value = (uint32_t)number;
+			return true;
+		}
+
+		bool _parse_address(const char* begin, const char* end, uint32_t& addr)
+		{
+			uint8_t prefix;
+
+			if (memchr(begin, '.', end - begin))
+				return ipparser::parse_cidr(begin, end, addr, prefix) && (prefix == 32);
+
+			return _parse_number(begin, end, addr);
+		}
+
+		inline uint16_t _upper(char c)
+		{
+			return ((c >= 'a') && (c <= 'z')) ? (uint16_t)(c - 'a' + 'A') : (uint16_t)c;
+		}
+
+		inline bool _is_letter(char c)
+		{
+			return ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z'));
+		}
+
+		inline bool _same_tag(const IPRange& a, const IPRange& b)
+		{
+			return (a.asn == b.asn) && (a.country == b.country);
+		}
+	}
+
+	RangeTable::RangeTable()
+	{
+		this->starts = nullptr;
+		this->ranges = nullptr;
+		this->count = 0;
+	}
+
+	const IPRange* RangeTable::lookup(uint32_t addr) const
+	{
+		const uint32_t* starts = this->starts;
+		size_t k = 1;
+		size_t last = 0;    // deepest node with start <= addr: the predecessor in sorted order
+
+		while (k <= this->count)
+		{
+			__builtin_prefetch(starts + k * 16);
+
+			size_t right = starts[k] <= addr;
+			last = right ? k : last;
+			k = 2 * k + right;
+		}
+
+		if ((last == 0) || (addr > this->ranges[last].end))
+			return nullptr;
+
+		return &this->ranges[last];
+	}
+
+	size_t RangeTable::get_range_count() const
+	{
+		return this->count;
+	}
+
+	uint32_t RangeTable::get_start(size_t index) const
+	{
+		return this->starts[index];
+	}
+
+	const IPRange& RangeTable::get_range(size_t index) const
+	{
+		return this->ranges[index];
+	}
+
+	size_t RangeTable::get_memory_usage() const
+	{
+		return this->count ? (this->count + 1) * (sizeof(uint32_t) + sizeof(IPRange)) : 0;
+	}
+
+	bool RangeTable::save(const char* path) const
+	{
+		RuleFileWriter writer(RULEFILE_KIND_RANGE);
+		size_t size = this->count ? this->count + 1 : 0;
+
+		writer.set_entry_count((uint32_t)this->count);
+		writer.add_section(this->starts, size * sizeof(uint32_t));
+		writer.add_section(this->ranges, size * sizeof(IPRange));
+
+		return writer.write(path);
+	}
+
+	RangeTable* RangeTable::load(const char* path, bool verify)
+	{
+		std::shared_ptr<RuleFile> file = RuleFile::open(path, RULEFILE_KIND_RANGE, verify);
+
+		if (!file || (file->get_header().section_count != 2))
+			return nullptr;
+
+		size_t count = file->get_header().entry_count;
+		size_t starts_size, ranges_size;
+		const void* starts = file->get_section(0, starts_size);
+		const void* ranges = file->get_section(1, ranges_size);
+		size_t size = count ? count + 1 : 0;
+
+		if ((starts_size != size * sizeof(uint32_t)) || (ranges_size != size * sizeof(IPRange)))
+			return nullptr;
+
+		RangeTable* table = new RangeTable();
+
+		table->starts = (const uint32_t*)starts;
+		table->ranges = (const IPRange*)ranges;
+		table->count = count;
+		table->file = std::move(file);
+
+		return table;
+	}
+
+	RangeTableBuilder::RangeTableBuilder()
+	{
+		this->invalid_count = 0;
+	}
+
+	bool RangeTableBuilder::add(uint32_t start, uint32_t end, uint32_t asn, uint16_t country)
+	{
+		if (start > end)
+			return false;
+
+		Entry entry;
+		entry.start = start;
+		entry.range.end = end;
+		entry.range.asn = asn;
+		entry.range.country = country;
+		entry.range.reserved = 0;
+
+		this->entries.push_back(entry);
+		return true;
+	}
+
+	bool RangeTableBuilder::add_line(const char* line, size_t length)
+	{
+		const char* p = line;
+		const char* end = line + length;
+		const char* fields[4][2];
+		int field_count = 0;
+
+		while (p < end && field_count < 4)
+		{
+			while ((p < end) && _is_space(*p))
+				p++;
+
+			if ((p == end) || (*p == '#'))
+				break;
+
+			fields[field_count][0] = p;
+
+			while ((p < end) && !_is_space(*p))
+				p++;
+
+			fields[field_count][1] = p;
+			field_count++;
+		}
+
+		// Blank line or comment
+		if (field_count == 0)
+			return true;
+
+		uint32_t start, last, asn = 0;
+		uint16_t country = 0;
+
+		if ((field_count < 3)
+			|| !_parse_address(fields[0][0], fields[0][1], start)
+			|| !_parse_address(fields[1][0], fields[1][1], last))
+		{
+			this->invalid_count++;
+			return false;
+		}
+
+		const char* asn_begin = fields[2][0];
+
+		if ((fields[2][1] - asn_begin > 2) && (_upper(asn_begin[0]) == 'A') && (_upper(asn_begin[1]) == 'S'))
+			asn_begin += 2;
+
+		if (!_parse_number(asn_begin, fields[2][1], asn))
+		{
+			this->invalid_count++;
+			return false;
+		}
+
+		// "None", "Unknown", "-": no country
+		if ((field_count == 4) && (fields[3][1] - fields[3][0] == 2) && _is_letter(fields[3][0][0]) && _is_letter(fields[3][0][1]))
+			country = (uint16_t)((_upper(fields[3][0][0]) << 8) | _upper(fields[3][0][1]));
+
+		if (!this->add(start, last, asn, country))
+		{
+			this->invalid_count++;
+			return false;
+		}
+
+		return true;
+	}
+
+	bool RangeTableBuilder::read_path(const char* path)
+	{
+		FILE* file = fopen(path, "re");
+
+		if (!file)
+			return false;
+
+		char* line = nullptr;
+		size_t capacity = 0;
+		ssize_t length;
+
+		while ((length = getline(&line, &capacity, file)) != -1)
+			this->add_line(line, (size_t)length);
+
+		bool ok = !ferror(file);
+
+		free(line);
+		fclose(file);
+		return ok;
+	}
+
+	size_t RangeTableBuilder::get_count() const
+	{
+		return this->entries.size();
+	}
+
+	size_t RangeTableBuilder::get_invalid_count() const
+	{
+		return this->invalid_count;
+	}
+
+	RangeTable* RangeTableBuilder::build()
+	{
+		std::vector<Entry> entries = std::move(this->entries);
+		this->entries.clear();
+
+		// Outer ranges before the ranges nested in them
+		std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+			return (a.start != b.start) ? (a.start < b.start) : (a.range.end > b.range.end);
+		});
+
+		// Sweep with a stack of open ranges, each nested in the one below it.
+		// The innermost open range owns the addresses from `cursor` on.
+		std::vector<Entry> flat;
+		std::vector<Entry> open;
+		uint64_t cursor = 0;
+
+		auto emit = [&](uint64_t first, uint64_t last, const IPRange& range) {
+			if (first > last)
+				return;
+
+			if (!flat.empty() && ((uint64_t)flat.back().range.end + 1 == first) && _same_tag(flat.back().range, range))
+			{
+				flat.back().range.end = (uint32_t)last;
+				return;
+			}
+
+			Entry entry;
+			entry.start = (uint32_t)first;
+			entry.range = range;
+			entry.range.end = (uint32_t)last;
+			flat.push_back(entry);
+		};
+
+		for (const Entry& entry : entries)
+		{
+			while (!open.empty() && (open.back().range.end < entry.start))
+			{
+				emit(cursor, open.back().range.end, open.back().range);
+				cursor = (uint64_t)open.back().range.end + 1;
+				open.pop_back();
+			}
+
+			if (!open.empty() && (entry.start > cursor))
+				emit(cursor, (uint64_t)entry.start - 1, open.back().range);
+
+			cursor = entry.start;
+
+			// Open ranges ending inside this one are covered by it from here on
+			while (!open.empty() && (open.back().range.end <= entry.range.end))
+				open.pop_back();
+
+			open.push_back(entry);
+		}
+
+		while (!open.empty())
+		{
+			emit(cursor, open.back().range.end, open.back().range);
+			cursor = (uint64_t)open.back().range.end + 1;
+			open.pop_back();
+		}
+
+		RangeTable* table = new RangeTable();
+		size_t count = flat.size();
+
+		if (count == 0)
+			return table;
+
+		table->start_storage.assign(count + 1, 0);
+		table->range_storage.assign(count + 1, IPRange{0, 0, 0, 0});
+
+		// In-order walk of the implicit tree places the sorted ranges
+		size_t next = 0;
+		std::vector<size_t> path;
+
+		for (size_t k = 1; (k <= count) || !path.empty();)
+		{
+			if (k <= count)
+			{
+				path.push_back(k);
+				k = 2 * k;
+				continue;
+			}
+
+			k = path.back();
+			path.pop_back();
+
+			table->start_storage[k] = flat[next].start;
+			table->range_storage[k] = flat[next].range;
+			next++;
+
+			k = 2 * k + 1;
+		}
+
+		table->starts = table->start_storage.data();
+		table->ranges = table->range_storage.data();
+		table->count = count;
+
+		return table;
+	}
+
+	RangeTagSet::RangeTagSet()
+	{
+		memset(this->countries, 0, sizeof(this->countries));
+		this->count = 0;
+	}
+
+	bool RangeTagSet::add(const char* token, size_t length)
+	{
+		if ((length == 2) && _is_letter(token[0]) && _is_letter(token[1]))
+		{
+			size_t bit = (_upper(token[0]) - 'A') * 26 + (_upper(token[1]) - 'A');
+			uint64_t mask = 1ull << (bit % 64);
+
+			if (!(this->countries[bit / 64] & mask))
+			{
+				this->countries[bit / 64] |= mask;
+				this->count++;
+			}
+
+			return true;
+		}
+
+		uint32_t asn;
+
+		if ((length < 3) || (_upper(token[0]) != 'A') || (_upper(token[1]) != 'S')
+			|| !_parse_number(token + 2, token + length, asn) || (asn == 0))
+		{
+			return false;
+		}
+
+		auto it = std::lower_bound(this->asns.begin(), this->asns.end(), asn);
+
+		if ((it == this->asns.end()) || (*it != asn))
+		{
+			this->asns.insert(it, asn);
+			this->count++;
+		}
+
+		return true;
+	}
+
+	bool RangeTagSet::contains(const IPRange& range) const
+	{
+		uint8_t first = (uint8_t)(range.country >> 8);
+		uint8_t second = (uint8_t)range.country;
+
+		if ((first >= 'A') && (first <= 'Z') && (second >= 'A') && (second <= 'Z'))
+		{
+			size_t bit = (first - 'A') * 26 + (second - 'A');
+
+			if (this->countries[bit / 64] & (1ull << (bit % 64)))
+				return true;
+		}
+
+		return range.asn && std::binary_search(this->asns.begin(), this->asns.end(), range.asn);
+	}
+
+	bool RangeTagSet::is_empty() const
+	{
+		return this->count == 0;
+	}
+
+	size_t RangeTagSet::get_count() const
+	{
+		return this->count;
+	}
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "rulefile.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace tunmode
+{
+	typedef struct __IP_RANGE__ {
+		uint32_t end;        // inclusive, host byte order
+		uint32_t asn;        // 0 = unknown
+		uint16_t country;    // two upper case letters, first one in the high byte; 0 = unknown
+		uint16_t reserved;
+	} IPRange;
+
+	/*
+	 * Non-overlapping IPv4 ranges [start, end], each tagged with the
+	 * country and AS number it belongs to. Meant for region and operator
+	 * blocking, where ranges don't follow CIDR boundaries and number in
+	 * the hundreds of thousands.
+	 *
+	 * Starts are kept in Eytzinger (breadth-first) order: the top levels
+	 * of every search share the same few cache lines, the descent has no
+	 * data-dependent branch, and the line four levels down is prefetched
+	 * while the current one is compared.
+	 *
+	 * The tables can run directly on top of a mapped rule file (see
+	 * save() / load()).
+	 */
+	class RangeTable
+	{
+	public:
+		RangeTable();
+
+		/* Range holding `addr` (host byte order), nullptr if none */
+		const IPRange* lookup(uint32_t addr) const;
+
+		/* Ranges in table order, index 1 .. get_range_count() */
+		size_t         get_range_count() const;
+		uint32_t       get_start(size_t index) const;
+		const IPRange& get_range(size_t index) const;
+		size_t         get_memory_usage() const;
+
+		bool save(const char* path) const;
+		static RangeTable* load(const char* path, bool verify = true);
+
+	private:
+		const uint32_t* starts;    // [count + 1], Eytzinger order from index 1
+		const IPRange*  ranges;    // parallel to starts
+		size_t          count;
+
+		std::vector<uint32_t> start_storage;
+		std::vector<IPRange>  range_storage;
+		std::shared_ptr<RuleFile> file;
+
+		friend class RangeTableBuilder;
+	};
+
+	class RangeTableBuilder
+	{
+	public:
+		RangeTableBuilder();
+
+		bool add(uint32_t start, uint32_t end, uint32_t asn, uint16_t country);
+
+		/*
+		 * One range per line, whitespace separated, as in ip2asn-v4.tsv:
+		 *     start end asn country [description ...]
+		 * Addresses dotted or decimal; asn 0 and country "None" mean unknown.
+		 */
+		bool add_line(const char* line, size_t length);
+		bool read_path(const char* path);
+
+		size_t get_count() const;
+		size_t get_invalid_count() const;
+
+		/* Where ranges overlap, the one starting later wins; on equal starts the narrower, then the one added last */
+		RangeTable* build();
+
+	private:
+		typedef struct __RANGE_ENTRY__ {
+			uint32_t start;
+			IPRange  range;
+		} Entry;
+
+		std::vector<Entry> entries;
+		size_t invalid_count;
+	};
+
+	/* Countries and AS numbers to block, e.g. "CN RU AS13335" */
+	class RangeTagSet
+	{
+	public:
+		RangeTagSet();
+
+		/* "CN" or "AS13335", any case */
+		bool add(const char* token, size_t length);
+
+		bool contains(const IPRange& range) const;
+		bool is_empty() const;
+		size_t get_count() const;
+
+	private:
+		uint64_t countries[(26 * 26 + 63) / 64];
+		std::vector<uint32_t> asns;    // sorted
+		size_t count;
+	};
+}
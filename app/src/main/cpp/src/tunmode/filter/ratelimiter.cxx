@@ -0,0 +1,52 @@
+#include <tunmode/filter/ratelimiter.hpp>
+
+#include <algorithm>
+#include <chrono>
+
+namespace tunmode
+{
+	RateLimiter::RateLimiter(uint32_t rate_per_sec, uint32_t burst, size_t capacity)
+	{
+		size_t size = 1;
+
+		while (size < capacity)
+			size <<= 1;
+
+		this->buckets.assign(size, Bucket{0, 0});
+		this->mask = size - 1;
+		this->rate = rate_per_sec;
+		this->burst = std::max<uint32_t>(burst, 1);
+	}
+
+	bool RateLimiter::allow(uint32_t key)
+	{
+		uint64_t now_ms = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+
+		return this->allow(key, now_ms);
+	}
+
+	bool RateLimiter::allow(uint32_t key, uint64_t now_ms)
+	{
+		Bucket& bucket = this->buckets[(size_t)(((uint64_t)key * 0x9E3779B97F4A7C15ull) >> 40) & this->mask];
+		uint64_t full = (uint64_t)this->burst * 1000;
+
+		if (bucket.updated_ms == 0)
+		{
+			bucket.tokens = (uint32_t)full;
+		}
+		else
+		{
+			uint64_t refill = (now_ms - bucket.updated_ms) * this->rate;
+			bucket.tokens = (uint32_t)std::min<uint64_t>(full, bucket.tokens + refill);
+		}
+
+		bucket.updated_ms = now_ms ? now_ms : 1;
+
+		if (bucket.tokens < 1000)
+			return false;
+
+		bucket.tokens -= 1000;
+		return true;
+	}
+}
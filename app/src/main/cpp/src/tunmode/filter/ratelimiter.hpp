@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace tunmode
+{
+	/*
+	 * Per-key token bucket over a fixed direct-mapped table.
+	 *
+	 * Keys that collide share a bucket, which can only make the limit
+	 * stricter, and memory stays constant however many keys are seen.
+	 * Not thread-safe: owned by the tunnel thread.
+	 */
+	class RateLimiter
+	{
+	public:
+		RateLimiter(uint32_t rate_per_sec, uint32_t burst, size_t capacity = 1024);
+
+		/* Takes one token for `key`; false if its bucket is empty */
+		bool allow(uint32_t key);
+		bool allow(uint32_t key, uint64_t now_ms);
+
+	private:
+		typedef struct __RATE_BUCKET__ {
+			uint32_t tokens;        // in 1/1000 of a token
+			uint64_t updated_ms;
+		} Bucket;
+
+		std::vector<Bucket> buckets;
+		size_t   mask;
+		uint32_t rate;      // tokens per second
+		uint32_t burst;     // bucket size in tokens
+	};
+}
@@ -0,0 +1,264 @@
+#include <tunmode/filter/routeplanner.hpp>
+#include <tunmode/filter/ipparser.hpp>
+
+#include <algorithm>
+#include <queue>
+
+namespace tunmode::routeplanner
+{
+	namespace
+	{
+		typedef struct __ROUTE_NODE__ {
+			uint32_t addr;
+			uint8_t  prefix;
+			bool     alive;
+			uint32_t version;
+			uint64_t covered;    // addresses that actually had to be routed
+			int64_t  prev;
+			int64_t  next;
+		} Node;
+
+		typedef struct __ROUTE_MERGE__ {
+			uint64_t cost;       // extra addresses routed by merging
+			uint32_t left;
+			uint32_t right;
+			uint32_t left_version;
+			uint32_t right_version;
+		} Merge;
+
+		inline uint64_t _size(uint8_t prefix)
+		{
+			return (uint64_t)1 << (32 - prefix);
+		}
+
+		inline uint64_t _end(uint32_t addr, uint8_t prefix)
+		{
+			return (uint64_t)addr + _size(prefix) - 1;
+		}
+
+		inline uint8_t _common_prefix(const Node& a, const Node& b)
+		{
+			uint32_t diff = a.addr ^ b.addr;
+			uint8_t prefix = diff ? (uint8_t)__builtin_clz(diff) : 32;
+			return std::min({prefix, a.prefix, b.prefix});
+		}
+
+		// Sorted, with every prefix inside an earlier one dropped
+		void _normalize(std::vector<Route>& routes)
+		{
+			for (Route& route : routes)
+			{
+				route.addr &= ipparser::prefix_mask(route.prefix);
+			}
+
+			std::sort(routes.begin(), routes.end(), [](const Route& a, const Route& b) {
+				return (a.addr != b.addr) ? (a.addr < b.addr) : (a.prefix < b.prefix);
+			});
+
+			size_t count = 0;
+
+			for (const Route& route : routes)
+			{
+				if (count && (_end(route.addr, route.prefix) <= _end(routes[count - 1].addr, routes[count - 1].prefix)))
+					continue;
+
+				routes[count++] = route;
+			}
+
+			routes.resize(count);
+		}
+
+		// Prefix-aligned blocks exactly covering [low, high]
+		void _split_range(uint64_t low, uint64_t high, std::vector<Route>& out)
+		{
+			while (low <= high)
+			{
+				uint64_t size = low ? (low & (0 - low)) : ((uint64_t)1 << 32);
+				uint8_t prefix = (uint8_t)(32 - __builtin_ctzll(size));
+
+				while (low + size - 1 > high)
+				{
+					size >>= 1;
+					prefix++;
+				}
+
+				out.push_back({(uint32_t)low, prefix});
+				low += size;
+			}
+		}
+		// Longest prefix length at which the routes collapse to at most `limit` blocks
+		uint8_t _coarse_prefix(const std::vector<Route>& routes, size_t limit)
+		{
+			size_t splits[33] = {};
+
+			for (size_t i = 1; i < routes.size(); i++)
+			{
+				uint32_t diff = routes[i - 1].addr ^ routes[i].addr;
+				uint8_t common = diff ? (uint8_t)__builtin_clz(diff) : 32;
+				splits[std::min({common, routes[i - 1].prefix, routes[i].prefix})]++;
+			}
+
+			// Truncated to `length` bits, neighbours stay apart if they differ above it
+			size_t blocks = 1;
+
+			for (uint8_t length = 0; length < 32; length++)
+			{
+				blocks += splits[length];
+
+				if (blocks > limit)
+					return length;
+			}
+
+			return 32;
+		}
+	}
+
+	std::vector<Route> cover(std::vector<Route> prefixes, size_t max_routes)
+	{
+		_normalize(prefixes);
+
+		// The greedy merge below is O(n log n); for far oversized inputs first
+		// truncate to a coarse length that keeps a few times the budget
+		if (max_routes && (prefixes.size() > max_routes * 4))
+		{
+			uint8_t length = _coarse_prefix(prefixes, max_routes * 4);
+
+			for (Route& route : prefixes)
+			{
+				route.prefix = std::min(route.prefix, length);
+			}
+
+			_normalize(prefixes);
+		}
+
+		std::vector<Node> nodes;
+		nodes.reserve(prefixes.size());
+
+		for (size_t i = 0; i < prefixes.size(); i++)
+		{
+			const Route& route = prefixes[i];
+			nodes.push_back({route.addr, route.prefix, true, 0, _size(route.prefix), (int64_t)i - 1,
+				(i + 1 < prefixes.size()) ? (int64_t)i + 1 : -1});
+		}
+
+		auto later = [](const Merge& a, const Merge& b) {
+			return (a.cost != b.cost) ? (a.cost > b.cost) : (a.left > b.left);
+		};
+
+		std::priority_queue<Merge, std::vector<Merge>, decltype(later)> merges(later);
+
+		auto push = [&](int64_t left) {
+			if ((left < 0) || (nodes[left].next < 0))
+				return;
+
+			const Node& a = nodes[left];
+			const Node& b = nodes[a.next];
+			uint64_t cost = _size(_common_prefix(a, b)) - a.covered - b.covered;
+
+			merges.push({cost, (uint32_t)left, (uint32_t)a.next, a.version, b.version});
+		};
+
+		for (size_t i = 0; i + 1 < nodes.size(); i++)
+		{
+			push((int64_t)i);
+		}
+
+		size_t count = nodes.size();
+
+		while (!merges.empty())
+		{
+			Merge merge = merges.top();
+			merges.pop();
+
+			Node& left = nodes[merge.left];
+			const Node& right = nodes[merge.right];
+
+			if (!left.alive || !right.alive || (left.version != merge.left_version)
+				|| (right.version != merge.right_version) || (left.next != (int64_t)merge.right))
+			{
+				continue;
+			}
+
+			// Free merges (exact siblings) always happen; lossy ones only over budget
+			if ((merge.cost > 0) && ((max_routes == 0) || (count <= max_routes)))
+				break;
+
+			uint8_t prefix = _common_prefix(left, right);
+			uint32_t addr = left.addr & ipparser::prefix_mask(prefix);
+			uint64_t end = _end(addr, prefix);
+
+			// The supernet may swallow further neighbours on both sides
+			int64_t first = merge.left;
+			int64_t last = merge.right;
+
+			while ((nodes[first].prev >= 0) && (nodes[nodes[first].prev].addr >= addr))
+				first = nodes[first].prev;
+
+			while ((nodes[last].next >= 0) && (_end(nodes[nodes[last].next].addr, nodes[nodes[last].next].prefix) <= end))
+				last = nodes[last].next;
+
+			uint64_t covered = 0;
+
+			for (int64_t i = first;; i = nodes[i].next)
+			{
+				covered += nodes[i].covered;
+				nodes[i].alive = false;
+				count--;
+
+				if (i == last)
+					break;
+			}
+
+			Node& merged = nodes[first];
+			merged.addr = addr;
+			merged.prefix = prefix;
+			merged.alive = true;
+			merged.version++;
+			merged.covered = std::min(covered, _size(prefix));
+			merged.next = nodes[last].next;
+			count++;
+
+			if (merged.next >= 0)
+				nodes[merged.next].prev = first;
+
+			push(merged.prev);
+			push(first);
+		}
+
+		std::vector<Route> routes;
+		routes.reserve(count);
+
+		for (int64_t i = nodes.empty() ? -1 : 0; i >= 0; i = nodes[i].next)
+		{
+			routes.push_back({nodes[i].addr, nodes[i].prefix});
+		}
+
+		return routes;
+	}
+
+	std::vector<Route> complement(std::vector<Route> excluded, size_t max_routes)
+	{
+		_normalize(excluded);
+
+		std::vector<Route> gaps;
+		uint64_t next = 0;
+
+		for (const Route& route : excluded)
+		{
+			if (route.addr > next)
+				_split_range(next, (uint64_t)route.addr - 1, gaps);
+
+			next = _end(route.addr, route.prefix) + 1;
+		}
+
+		if (next <= 0xFFFFFFFFull)
+			_split_range(next, 0xFFFFFFFFull, gaps);
+
+		return cover(std::move(gaps), max_routes);
+	}
+
+	void append_range(uint32_t first, uint32_t last, std::vector<Route>& routes)
+	{
+		_split_range(first, last, routes);
+	}
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace tunmode::routeplanner
+{
+	typedef struct __ROUTE__ {
+		uint32_t addr;      // host byte order, host bits cleared
+		uint8_t  prefix;
+	} Route;
+
+	// Smallest set of CIDR routes covering every prefix in `prefixes`.
+	// Over `max_routes` (0 = unlimited), neighbouring routes are merged
+	// into the supernet that adds the least extra address space, so the
+	// result may cover more than asked for but never less.
+	std::vector<Route> cover(std::vector<Route> prefixes, size_t max_routes);
+
+	// Routes covering all of IPv4 except `excluded`, under the same budget.
+	// Over budget, some excluded space ends up routed.
+	std::vector<Route> complement(std::vector<Route> excluded, size_t max_routes);
+
+	// Appends the prefix-aligned blocks exactly covering [first, last].
+	void append_range(uint32_t first, uint32_t last, std::vector<Route>& routes);
+}
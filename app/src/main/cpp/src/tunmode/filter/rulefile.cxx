@@ -0,0 +1,211 @@
+#include <tunmode/filter/rulefile.hpp>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <ctime>
+
+#include <misc/logger.hpp>
+
+namespace tunmode
+{
+	RuleFile::RuleFile(const void* map, size_t size)
+	{
+		this->map = map;
+		this->size = size;
+	}
+
+	RuleFile::~RuleFile()
+	{
+		munmap((void*)this->map, this->size);
+	}
+
+	std::shared_ptr<RuleFile> RuleFile::open(const char* path, RuleFileKind kind, bool verify)
+	{
+		int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+
+		if (fd == -1)
+			return nullptr;
+
+		struct stat st;
+
+		if ((fstat(fd, &st) == -1) || ((size_t)st.st_size < sizeof(RuleFileHeader)))
+		{
+			::close(fd);
+			return nullptr;
+		}
+
+		size_t size = (size_t)st.st_size;
+		void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+
+		if (map == MAP_FAILED)
+			return nullptr;
+
+		std::shared_ptr<RuleFile> file(new RuleFile(map, size));
+		const RuleFileHeader& header = file->get_header();
+
+		if ((memcmp(header.magic, TUNMODE_RULEFILE_MAGIC, 8) != 0)
+			|| (header.version != TUNMODE_RULEFILE_VERSION)
+			|| (header.kind != kind)
+			|| (header.file_size != size)
+			|| (header.checked_size > size - sizeof(RuleFileHeader))
+			|| (header.section_count > TUNMODE_RULEFILE_SECTIONS))
+		{
+			LOGW_("Rule file %s: bad header", path);
+			return nullptr;
+		}
+
+		for (uint32_t i = 0; i < header.section_count; i++)
+		{
+			const RuleFileSection& section = header.sections[i];
+
+			if ((section.offset % TUNMODE_RULEFILE_ALIGN) || (section.offset > size) || (section.size > size - section.offset))
+			{
+				LOGW_("Rule file %s: section %u out of bounds", path, i);
+				return nullptr;
+			}
+		}
+
+		if (verify)
+		{
+			const uint8_t* payload = (const uint8_t*)map + sizeof(RuleFileHeader);
+
+			if (RuleFile::checksum(payload, header.checked_size) != header.checksum)
+			{
+				LOGW_("Rule file %s: checksum mismatch", path);
+				return nullptr;
+			}
+		}
+
+		return file;
+	}
+
+	const RuleFileHeader& RuleFile::get_header() const
+	{
+		return *(const RuleFileHeader*)this->map;
+	}
+
+	const void* RuleFile::get_section(uint32_t index, size_t& size) const
+	{
+		const RuleFileHeader& header = this->get_header();
+
+		if (index >= header.section_count)
+		{
+			size = 0;
+			return nullptr;
+		}
+
+		size = header.sections[index].size;
+		return (const uint8_t*)this->map + header.sections[index].offset;
+	}
+
+	uint64_t RuleFile::checksum(const void* data, size_t size)
+	{
+		const uint8_t* p = (const uint8_t*)data;
+		uint64_t h = 0xCBF29CE484222325ull ^ size;
+
+		for (; size >= 8; size -= 8, p += 8)
+		{
+			uint64_t word;
+			memcpy(&word, p, 8);
+			h = (h ^ word) * 0x100000001B3ull;
+			h ^= h >> 29;
+		}
+
+		for (; size > 0; size--, p++)
+		{
+			h = (h ^ *p) * 0x100000001B3ull;
+		}
+
+		return h ^ (h >> 32);
+	}
+
+	RuleFileWriter::RuleFileWriter(RuleFileKind kind)
+	{
+		memset(&this->header, 0, sizeof(this->header));
+		memcpy(this->header.magic, TUNMODE_RULEFILE_MAGIC, 8);
+		this->header.version = TUNMODE_RULEFILE_VERSION;
+		this->header.kind = kind;
+		this->header.created = (uint64_t)time(nullptr);
+		this->checked_count = 0;
+		this->misplaced = false;
+	}
+
+	void RuleFileWriter::set_entry_count(uint32_t entry_count)
+	{
+		this->header.entry_count = entry_count;
+	}
+
+	void RuleFileWriter::set_param(uint32_t index, uint32_t value)
+	{
+		this->header.params[index] = value;
+	}
+
+	void RuleFileWriter::add_section(const void* data, size_t size, bool checked)
+	{
+		if (checked)
+		{
+			this->misplaced |= this->checked_count != this->sections.size();
+			this->checked_count++;
+		}
+
+		this->sections.push_back({data, size});
+	}
+
+	bool RuleFileWriter::write(const char* path)
+	{
+		if ((this->sections.size() > TUNMODE_RULEFILE_SECTIONS) || this->misplaced)
+			return false;
+
+		// Lay sections out, then build the image in memory so the checksum covers the padding too
+		uint64_t offset = sizeof(RuleFileHeader);
+
+		for (size_t i = 0; i < this->sections.size(); i++)
+		{
+			offset = (offset + TUNMODE_RULEFILE_ALIGN - 1) & ~(uint64_t)(TUNMODE_RULEFILE_ALIGN - 1);
+			this->header.sections[i].offset = offset;
+			this->header.sections[i].size = this->sections[i].second;
+			offset += this->sections[i].second;
+		}
+
+		this->header.section_count = (uint32_t)this->sections.size();
+		this->header.file_size = offset;
+		this->header.checked_size = (this->checked_count < this->sections.size())
+			? this->header.sections[this->checked_count].offset - sizeof(RuleFileHeader)
+			: offset - sizeof(RuleFileHeader);
+
+		std::vector<uint8_t> image(offset, 0);
+
+		for (size_t i = 0; i < this->sections.size(); i++)
+		{
+			if (this->sections[i].second)
+				memcpy(&image[this->header.sections[i].offset], this->sections[i].first, this->sections[i].second);
+		}
+
+		this->header.checksum = RuleFile::checksum(&image[sizeof(RuleFileHeader)], this->header.checked_size);
+		memcpy(&image[0], &this->header, sizeof(RuleFileHeader));
+
+		// Write to a temporary file and rename so readers never map a partial file
+		std::string tmp_path = std::string(path) + ".tmp";
+		FILE* file = fopen(tmp_path.c_str(), "wb");
+
+		if (!file)
+			return false;
+
+		bool ok = fwrite(image.data(), 1, image.size(), file) == image.size();
+		ok = (fclose(file) == 0) && ok;
+
+		if (!ok || (rename(tmp_path.c_str(), path) != 0))
+		{
+			unlink(tmp_path.c_str());
+			return false;
+		}
+
+		return true;
+	}
+}
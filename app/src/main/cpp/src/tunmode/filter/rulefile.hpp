@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#define TUNMODE_RULEFILE_MAGIC     "TUNRULES"
+#define TUNMODE_RULEFILE_VERSION   3
+#define TUNMODE_RULEFILE_SECTIONS  12
+#define TUNMODE_RULEFILE_ALIGN     64
+
+namespace tunmode
+{
+	enum RuleFileKind : uint32_t {
+		RULEFILE_KIND_IP = 1,
+		RULEFILE_KIND_DOMAIN = 2,
+		RULEFILE_KIND_RANGE = 3
+	};
+
+	typedef struct __RULE_FILE_SECTION__ {
+		uint64_t offset;
+		uint64_t size;
+	} RuleFileSection;
+
+	/*
+	 * On-disk layout: this header followed by up to twelve sections,
+	 * each aligned to TUNMODE_RULEFILE_ALIGN. `checksum` covers the
+	 * `checked_size` bytes after the header; sections past them are
+	 * never read by verification. All integers are in native byte order.
+	 */
+	typedef struct __RULE_FILE_HEADER__ {
+		char     magic[8];
+		uint32_t version;
+		uint32_t kind;
+		uint64_t created;          // unix time
+		uint64_t file_size;
+		uint64_t checksum;
+		uint64_t checked_size;
+		uint32_t entry_count;
+		uint32_t section_count;
+		uint32_t params[4];        // kind specific
+		RuleFileSection sections[TUNMODE_RULEFILE_SECTIONS];
+	} RuleFileHeader;
+
+	/* Read-only mapping of a compiled rule file */
+	class RuleFile
+	{
+	public:
+		~RuleFile();
+
+		/* Returns nullptr if the file is missing, truncated or fails its checksum */
+		static std::shared_ptr<RuleFile> open(const char* path, RuleFileKind kind, bool verify = true);
+
+		const RuleFileHeader& get_header() const;
+		const void*           get_section(uint32_t index, size_t& size) const;
+
+		static uint64_t checksum(const void* data, size_t size);
+
+	private:
+		RuleFile(const void* map, size_t size);
+
+		const void* map;
+		size_t size;
+	};
+
+	class RuleFileWriter
+	{
+	public:
+		RuleFileWriter(RuleFileKind kind);
+
+		void set_entry_count(uint32_t entry_count);
+		void set_param(uint32_t index, uint32_t value);
+		/*
+		 * Unchecked sections are left out of the checksum, so a verified
+		 * load doesn't page them in; they have to be added last.
+		 */
+		void add_section(const void* data, size_t size, bool checked = true);
+
+		bool write(const char* path);
+
+	private:
+		RuleFileHeader header;
+		std::vector<std::pair<const void*, size_t>> sections;
+		size_t checked_count;
+		bool   misplaced;    // a checked section came after an unchecked one
+	};
+}
@@ -0,0 +1,78 @@
+#include <tunmode/filter/ruleset.hpp>
+
+namespace tunmode
+{
+	RuleSet::RuleSet()
+	{
+		this->generation = 1;
+		this->blocked_ips = std::make_shared<IPClassifier>();
+		this->flow_rules = std::make_shared<FlowClassifier>();
+		this->blocked_domains = std::make_shared<DomainSet>();
+		this->ip_ranges = std::make_shared<RangeTable>();
+		this->blocked_tags = std::make_shared<RangeTagSet>();
+	}
+
+	RuleSet::RuleSet(const RuleSet& other) = default;
+
+	uint32_t RuleSet::get_generation() const
+	{
+		return this->generation;
+	}
+
+	const IPClassifier* RuleSet::get_blocked_ips() const
+	{
+		return this->blocked_ips.get();
+	}
+
+	const FlowClassifier* RuleSet::get_flow_rules() const
+	{
+		return this->flow_rules.get();
+	}
+
+	const DomainSet* RuleSet::get_blocked_domains() const
+	{
+		return this->blocked_domains.get();
+	}
+
+	const RangeTable* RuleSet::get_ip_ranges() const
+	{
+		return this->ip_ranges.get();
+	}
+
+	const RangeTagSet* RuleSet::get_blocked_tags() const
+	{
+		return this->blocked_tags.get();
+	}
+
+	RuleSet* RuleSet::next() const
+	{
+		RuleSet* rule_set = new RuleSet(*this);
+		rule_set->generation = this->generation + 1;
+		return rule_set;
+	}
+
+	void RuleSet::set_blocked_ips(std::shared_ptr<const IPClassifier> blocked_ips)
+	{
+		this->blocked_ips = std::move(blocked_ips);
+	}
+
+	void RuleSet::set_flow_rules(std::shared_ptr<const FlowClassifier> flow_rules)
+	{
+		this->flow_rules = std::move(flow_rules);
+	}
+
+	void RuleSet::set_blocked_domains(std::shared_ptr<const DomainSet> blocked_domains)
+	{
+		this->blocked_domains = std::move(blocked_domains);
+	}
+
+	void RuleSet::set_ip_ranges(std::shared_ptr<const RangeTable> ip_ranges)
+	{
+		this->ip_ranges = std::move(ip_ranges);
+	}
+
+	void RuleSet::set_blocked_tags(std::shared_ptr<const RangeTagSet> blocked_tags)
+	{
+		this->blocked_tags = std::move(blocked_tags);
+	}
+}
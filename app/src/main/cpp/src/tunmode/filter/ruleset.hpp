@@ -0,0 +1,49 @@
+#pragma once
+
+#include "ipclassifier.hpp"
+#include "flowclassifier.hpp"
+#include "domainset.hpp"
+#include "rangetable.hpp"
+
+#include <cstdint>
+#include <memory>
+
+namespace tunmode
+{
+	/*
+	 * Immutable snapshot of everything the datapath matches against.
+	 *
+	 * Snapshots are published through an RcuPointer; a new snapshot
+	 * shares unchanged components with the previous one.
+	 */
+	class RuleSet
+	{
+	public:
+		RuleSet();
+		RuleSet(const RuleSet& other);
+
+		uint32_t            get_generation() const;
+		const IPClassifier* get_blocked_ips() const;
+		const FlowClassifier* get_flow_rules() const;
+		const DomainSet*    get_blocked_domains() const;
+		const RangeTable*   get_ip_ranges() const;
+		const RangeTagSet*  get_blocked_tags() const;
+
+		/* Writer side: copy of `this` with the next generation number */
+		RuleSet* next() const;
+
+		void set_blocked_ips(std::shared_ptr<const IPClassifier> blocked_ips);
+		void set_flow_rules(std::shared_ptr<const FlowClassifier> flow_rules);
+		void set_blocked_domains(std::shared_ptr<const DomainSet> blocked_domains);
+		void set_ip_ranges(std::shared_ptr<const RangeTable> ip_ranges);
+		void set_blocked_tags(std::shared_ptr<const RangeTagSet> blocked_tags);
+
+	private:
+		uint32_t generation;
+		std::shared_ptr<const IPClassifier> blocked_ips;
+		std::shared_ptr<const FlowClassifier> flow_rules;    // checked before blocked_ips
+		std::shared_ptr<const DomainSet> blocked_domains;
+		std::shared_ptr<const RangeTable> ip_ranges;         // country / ASN of each address
+		std::shared_ptr<const RangeTagSet> blocked_tags;     // which of those to block
+	};
+}
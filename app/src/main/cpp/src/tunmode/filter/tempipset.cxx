@@ -0,0 +1,139 @@
+#include <tunmode/filter/tempipset.hpp>
+
+#include <chrono>
+
+namespace tunmode
+{
+	TempIPSet::TempIPSet(size_t capacity)
+	{
+		size_t size = PROBES;
+
+		while (size < capacity)
+			size <<= 1;
+
+		this->slots.reset(new std::atomic<uint64_t>[size]);
+		this->mask = size - 1;
+		this->used.store(false);
+
+		for (size_t i = 0; i < size; i++)
+			this->slots[i].store(0, std::memory_order_relaxed);
+	}
+
+	uint32_t TempIPSet::now_sec()
+	{
+		// Offset by one so that a live expiry is never 0
+		return 1 + (uint32_t)std::chrono::duration_cast<std::chrono::seconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	size_t TempIPSet::index(uint32_t addr) const
+	{
+		return (size_t)(((uint64_t)addr * 0x9E3779B97F4A7C15ull) >> 32) & this->mask;
+	}
+
+	void TempIPSet::insert(uint32_t addr, uint32_t ttl_sec)
+	{
+		this->insert(addr, ttl_sec, now_sec());
+	}
+
+	void TempIPSet::insert(uint32_t addr, uint32_t ttl_sec, uint32_t now)
+	{
+		uint32_t expires = now + ttl_sec;
+		uint64_t value = ((uint64_t)addr << 32) | expires;
+		size_t start = this->index(addr);
+
+		this->used.store(true, std::memory_order_relaxed);
+
+		while (true)
+		{
+			std::atomic<uint64_t>* victim = nullptr;
+			uint64_t victim_value = 0;
+			uint32_t victim_expires = UINT32_MAX;
+
+			for (size_t probe = 0; probe < PROBES; probe++)
+			{
+				std::atomic<uint64_t>& slot = this->slots[(start + probe) & this->mask];
+				uint64_t current = slot.load(std::memory_order_acquire);
+
+				if (current && ((current >> 32) == addr))
+				{
+					// Already present: only ever extend
+					while ((uint32_t)current < expires)
+					{
+						if (slot.compare_exchange_weak(current, value, std::memory_order_acq_rel))
+							return;
+
+						// Evicted meanwhile
+						if ((current >> 32) != addr)
+							break;
+					}
+
+					if ((current >> 32) == addr)
+						return;
+				}
+
+				// Free and expired slots count as expiring first
+				uint32_t current_expires = (uint32_t)current;
+				uint32_t rank = (current_expires <= now) ? 0 : current_expires;
+
+				if (!victim || (rank < victim_expires))
+				{
+					victim = &slot;
+					victim_value = current;
+					victim_expires = rank;
+				}
+			}
+
+			if (victim->compare_exchange_strong(victim_value, value, std::memory_order_acq_rel))
+				return;
+
+			// Lost a race for the slot, look again
+		}
+	}
+
+	bool TempIPSet::contains(uint32_t addr) const
+	{
+		if (!this->used.load(std::memory_order_relaxed))
+			return false;
+
+		return this->contains(addr, now_sec());
+	}
+
+	bool TempIPSet::contains(uint32_t addr, uint32_t now) const
+	{
+		size_t start = this->index(addr);
+
+		for (size_t probe = 0; probe < PROBES; probe++)
+		{
+			uint64_t current = this->slots[(start + probe) & this->mask].load(std::memory_order_acquire);
+
+			// A racing insert may have left a second copy further on
+			if (current && ((current >> 32) == addr) && ((uint32_t)current > now))
+				return true;
+		}
+
+		return false;
+	}
+
+	void TempIPSet::clear()
+	{
+		for (size_t i = 0; i <= this->mask; i++)
+			this->slots[i].store(0, std::memory_order_release);
+	}
+
+	size_t TempIPSet::get_live_count() const
+	{
+		uint32_t now = now_sec();
+		size_t count = 0;
+
+		for (size_t i = 0; i <= this->mask; i++)
+		{
+			uint64_t current = this->slots[i].load(std::memory_order_relaxed);
+
+			if (current && ((uint32_t)current > now))
+				count++;
+		}
+
+		return count;
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace tunmode
+{
+	/*
+	 * Fixed-size set of IPv4 addresses that each expire on their own.
+	 *
+	 * Every slot is one 64-bit word (address << 32 | expiry second), so
+	 * inserts are a CAS and lookups a few plain loads, from any number of
+	 * threads without locks. An address lives in one of PROBES slots after
+	 * its hash; when they are all live the one expiring first is evicted,
+	 * which bounds memory however many addresses are seen.
+	 */
+	class TempIPSet
+	{
+	public:
+		static constexpr size_t PROBES = 8;
+
+		TempIPSet(size_t capacity = 8192);
+
+		/* Addresses in host byte order; keeps the later expiry of a repeat */
+		void insert(uint32_t addr, uint32_t ttl_sec);
+		void insert(uint32_t addr, uint32_t ttl_sec, uint32_t now);
+
+		bool contains(uint32_t addr) const;
+		bool contains(uint32_t addr, uint32_t now) const;
+
+		void clear();
+
+		size_t get_live_count() const;
+
+		static uint32_t now_sec();
+
+	private:
+		std::unique_ptr<std::atomic<uint64_t>[]> slots;    // 0 = free
+		size_t mask;
+		std::atomic<bool> used;                           // skips the clock while empty
+
+		size_t index(uint32_t addr) const;
+	};
+}
@@ -0,0 +1,43 @@
+#include <tunmode/filter/verdictcache.hpp>
+
+namespace tunmode
+{
+	VerdictCache::VerdictCache(size_t capacity)
+	{
+		size_t size = 1;
+
+		while (size < capacity)
+			size <<= 1;
+
+		this->entries.assign(size, Entry{0, 0, 0, VERDICT_NONE, 0, 0});
+		this->mask = size - 1;
+	}
+
+	size_t VerdictCache::index(uint64_t id, int protocol) const
+	{
+		uint64_t h = (id ^ (uint64_t)protocol) * 0x9E3779B97F4A7C15ull;
+		return (size_t)(h >> 32) & this->mask;
+	}
+
+	VerdictHit VerdictCache::get(uint64_t id, int protocol, uint32_t generation) const
+	{
+		const Entry& entry = this->entries[this->index(id, protocol)];
+
+		if ((entry.id != id) || (entry.protocol != protocol) || (entry.generation != generation))
+			return {VERDICT_NONE, 0, 0};
+
+		return {(Verdict)entry.verdict, entry.prefix, entry.addr};
+	}
+
+	void VerdictCache::set(uint64_t id, int protocol, uint32_t generation, const VerdictHit& hit)
+	{
+		Entry& entry = this->entries[this->index(id, protocol)];
+
+		entry.id = id;
+		entry.protocol = (int16_t)protocol;
+		entry.generation = generation;
+		entry.verdict = hit.verdict;
+		entry.prefix = hit.prefix;
+		entry.addr = hit.addr;
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace tunmode
+{
+	enum Verdict : uint8_t {
+		VERDICT_NONE = 0,
+		VERDICT_ALLOW,
+		VERDICT_BLOCK
+	};
+
+	/* A verdict and the destination prefix of the rule behind it, for hit counting */
+	typedef struct __VERDICT_HIT__ {
+		Verdict  verdict;
+		uint8_t  prefix;
+		uint32_t addr;      // host byte order
+	} VerdictHit;
+
+	/*
+	 * Direct-mapped per-flow verdict cache keyed by Packet::get_id().
+	 *
+	 * Entries are tagged with the rule set generation they were computed
+	 * against, so bumping the generation invalidates everything at once.
+	 * Not thread-safe: owned by the tunnel thread.
+	 */
+	class VerdictCache
+	{
+	public:
+		VerdictCache(size_t capacity = 4096);
+
+		/* verdict is VERDICT_NONE on a miss */
+		VerdictHit get(uint64_t id, int protocol, uint32_t generation) const;
+		void       set(uint64_t id, int protocol, uint32_t generation, const VerdictHit& hit);
+
+	private:
+		typedef struct __VERDICT_ENTRY__ {
+			uint64_t id;
+			uint32_t generation;
+			int16_t  protocol;
+			uint8_t  verdict;
+			uint8_t  prefix;
+			uint32_t addr;
+		} Entry;
+
+		std::vector<Entry> entries;
+		size_t mask;
+
+		size_t index(uint64_t id, int protocol) const;
+	};
+}
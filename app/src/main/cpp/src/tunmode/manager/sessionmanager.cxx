@@ -1,25 +1,90 @@
 #include <tunmode/manager/sessionmanager.hpp>
 
+#include <misc/logger.hpp>
+
 namespace tunmode
 {
-	SessionManager::SessionManager() {}
+	SessionManager::SessionManager(Reactor* reactor)
+	{
+		this->reactor = reactor;
+		this->shards.reset(new SessionShard[reactor->get_loop_count()]);
+		this->dropped.store(0);
+	}
 
-	Session* SessionManager::get_or_add(uint64_t id)
+	SessionManager::~SessionManager() {}
+
+	Session* SessionManager::get_or_add(size_t shard, uint64_t id)
 	{
-		if (this->sessions.contains(id))
+		std::unordered_map<uint64_t, Session*>& sessions = this->shards[shard].sessions;
+		auto it = sessions.find(id);
+
+		if (it != sessions.end())
+		{
+			return it->second;
+		}
+
+		Session* session = this->add(id, this->reactor->get_loop(shard));
+
+		if (session)
 		{
-			return this->sessions[id];
+			sessions.insert({id, session});
 		}
 
-		return this->add(id);
+		return session;
+	}
+
+	bool SessionManager::enqueue(Session* session, Packet* packet)
+	{
+		if (session->get_client_socket()->send(packet))
+		{
+			return true;
+		}
+
+		this->dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	uint64_t SessionManager::get_dropped() const
+	{
+		return this->dropped.load(std::memory_order_relaxed);
 	}
 
 	void SessionManager::remove(uint64_t id)
 	{
-		std::lock_guard<std::mutex> lock(this->mtx);
-		
-		Session* session = this->sessions[id];
-		this->sessions.erase(id);
+		SessionShard& shard = this->shards[this->reactor->get_shard(id)];
+		std::lock_guard<std::mutex> lock(shard.mtx);
+
+		auto it = shard.sessions.find(id);
+
+		if (it == shard.sessions.end())
+		{
+			return;
+		}
+
+		Session* session = it->second;
+		uint64_t dropped = session->get_client_socket()->get_dropped();
+
+		if (dropped)
+		{
+			LOGD_("Session %llx dropped %llu client packets on a full queue", (unsigned long long)id, (unsigned long long)dropped);
+		}
+
+		shard.sessions.erase(it);
 		delete session;
 	}
-}
\ No newline at end of file
+
+	void SessionManager::clear()
+	{
+		for (size_t i = 0; i < this->reactor->get_loop_count(); i++)
+		{
+			std::lock_guard<std::mutex> lock(this->shards[i].mtx);
+
+			for (auto& entry : this->shards[i].sessions)
+			{
+				delete entry.second;
+			}
+
+			this->shards[i].sessions.clear();
+		}
+	}
+}
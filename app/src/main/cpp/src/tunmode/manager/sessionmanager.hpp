@@ -2,26 +2,56 @@
 
 #include "../session/session.hpp"
 #include "../common/packet.hpp"
+#include "../reactor/reactor.hpp"
 
 #include <unordered_map>
+#include <atomic>
 #include <cstdint>
+#include <memory>
 #include <mutex>
 
 namespace tunmode
 {
+	/*
+	 * Sessions by flow id, split into one shard per event loop of the
+	 * reactor. A shard's lock is only shared by the tunnel thread handing
+	 * packets in and the loop removing finished sessions.
+	 */
 	class SessionManager
 	{
 	public:
-		SessionManager();
+		SessionManager(Reactor* reactor);
+		virtual ~SessionManager();
 
-		virtual void handle_packet(const Packet& packet) = 0;
+		/*
+		 * Queues a pooled packet to its session, which then owns it; false
+		 * if it was not taken. Never waits: a UDP session whose queue is
+		 * full has the datagram dropped (and counted) instead, a TCP one
+		 * leaves the segment unacknowledged for the client to resend.
+		 */
+		virtual bool handle_packet(Packet* packet) = 0;
+
+		/* Client datagrams dropped on full session queues since start */
+		uint64_t get_dropped() const;
+
+		/* Deletes the sessions left over once the reactor has stopped */
+		void clear();
 
 	protected:
-		std::mutex mtx;
-		std::unordered_map<uint64_t, Session*> sessions;
+		typedef struct __SESSION_SHARD__ {
+			std::mutex mtx;
+			std::unordered_map<uint64_t, Session*> sessions;
+		} SessionShard;
+
+		Reactor* reactor;
+		std::unique_ptr<SessionShard[]> shards;
+		std::atomic<uint64_t> dropped;
 
-		virtual Session* add(uint64_t id) = 0;
-		Session* get_or_add(uint64_t id);
+		virtual Session* add(uint64_t id, EventLoop* loop) = 0;
+		/* Caller holds the lock of `shard`; nullptr if the session could not be set up */
+		Session* get_or_add(size_t shard, uint64_t id);
+		/* Caller holds the lock of the session's shard */
+		bool     enqueue(Session* session, Packet* packet);
 		void remove(uint64_t id);
 	};
-}
\ No newline at end of file
+}
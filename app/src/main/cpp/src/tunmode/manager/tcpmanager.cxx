@@ -4,20 +4,29 @@
 
 namespace tunmode
 {
-	TCPManager::TCPManager() : SessionManager() {}
+	TCPManager::TCPManager(Reactor* reactor) : SessionManager(reactor) {}
 
-	void TCPManager::handle_packet(const Packet& packet)
+	bool TCPManager::handle_packet(Packet* packet)
 	{
-		std::lock_guard<std::mutex> lock(this->mtx);
-		TCPSession* session = reinterpret_cast<TCPSession*>(this->get_or_add(packet.get_id()));
-		*(session->get_client_socket()) < packet;
+		uint64_t id = packet->get_id();
+		size_t shard = this->reactor->get_shard(id);
+
+		std::lock_guard<std::mutex> lock(this->shards[shard].mtx);
+		TCPSession* session = reinterpret_cast<TCPSession*>(this->get_or_add(shard, id));
+
+		return session && this->enqueue(session, packet);
 	}
 
-	Session* TCPManager::add(uint64_t id)
+	Session* TCPManager::add(uint64_t id, EventLoop* loop)
 	{
-		TCPSession* session = new TCPSession(this, id);
+		TCPSession* session = new TCPSession(this, loop, id);
 		utils::protect_socket(session->get_server_socket()->get_socket());
-		this->sessions.insert({id, session});
+
+		if (!loop->add(session))
+		{
+			delete session;
+			return nullptr;
+		}
 
 		return session;
 	}
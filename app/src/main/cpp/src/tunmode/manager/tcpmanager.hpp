@@ -10,12 +10,12 @@ namespace tunmode
 	class TCPManager : public SessionManager
 	{
 	public:
-		TCPManager();
+		TCPManager(Reactor* reactor);
 
-		void handle_packet(const Packet& packet) override;
+		bool handle_packet(Packet* packet) override;
 
 	private:
-		Session* add(uint64_t id) override;
+		Session* add(uint64_t id, EventLoop* loop) override;
 
 		friend class TCPSession;
 	};
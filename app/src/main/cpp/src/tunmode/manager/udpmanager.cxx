@@ -4,20 +4,29 @@
 
 namespace tunmode
 {
-	UDPManager::UDPManager() : SessionManager() {}
+	UDPManager::UDPManager(Reactor* reactor) : SessionManager(reactor) {}
 
-	void UDPManager::handle_packet(const Packet& packet)
+	bool UDPManager::handle_packet(Packet* packet)
 	{
-		std::lock_guard<std::mutex> lock(this->mtx);
-		UDPSession* session = reinterpret_cast<UDPSession*>(this->get_or_add(packet.get_id()));
-		*(session->get_client_socket()) < packet;
+		uint64_t id = packet->get_id();
+		size_t shard = this->reactor->get_shard(id);
+
+		std::lock_guard<std::mutex> lock(this->shards[shard].mtx);
+		UDPSession* session = reinterpret_cast<UDPSession*>(this->get_or_add(shard, id));
+
+		return session && this->enqueue(session, packet);
 	}
 
-	Session* UDPManager::add(uint64_t id)
+	Session* UDPManager::add(uint64_t id, EventLoop* loop)
 	{
-		UDPSession* session = new UDPSession(this, id);
+		UDPSession* session = new UDPSession(this, loop, id);
 		utils::protect_socket(session->get_server_socket()->get_socket());
-		this->sessions.insert({id, session});
+
+		if (!loop->add(session))
+		{
+			delete session;
+			return nullptr;
+		}
 
 		return session;
 	}
@@ -0,0 +1,279 @@
+#include <tunmode/reactor/eventloop.hpp>
+#include <tunmode/session/session.hpp>
+#include <tunmode/socket/sessionsocket.hpp>
+#include <tunmode/definitions.hpp>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <algorithm>
+#include <climits>
+#include <chrono>
+
+#include <misc/logger.hpp>
+
+namespace tunmode
+{
+	namespace
+	{
+		constexpr uint64_t WAKE_TAG   = 0;    // data of the wake eventfd; sessions are never at address 0
+		constexpr uint64_t SERVER_TAG = 1;    // low bit of a session's data: the upstream socket
+		constexpr size_t   DETACHED   = (size_t)-1;
+
+		inline uint64_t _tag(Session* session, bool server)
+		{
+			return (uint64_t)(uintptr_t)session | (server ? SERVER_TAG : 0);
+		}
+	}
+
+	EventLoop::EventLoop()
+	{
+		this->epoll_fd = -1;
+		this->wake_fd = -1;
+		this->stopping.store(false);
+		this->next_deadline = 0;
+	}
+
+	EventLoop::~EventLoop()
+	{
+		this->stop();
+	}
+
+	bool EventLoop::start()
+	{
+		if (this->thread.joinable())
+			return true;
+
+		this->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		this->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+		struct epoll_event event;
+		event.events = EPOLLIN;
+		event.data.u64 = WAKE_TAG;
+
+		if ((this->epoll_fd == -1) || (this->wake_fd == -1)
+			|| (epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, this->wake_fd, &event) == -1))
+		{
+			LOGW_("EventLoop: setup failed (errno %d)", errno);
+			this->stop();
+			return false;
+		}
+
+		this->stopping.store(false);
+		this->next_deadline = 0;
+		this->thread = std::thread(&EventLoop::run, this);
+
+		return true;
+	}
+
+	void EventLoop::stop()
+	{
+		if (this->thread.joinable())
+		{
+			this->stopping.store(true);
+			eventfd_write(this->wake_fd, 1);
+			this->thread.join();
+		}
+
+		if (this->epoll_fd != -1)
+			::close(this->epoll_fd);
+
+		if (this->wake_fd != -1)
+			::close(this->wake_fd);
+
+		this->epoll_fd = -1;
+		this->wake_fd = -1;
+	}
+
+	bool EventLoop::add(Session* session)
+	{
+		// Signalled per packet into an empty queue and never read: edge-triggered
+		return this->watch(session, session->client_socket->get_wakeup_fd(), false, EPOLLIN | EPOLLET);
+	}
+
+	bool EventLoop::watch(Session* session, int fd, bool server, uint32_t events)
+	{
+		struct epoll_event event;
+		event.events = events;
+		event.data.u64 = _tag(session, server);
+
+		return epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0;
+	}
+
+	bool EventLoop::rewatch(Session* session, int fd, bool server, uint32_t events)
+	{
+		struct epoll_event event;
+		event.events = events;
+		event.data.u64 = _tag(session, server);
+
+		return epoll_ctl(this->epoll_fd, EPOLL_CTL_MOD, fd, &event) == 0;
+	}
+
+	void EventLoop::unwatch(int fd)
+	{
+		epoll_ctl(this->epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+	}
+
+	void EventLoop::schedule(Session* session, uint64_t deadline_ms)
+	{
+		session->deadline_ms = deadline_ms;
+
+		if (deadline_ms && (!this->next_deadline || (deadline_ms < this->next_deadline)))
+			this->next_deadline = deadline_ms;
+	}
+
+	uint64_t EventLoop::now_ms()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void EventLoop::run()
+	{
+		struct epoll_event events[TUNMODE_REACTOR_EVENTS];
+
+		// With io_uring, the TUN writes of a batch of events go out in one submission
+		bool batched = SessionSocket::tun && SessionSocket::tun->batch_writes(true);
+
+		while (!this->stopping.load())
+		{
+			int timeout = -1;
+
+			if (this->next_deadline)
+			{
+				uint64_t now = now_ms();
+				timeout = (this->next_deadline > now) ? (int)std::min<uint64_t>(this->next_deadline - now, INT_MAX) : 0;
+			}
+
+			int count = epoll_wait(this->epoll_fd, events, TUNMODE_REACTOR_EVENTS, timeout);
+
+			if (count == -1)
+			{
+				if (errno == EINTR)
+					continue;
+
+				LOGW_("EventLoop: epoll_wait failed (errno %d)", errno);
+				break;
+			}
+
+			for (int i = 0; i < count; i++)
+			{
+				uint64_t data = events[i].data.u64;
+
+				if (data == WAKE_TAG)
+				{
+					eventfd_t value;
+					eventfd_read(this->wake_fd, &value);
+					continue;
+				}
+
+				Session* session = (Session*)(uintptr_t)(data & ~SERVER_TAG);
+
+				// Finished earlier in this batch, waiting to be reaped
+				if (session->done)
+					continue;
+
+				if (session->loop_slot == DETACHED)
+					this->attach(session);
+
+				bool open = (data & SERVER_TAG) ? session->on_server(events[i].events) : session->on_client();
+
+				if (!open)
+					this->finish(session);
+			}
+
+			if (this->next_deadline)
+			{
+				uint64_t now = now_ms();
+
+				if (now >= this->next_deadline)
+					this->sweep(now);
+			}
+
+			this->reap();
+
+			if (batched)
+				TunSocket::flush_writes();
+		}
+
+		for (Session* session : this->sessions)
+		{
+			if (!session->done)
+			{
+				session->on_stop();
+				this->finish(session);
+			}
+		}
+
+		this->reap();
+		this->next_deadline = 0;
+
+		if (batched)
+			SessionSocket::tun->batch_writes(false);
+	}
+
+	void EventLoop::attach(Session* session)
+	{
+		session->loop_slot = this->sessions.size();
+		this->sessions.push_back(session);
+	}
+
+	void EventLoop::finish(Session* session)
+	{
+		session->done = true;
+		this->finished.push_back(session);
+	}
+
+	/* Sessions are only deleted here, after the batch that finished them */
+	void EventLoop::reap()
+	{
+		for (Session* session : this->finished)
+		{
+			this->unwatch(session->client_socket->get_wakeup_fd());
+
+			if (session->server_watched)
+			{
+				this->unwatch(session->server_socket->get_socket());
+				session->server_watched = false;
+			}
+
+			if (session->loop_slot != DETACHED)
+			{
+				Session* last = this->sessions.back();
+				this->sessions[session->loop_slot] = last;
+				last->loop_slot = session->loop_slot;
+				this->sessions.pop_back();
+				session->loop_slot = DETACHED;
+			}
+
+			session->finish();
+		}
+
+		this->finished.clear();
+	}
+
+	void EventLoop::sweep(uint64_t now)
+	{
+		this->next_deadline = 0;
+
+		for (Session* session : this->sessions)
+		{
+			if (session->done || !session->deadline_ms)
+				continue;
+
+			if (session->deadline_ms <= now)
+			{
+				session->deadline_ms = 0;
+
+				if (!session->on_timeout(now))
+				{
+					this->finish(session);
+					continue;
+				}
+			}
+
+			this->schedule(session, session->deadline_ms);
+		}
+	}
+}
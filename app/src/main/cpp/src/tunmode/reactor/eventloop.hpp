@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace tunmode
+{
+	class Session;
+
+	/*
+	 * One event loop thread and the epoll set of the sessions it owns.
+	 *
+	 * A session is handed to its loop with add(), from any thread, once
+	 * it is ready to receive client packets. From then on every handler
+	 * of the session runs on the loop thread, so sessions need no locks
+	 * of their own; they must never block.
+	 *
+	 * Deadlines are kept per session and checked when the earliest one
+	 * scheduled is due, so an idle loop sleeps in epoll_wait() until the
+	 * next event or deadline.
+	 */
+	class EventLoop
+	{
+	public:
+		EventLoop();
+		~EventLoop();
+
+		bool start();
+		/* Stops the sessions still open and joins the thread */
+		void stop();
+
+		/* Any thread: starts delivering the session's client events */
+		bool add(Session* session);
+
+		/* Loop thread only */
+		bool watch(Session* session, int fd, bool server, uint32_t events);
+		bool rewatch(Session* session, int fd, bool server, uint32_t events);
+		void unwatch(int fd);
+		void schedule(Session* session, uint64_t deadline_ms);
+
+		static uint64_t now_ms();
+
+	private:
+		int epoll_fd;
+		int wake_fd;
+		std::thread thread;
+		std::atomic<bool> stopping;
+
+		std::vector<Session*> sessions;     // seen on this loop, by Session::loop_slot
+		std::vector<Session*> finished;     // done during the current batch
+		uint64_t next_deadline;             // earliest deadline scheduled since the last sweep, 0 = none
+
+		void run();
+		void attach(Session* session);
+		void finish(Session* session);
+		void reap();
+		void sweep(uint64_t now);
+	};
+}
@@ -0,0 +1,55 @@
+#include <tunmode/reactor/reactor.hpp>
+#include <tunmode/definitions.hpp>
+
+#include <algorithm>
+#include <thread>
+
+namespace tunmode
+{
+	Reactor::Reactor(size_t loop_count)
+	{
+		if (loop_count == 0)
+			loop_count = std::thread::hardware_concurrency();
+
+		loop_count = std::clamp<size_t>(loop_count, 1, TUNMODE_REACTOR_MAX_LOOPS);
+
+		for (size_t i = 0; i < loop_count; i++)
+			this->loops.emplace_back(new EventLoop());
+	}
+
+	bool Reactor::start()
+	{
+		for (std::unique_ptr<EventLoop>& loop : this->loops)
+		{
+			if (!loop->start())
+			{
+				this->stop();
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	void Reactor::stop()
+	{
+		for (std::unique_ptr<EventLoop>& loop : this->loops)
+			loop->stop();
+	}
+
+	size_t Reactor::get_loop_count() const
+	{
+		return this->loops.size();
+	}
+
+	/* Flow ids keep the client port in the low bits; mix them into the top */
+	size_t Reactor::get_shard(uint64_t id) const
+	{
+		return (size_t)(((id * 0x9E3779B97F4A7C15ull) >> 32) % this->loops.size());
+	}
+
+	EventLoop* Reactor::get_loop(size_t shard)
+	{
+		return this->loops[shard].get();
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "eventloop.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace tunmode
+{
+	/*
+	 * A fixed set of event loops, about one per core, each owning the
+	 * sessions of one shard of flows. A flow always hashes to the same
+	 * shard, so its packets are handled in order by a single thread.
+	 */
+	class Reactor
+	{
+	public:
+		/* 0 = one loop per core, up to TUNMODE_REACTOR_MAX_LOOPS */
+		Reactor(size_t loop_count = 0);
+
+		bool start();
+		void stop();
+
+		size_t     get_loop_count() const;
+		size_t     get_shard(uint64_t id) const;
+		EventLoop* get_loop(size_t shard);
+
+	private:
+		std::vector<std::unique_ptr<EventLoop>> loops;
+	};
+}
@@ -1,12 +1,19 @@
 #include <tunmode/session/session.hpp>
+#include <tunmode/reactor/eventloop.hpp>
 
-#include <thread>
+#include <sys/epoll.h>
 
 namespace tunmode
 {
-	Session::Session(uint64_t id)
+	Session::Session(EventLoop* loop, uint64_t id)
 	{
 		this->id = id;
+		this->loop = loop;
+		this->client_paused = false;
+		this->server_watched = false;
+		this->loop_slot = (size_t)-1;    // not yet seen by the loop
+		this->deadline_ms = 0;
+		this->done = false;
 	}
 
 	Session::~Session()
@@ -29,4 +36,49 @@ namespace tunmode
 	{
 		return this->server_socket;
 	}
-}
\ No newline at end of file
+
+	EventLoop* Session::get_loop()
+	{
+		return this->loop;
+	}
+
+	/* Paused client packets stay queued; resuming re-arms the wakeup, so they are picked up */
+	void Session::pause_client(bool paused)
+	{
+		if (this->client_paused == paused)
+			return;
+
+		this->client_paused = paused;
+		this->loop->rewatch(this, this->client_socket->get_wakeup_fd(), false, paused ? 0 : (EPOLLIN | EPOLLET));
+	}
+
+	void Session::watch_server(uint32_t events)
+	{
+		int fd = this->server_socket->get_socket();
+
+		if (this->server_watched)
+		{
+			this->loop->rewatch(this, fd, true, events);
+			return;
+		}
+
+		this->server_watched = this->loop->watch(this, fd, true, events);
+	}
+
+	/* Leaves the epoll set before the fd number can be reused */
+	void Session::close_server()
+	{
+		if (this->server_watched)
+		{
+			this->loop->unwatch(this->server_socket->get_socket());
+			this->server_watched = false;
+		}
+
+		this->server_socket->close();
+	}
+
+	void Session::set_deadline(uint64_t deadline_ms)
+	{
+		this->loop->schedule(this, deadline_ms);
+	}
+}
@@ -3,20 +3,34 @@
 #include "../socket/socket.hpp"
 #include "../socket/sessionsocket.hpp"
 
-#include <poll.h>
+#include <cstddef>
 #include <cstdint>
 
 namespace tunmode
 {
+	class EventLoop;
+
+	/*
+	 * One flow, driven by the event loop that owns its shard. Handlers
+	 * must not block; each returns false once the session is over, and
+	 * the loop then hands it back to its manager with finish().
+	 */
 	class Session
 	{
 	public:
-		Session(uint64_t id);
+		Session(EventLoop* loop, uint64_t id);
 		virtual ~Session();
 
 		uint64_t       get_id();
 		SessionSocket* get_client_socket();
 		Socket*        get_server_socket();
+		EventLoop*     get_loop();
+
+		virtual bool on_client() = 0;                     // client packets queued
+		virtual bool on_server(uint32_t events) = 0;      // epoll events of the upstream socket
+		virtual bool on_timeout(uint64_t now_ms) = 0;     // deadline set with EventLoop::schedule() passed
+		virtual void on_stop() = 0;                       // the loop is shutting down
+		virtual void finish() = 0;
 
 	protected:
 		uint64_t id;
@@ -24,7 +38,20 @@ namespace tunmode
 		SessionSocket* client_socket;
 		Socket* server_socket;
 
-		virtual int poll(struct pollfd fds[2]) = 0;
-		virtual void loop() = 0;
+		EventLoop* loop;
+		bool client_paused;
+		bool server_watched;
+
+		void pause_client(bool paused);
+		void watch_server(uint32_t events);
+		void close_server();
+		void set_deadline(uint64_t deadline_ms);
+
+	private:
+		size_t   loop_slot;      // index in the loop's sessions
+		uint64_t deadline_ms;    // 0 = none
+		bool     done;
+
+		friend class EventLoop;
 	};
-}
\ No newline at end of file
+}
@@ -4,213 +4,355 @@
 #include <tunmode/socket/sessionsocket.hpp>
 #include <tunmode/socket/tcpsocket.hpp>
 #include <tunmode/manager/tcpmanager.hpp>
+#include <tunmode/reactor/eventloop.hpp>
 
 #include <sys/socket.h>
-#include <thread>
+#include <sys/epoll.h>
 #include <errno.h>
+#include <cstring>
 
 namespace tunmode
 {
-	TCPSession::TCPSession(TCPManager* manager, uint64_t id) : Session(id)
+	TCPSession::TCPSession(TCPManager* manager, EventLoop* loop, uint64_t id) : Session(loop, id)
 	{
 		this->manager = manager;
 		this->client_socket = reinterpret_cast<SessionSocket*>(new TCPSocket());
 		this->server_socket = new Socket(AF_INET, SOCK_STREAM);
-		// this->server_socket->set_nonblocking(true);
-
-		std::thread loop_t(&TCPSession::loop, this);
-		loop_t.detach();
+		this->server_socket->set_nonblocking(true);
+		this->stage = TCPSTAGE_OPEN;
+		this->backlog.set_size(0);
 	}
 
-	int TCPSession::poll(struct pollfd fds[2])
-	{
-		return 0;
-	}
-
-	int TCPSession::poll2(struct pollfd fds[2], Buffer& client_buffer, Buffer& server_buffer)
+	bool TCPSession::on_client()
 	{
 		TCPSocket* cl_socket = reinterpret_cast<TCPSocket*>(this->client_socket);
-		Socket*& sv_socket = this->server_socket;
-
-		TCPState cl_socket_state = cl_socket->get_state();
-
-		int ret = 0;
-		int _ret = 0;
 
 		while (true)
 		{
-			_ret = 0;
+			int status;
 
-			// if (cl_socket_state == TCPSTATE_CLOSED)
-			// {
-			// 	fds[0].revents = POLLNVAL;
-			// 	return 1;
-			// }
+			switch (this->stage)
+			{
+			case TCPSTAGE_OPEN:
+				status = cl_socket->accept(this->server_socket);
 
-			int fd_count = 2;
-			int poll_timeout = 120000;
+				if (status != 0)
+				{
+					return status == 1;
+				}
 
-			if ((cl_socket_state == TCPSTATE_TIME_WAIT) || (cl_socket_state == TCPSTATE_CLOSED))
-			{
-				fd_count = 1;
-				poll_timeout = 15000;
-				fds[1].revents = 0;
-			}
+				if (!cl_socket->is_deferred())
+				{
+					return this->connect();
+				}
 
-			ret = ::poll(fds, fd_count, poll_timeout);
+				cl_socket->syn_ack();
+				this->stage = TCPSTAGE_HANDSHAKE;
+				break;
 
-			if (ret == -1)
-			{
+			case TCPSTAGE_HANDSHAKE:
+				status = cl_socket->handshake();
+
+				if (status != 0)
+				{
+					return status == 1;
+				}
+
+				if (cl_socket->is_deferred())
+				{
+					// Nothing within PEEK_TIMEOUT_MS: not worth holding the connection for
+					this->stage = TCPSTAGE_PEEK;
+					this->set_deadline(EventLoop::now_ms() + TCPSocket::PEEK_TIMEOUT_MS);
+					break;
+				}
+
+				this->stage = TCPSTAGE_FORWARD;
+				this->watch_server(EPOLLIN);
 				break;
-			}
-			else if (ret == 0)
-			{
-				if ((cl_socket_state == TCPSTATE_TIME_WAIT) || (cl_socket_state == TCPSTATE_CLOSED))
+
+			case TCPSTAGE_PEEK:
+				status = cl_socket->peek();
+
+				if (status != 0)
 				{
-					fds[0].revents = POLLNVAL;
-					return 1;
+					return status == 1;
 				}
 
-				return 0;
+				this->set_deadline(0);
+				return this->connect();
+
+			case TCPSTAGE_FORWARD:
+				return this->forward();
+
+			case TCPSTAGE_CLOSE:
+				return cl_socket->closing() != 0;
+
+			default:
+				return true;
 			}
-			else
+		}
+	}
+
+	bool TCPSession::on_server(uint32_t events)
+	{
+		switch (this->stage)
+		{
+		case TCPSTAGE_CONNECT:
+			return this->connected();
+
+		case TCPSTAGE_FORWARD:
 			{
-				if (fds[0].revents)
+				if ((events & EPOLLOUT) && !this->flush())
 				{
-					_ret++;
-					if (fds[0].revents & POLLIN)
-					{
-						int status = cl_socket->recv(client_buffer);
-						if (status == -2)
-						{
-							fds[0].revents |= POLLMSG;
-						}
-						else if (status == -1)
-						{
-							if ((errno == EWOULDBLOCK) || (errno == EAGAIN))
-							{
-								fds[0].revents = 0;
-								ret--;
-							}
-							else
-							{
-								fds[0].revents = POLLERR;
-							}
-						}
-						else if (client_buffer.get_size() == 0)
-						{
-							if (cl_socket->get_state() == TCPSTATE_CLOSE_WAIT)
-							{
-								fds[0].revents = POLLHUP;
-							}
-							else
-							{
-								fds[0].revents = 0;
-								_ret--;
-							}
-						}
-					}
+					return this->close();
 				}
 
-				if (fds[1].revents)
+				if (events & EPOLLIN)
 				{
-					_ret++;
+					Buffer server_buffer;
+					size_t sz = this->server_socket->recv(&server_buffer, MSG_DONTWAIT);
 
-					if (fds[1].revents & POLLIN)
+					if (sz == 0)
 					{
-						size_t sz = sv_socket->recv(&server_buffer, MSG_DONTWAIT);
-
-						if (sz == 0)
-						{
-							fds[1].revents = POLLHUP;
-						}
-						else if (sz == -1)
+						return this->close();
+					}
+					else if (sz == (size_t)-1)
+					{
+						if ((errno != EWOULDBLOCK) && (errno != EAGAIN))
 						{
-							if ((errno == EWOULDBLOCK) || (errno == EAGAIN))
-							{
-								fds[1].revents = 0;
-								ret--;
-							}
+							return this->close();
 						}
 					}
+					else
+					{
+						reinterpret_cast<TCPSocket*>(this->client_socket)->send(server_buffer);
+					}
 				}
-
-				if (_ret)
+				else if (events & (EPOLLERR | EPOLLHUP))
 				{
-					return _ret;
+					return this->close();
 				}
 			}
+
+			return true;
+
+		case TCPSTAGE_HANDSHAKE:
+			// Connected, but not reading until the client is
+			if (events & (EPOLLERR | EPOLLHUP))
+			{
+				this->close_server();
+				reinterpret_cast<TCPSocket*>(this->client_socket)->abort();
+				return false;
+			}
+
+			return true;
+
+		default:
+			return true;
 		}
+	}
+
+	bool TCPSession::on_timeout(uint64_t)
+	{
+		switch (this->stage)
+		{
+		case TCPSTAGE_PEEK:
+			return this->connect();
+
+		case TCPSTAGE_CLOSE:
+			return false;
+
+		default:
+			return true;
+		}
+	}
 
-		return -1;
+	void TCPSession::on_stop()
+	{
+		TCPSocket* cl_socket = reinterpret_cast<TCPSocket*>(this->client_socket);
+
+		this->close_server();
+
+		if (this->stage == TCPSTAGE_FORWARD)
+		{
+			cl_socket->close();
+		}
+		else if ((this->stage != TCPSTAGE_OPEN) && (this->stage != TCPSTAGE_CLOSE))
+		{
+			cl_socket->abort();
+		}
 	}
 
-	void TCPSession::loop()
+	void TCPSession::finish()
 	{
-		this->_loop();
 		this->manager->remove(this->id);
 	}
 
-	void TCPSession::_loop()
+	/* The client is paused until the connect completes, its segments stay queued */
+	bool TCPSession::connect()
 	{
 		TCPSocket* cl_socket = reinterpret_cast<TCPSocket*>(this->client_socket);
-		Socket*& sv_socket = this->server_socket;
+		int status = cl_socket->connect(this->server_socket);
 
-		if (cl_socket->connect(sv_socket))
+		if (status == -1)
 		{
-			cl_socket->close();
-			sv_socket->close();
-			return;
+			cl_socket->abort();
+			return false;
 		}
 
-		struct pollfd fds[2];
+		if (status == 0)
+		{
+			return this->connected();
+		}
+
+		this->stage = TCPSTAGE_CONNECT;
+		this->pause_client(true);
+		this->watch_server(EPOLLOUT);
+
+		return true;
+	}
 
-		fds[0].fd = cl_socket->get_read_pipe();
-		fds[0].events = POLLIN; // fake POLLIN
+	bool TCPSession::connected()
+	{
+		TCPSocket* cl_socket = reinterpret_cast<TCPSocket*>(this->client_socket);
 
-		fds[1].fd = sv_socket->get_socket();
-		fds[1].events = POLLIN;
+		if (this->server_socket->get_error() != 0)
+		{
+			cl_socket->abort();
+			return false;
+		}
 
+		this->pause_client(false);
+
+		if (cl_socket->get_state() == TCPSTATE_SYN_RECEIVED)
+		{
+			this->stage = TCPSTAGE_HANDSHAKE;
+			this->watch_server(0);
+			cl_socket->syn_ack();
+			return true;
+		}
+
+		this->stage = TCPSTAGE_FORWARD;
+		this->watch_server(EPOLLIN);
+
+		// A deferred connect has already read the first client segments; recv() hands them out first
+		return this->forward();
+	}
+
+	/* Client segments to the upstream socket, until none is queued or it has no room */
+	bool TCPSession::forward()
+	{
+		TCPSocket* cl_socket = reinterpret_cast<TCPSocket*>(this->client_socket);
 		Buffer client_buffer;
-		Buffer server_buffer;
 
-		while (!tunmode::params::stop_flag.load())
+		while (this->backlog.get_size() == 0)
 		{
-			fds[0].revents = 0;
-			fds[1].revents = 0;
-			int ret = this->poll2(fds, client_buffer, server_buffer);
+			errno = 0;
+			size_t status = cl_socket->recv(client_buffer);
 
-			if (ret == -1)
+			if (status == (size_t)-1)
 			{
-				break;
-			}
-			else if (ret == 0)
-			{
-				// timeout reached
-			}
-			else
-			{
-				if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL))
+				if ((errno == EWOULDBLOCK) || (errno == EAGAIN))
 				{
-					break;
-				}
-				else if (fds[0].revents & POLLIN)
-				{
-					sv_socket->send(&client_buffer, fds[0].revents & POLLMSG ? MSG_MORE : 0);
+					return true;
 				}
 
-				if (fds[1].revents & (POLLERR | POLLHUP | POLLNVAL))
-				{
-					break;
-				}
-				else if (fds[1].revents & POLLIN)
+				return this->close();
+			}
+
+			if (client_buffer.get_size() == 0)
+			{
+				if (cl_socket->get_state() == TCPSTATE_CLOSE_WAIT)
 				{
-					cl_socket->send(server_buffer);
+					return this->close();
 				}
+
+				continue;
+			}
+
+			if (!this->send(client_buffer, (status == (size_t)-2) ? MSG_MORE : 0))
+			{
+				return this->close();
 			}
 		}
 
-		cl_socket->close();
-		sv_socket->close();
+		return true;
+	}
+
+	/* What doesn't fit goes to the backlog, and the client waits until it is flushed */
+	bool TCPSession::send(Buffer& buffer, int flags)
+	{
+		size_t sent = this->server_socket->send(&buffer, flags);
+
+		if (sent == (size_t)-1)
+		{
+			if ((errno != EWOULDBLOCK) && (errno != EAGAIN))
+			{
+				return false;
+			}
+
+			sent = 0;
+		}
+
+		if (sent < buffer.get_size())
+		{
+			this->backlog((char*)buffer.get_buffer() + sent, buffer.get_size() - sent);
+			reinterpret_cast<TCPSocket*>(this->client_socket)->set_congested(true);
+			this->pause_client(true);
+			this->watch_server(EPOLLIN | EPOLLOUT);
+		}
+
+		return true;
+	}
+
+	bool TCPSession::flush()
+	{
+		size_t size = this->backlog.get_size();
+
+		if (size == 0)
+		{
+			return true;
+		}
+
+		size_t sent = this->server_socket->send(&this->backlog);
+
+		if (sent == (size_t)-1)
+		{
+			return (errno == EWOULDBLOCK) || (errno == EAGAIN);
+		}
+
+		if (sent < size)
+		{
+			memmove(this->backlog.get_buffer(), (char*)this->backlog.get_buffer() + sent, size - sent);
+			this->backlog.set_size(size - sent);
+			return true;
+		}
+
+		this->backlog.set_size(0);
+		this->watch_server(EPOLLIN);
+		reinterpret_cast<TCPSocket*>(this->client_socket)->set_congested(false);
+		this->pause_client(false);
+
+		return true;
+	}
+
+	/* Upstream first; the client gets our FIN and CLOSE_TIMEOUT_MS to answer it */
+	bool TCPSession::close()
+	{
+		TCPSocket* cl_socket = reinterpret_cast<TCPSocket*>(this->client_socket);
+
+		this->close_server();
+		this->backlog.set_size(0);
+		this->pause_client(false);
+
+		if (cl_socket->close())
+		{
+			return false;
+		}
+
+		this->stage = TCPSTAGE_CLOSE;
+		this->set_deadline(EventLoop::now_ms() + CLOSE_TIMEOUT_MS);
+
+		return true;
 	}
-}
\ No newline at end of file
+}
@@ -10,18 +10,39 @@ namespace tunmode
 {
 	class TCPManager;
 
+	enum TCPSessionStage {
+		TCPSTAGE_OPEN = 0,     // waiting for the client SYN
+		TCPSTAGE_CONNECT,      // upstream connect in progress, client paused
+		TCPSTAGE_HANDSHAKE,    // SYN | ACK sent, waiting for the client ACK
+		TCPSTAGE_PEEK,         // deferred connect, waiting for the first client segment
+		TCPSTAGE_FORWARD,
+		TCPSTAGE_CLOSE         // our FIN sent, waiting for the client's answer
+	};
+
 	class TCPSession : public Session
 	{
 	public:
-		TCPSession(TCPManager* manager, uint64_t id);
+		static constexpr int CLOSE_TIMEOUT_MS = 15000;
+
+		TCPSession(TCPManager* manager, EventLoop* loop, uint64_t id);
+
+		bool on_client() override;
+		bool on_server(uint32_t events) override;
+		bool on_timeout(uint64_t now_ms) override;
+		void on_stop() override;
+		void finish() override;
 
 	private:
 		TCPManager* manager;
+		TCPSessionStage stage;
 
-		int  poll(struct pollfd fds[2]) override;
-		void loop() override;
-		void _loop();
+		Buffer backlog;    // client data the upstream socket had no room for
 
-		int  poll2(struct pollfd fds[2], Buffer& client_buffer, Buffer& server_buffer);
+		bool connect();
+		bool connected();
+		bool forward();
+		bool send(Buffer& buffer, int flags);
+		bool flush();
+		bool close();
 	};
-}
\ No newline at end of file
+}
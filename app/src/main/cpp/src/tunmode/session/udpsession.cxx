@@ -5,93 +5,88 @@
 #include <tunmode/socket/sessionsocket.hpp>
 #include <tunmode/socket/udpsocket.hpp>
 #include <tunmode/manager/udpmanager.hpp>
+#include <tunmode/reactor/eventloop.hpp>
 
 #include <sys/socket.h>
-#include <thread>
+#include <sys/epoll.h>
 #include <errno.h>
 
 namespace tunmode
 {
-	UDPSession::UDPSession(UDPManager* manager, uint64_t id) : Session(id)
+	UDPSession::UDPSession(UDPManager* manager, EventLoop* loop, uint64_t id) : Session(loop, id)
 	{
 		this->manager = manager;
 		this->client_socket = reinterpret_cast<SessionSocket*>(new UDPSocket());
 		this->server_socket = new Socket(AF_INET, SOCK_DGRAM);
-		this->poll_timeout = 60000;
-
-		std::thread loop_t(&UDPSession::loop, this);
-		loop_t.detach();
-	}
-
-	int UDPSession::poll(struct pollfd fds[2])
-	{
-		return ::poll(fds, 2, this->poll_timeout);
+		this->server_socket->set_nonblocking(true);
+		this->idle_timeout = 60000;
+		this->started = false;
 	}
 
-	void UDPSession::loop()
-	{
-		this->_loop();
-		this->manager->remove(this->id);
-	}
-
-	void UDPSession::_loop()
+	bool UDPSession::on_client()
 	{
 		UDPSocket* cl_socket = reinterpret_cast<UDPSocket*>(this->client_socket);
 		Socket*& sv_socket = this->server_socket;
 
-		cl_socket->init(sv_socket);
+		if (!this->started)
+		{
+			if (cl_socket->init(sv_socket) == -1)
+			{
+				return true;
+			}
 
-		struct pollfd fds[2];
+			this->started = true;
+			this->watch_server(EPOLLIN);
+		}
 
-		fds[0].fd = cl_socket->get_read_pipe();
-		fds[0].events = POLLIN; // fake POLLIN
+		Buffer client_buffer;
 
-		fds[1].fd = sv_socket->get_socket();
-		fds[1].events = POLLIN;
+		while (cl_socket->recv(client_buffer) != (size_t)-1)
+		{
+			*sv_socket << client_buffer;
+		}
 
-		Buffer client_buffer;
-		Buffer server_buffer;
+		this->set_deadline(EventLoop::now_ms() + this->idle_timeout);
+		return true;
+	}
 
-		while (!tunmode::params::stop_flag.load())
+	bool UDPSession::on_server(uint32_t events)
+	{
+		if (events & (EPOLLERR | EPOLLHUP))
 		{
-			int ret = this->poll(fds);
+			return false;
+		}
 
-			if (ret == -1)
-			{
-				break;
-			}
-			else if (ret == 0)
-			{
-				// timeout reached
-				// server didn't respond
-				break;
-			}
-			else
-			{
-				if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL))
-				{
-					break;
-				}
-				else if (fds[0].revents & POLLIN)
-				{
-					*cl_socket >> client_buffer;
-					*sv_socket << client_buffer;
-				}
-
-				if (fds[1].revents & (POLLERR | POLLHUP | POLLNVAL))
-				{
-					break;
-				}
-				else if (fds[1].revents & POLLIN)
-				{
-					*sv_socket >> server_buffer;
-					*cl_socket << server_buffer;
-					this->poll_timeout = 10000;
-				}
-			}
+		Buffer server_buffer;
+
+		if (this->server_socket->recv(&server_buffer, MSG_DONTWAIT) == (size_t)-1)
+		{
+			return (errno == EWOULDBLOCK) || (errno == EAGAIN);
 		}
 
-		cl_socket->close();
-		sv_socket->close();
+		*(reinterpret_cast<UDPSocket*>(this->client_socket)) << server_buffer;
+
+		// Answered: the rest of the exchange is expected to be quick
+		this->idle_timeout = 10000;
+		this->set_deadline(EventLoop::now_ms() + this->idle_timeout);
+
+		return true;
+	}
+
+	/* Server didn't respond */
+	bool UDPSession::on_timeout(uint64_t)
+	{
+		return false;
+	}
+
+	void UDPSession::on_stop()
+	{
+		reinterpret_cast<UDPSocket*>(this->client_socket)->close();
+		this->close_server();
+	}
+
+	void UDPSession::finish()
+	{
+		this->manager->remove(this->id);
 	}
-}
\ No newline at end of file
+}
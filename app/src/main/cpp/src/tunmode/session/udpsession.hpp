@@ -13,14 +13,17 @@ namespace tunmode
 	class UDPSession : public Session
 	{
 	public:
-		UDPSession(UDPManager* manager, uint64_t id);
+		UDPSession(UDPManager* manager, EventLoop* loop, uint64_t id);
+
+		bool on_client() override;
+		bool on_server(uint32_t events) override;
+		bool on_timeout(uint64_t now_ms) override;
+		void on_stop() override;
+		void finish() override;
 
 	private:
 		UDPManager* manager;
-		uint32_t poll_timeout;
-
-		int poll(struct pollfd fds[2]) override;
-		void loop() override;
-		void _loop();
+		uint32_t idle_timeout;
+		bool started;
 	};
-}
\ No newline at end of file
+}
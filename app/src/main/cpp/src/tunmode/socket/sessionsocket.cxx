@@ -1,10 +1,8 @@
 #include <tunmode/socket/sessionsocket.hpp>
-#include <tunmode/common/utils.hpp>
 #include <tunmode/definitions.hpp>
 
 #include <unistd.h>
-#include <fcntl.h>
-#include <netinet/ip.h>
+#include <sys/eventfd.h>
 
 #include <misc/logger.hpp>
 
@@ -12,19 +10,22 @@ namespace tunmode
 {
 	TunSocket* SessionSocket::tun = nullptr;
 
-	SessionSocket::SessionSocket()
+	SessionSocket::SessionSocket(size_t queue_size) : queue(queue_size)
 	{
-		this->session_pipe[0] = 0;
-		this->session_pipe[1] = 0;
-
-		pipe2(this->session_pipe, O_DIRECT);
-		// auto res = fcntl(this->session_pipe[1], F_SETPIPE_SZ, 16384);
+		this->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		this->dropped = 0;
 	}
 
 	SessionSocket::~SessionSocket()
 	{
-		::close(this->session_pipe[0]);
-		::close(this->session_pipe[1]);
+		Packet* packet;
+
+		while (this->queue.pop(packet))
+		{
+			PacketPool::release(packet);
+		}
+
+		::close(this->wakeup_fd);
 	}
 
 	size_t SessionSocket::send_tun(Packet& packet)
@@ -32,47 +33,63 @@ namespace tunmode
 		return SessionSocket::tun->send(&packet);
 	}
 
-	size_t SessionSocket::send(const Packet& packet)
+	bool SessionSocket::send(Packet* packet)
 	{
-		return ::write(this->session_pipe[1], packet.get_buffer(), packet.get_size());
+		if (!this->push(packet))
+		{
+			this->dropped++;
+			return false;
+		}
+
+		return true;
 	}
 
-	size_t SessionSocket::recv(Packet& packet)
+	bool SessionSocket::push(Packet* packet)
 	{
-		size_t size = ::read(this->session_pipe[0], packet.get_buffer(), TUNMODE_BUFFER_SIZE);
-		packet.set_size(size);
-		ip* ip_header = (ip*)packet.get_buffer();
-		int proto = ip_header->ip_p;
-		packet.set_protocol(proto);
+		bool was_empty;
 
-		switch (proto)
+		if (!this->queue.push(packet, was_empty))
 		{
-		case (TUNMODE_PROTOCOL_TCP):
-			utils::make_tcp_id(&packet);
-			break;
-		case (TUNMODE_PROTOCOL_UDP):
-			utils::make_udp_id(&packet);
-			break;
-		default:
-			packet.set_protocol(TUNMODE_PROTOCOL_UNKNOWN);
-			break;
+			return false;
 		}
 
-		return size;
+		// Otherwise the loop has not drained the queue yet and will see the packet
+		if (was_empty)
+		{
+			eventfd_write(this->wakeup_fd, 1);
+		}
+
+		return true;
 	}
 
-	void SessionSocket::operator<(const Packet& packet)
+	bool SessionSocket::next(PacketRef& packet)
 	{
-		this->send(packet);
+		Packet* queued;
+
+		if (!this->queue.pop(queued))
+		{
+			return false;
+		}
+
+		packet.reset(queued);
+		return true;
+	}
+
+	size_t SessionSocket::get_queue_room() const
+	{
+		size_t size = this->queue.get_size();
+		size_t capacity = this->queue.get_capacity();
+
+		return (size < capacity) ? capacity - size : 0;
 	}
 
-	void SessionSocket::operator>(Packet& packet)
+	uint64_t SessionSocket::get_dropped() const
 	{
-		this->recv(packet);
+		return this->dropped;
 	}
 
-	int SessionSocket::get_read_pipe()
+	int SessionSocket::get_wakeup_fd()
 	{
-		return this->session_pipe[0];
+		return this->wakeup_fd;
 	}
 }
\ No newline at end of file
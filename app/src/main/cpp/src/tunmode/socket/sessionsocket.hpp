@@ -2,35 +2,61 @@
 
 #include "tunsocket.hpp"
 #include "../common/packet.hpp"
+#include "../common/packetpool.hpp"
+#include "../common/spscring.hpp"
 
 #include <netinet/in.h>
 #include <cstdint>
 
 namespace tunmode
 {
+	/*
+	 * Client side of a session. The tunnel thread queues client packets
+	 * (pooled, passed on as they are) with send(Packet*), the session's
+	 * event loop takes them with next(). The wakeup fd is only signalled
+	 * when a packet lands in an empty queue, and is meant to be watched
+	 * edge-triggered, so it is never read.
+	 *
+	 * The queue is bounded per flow: a session that stops draining it
+	 * (its upstream is backed up) only loses its own packets, and never
+	 * holds up the tunnel thread. Datagrams are dropped and counted; TCP
+	 * overrides send() to leave segments unacknowledged instead.
+	 */
 	class SessionSocket
 	{
 	public:
 		static TunSocket* tun;
 
-		SessionSocket();
+		SessionSocket(size_t queue_size);
 		virtual ~SessionSocket();
 
 		virtual size_t send_tun(Packet& packet); // send to tun iface
 
-		virtual size_t send(const Packet& packet);
+		/* Tunnel thread: takes the packet unless the queue is full (false) */
+		virtual bool   send(Packet* packet);
 		virtual size_t send(const Buffer& buffer) = 0;
-		virtual size_t recv(Packet& packet);
 		virtual size_t recv(Buffer& buffer) = 0;
 
-		virtual void   operator<(const Packet& packet);
+		/* Next queued client packet; false once the queue is empty */
+		bool next(PacketRef& packet);
+
+		/* Packets the queue still has room for */
+		size_t   get_queue_room() const;
+		/* Client packets dropped on a full queue; tunnel thread, or under the session's shard lock */
+		uint64_t get_dropped() const;
+
 		virtual void   operator<<(const Buffer& buffer) = 0;
-		virtual void   operator>(Packet& packet);
 		virtual void   operator>>(Buffer& buffer) = 0;
 
-		int get_read_pipe();
+		int get_wakeup_fd();
+
+	protected:
+		/* Queues the packet unless the queue is full (false), waking the loop if it was empty */
+		bool push(Packet* packet);
 
 	private:
-		int session_pipe[2];
+		SpscRing<Packet*> queue;
+		int wakeup_fd;
+		uint64_t dropped;
 	};
 }
\ No newline at end of file
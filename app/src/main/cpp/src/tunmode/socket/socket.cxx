@@ -4,6 +4,7 @@
 #include <sys/socket.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
 
 #include <misc/logger.hpp>
 
@@ -50,6 +51,9 @@ namespace tunmode
 
 	int Socket::close()
 	{
+		if (this->closed)
+			return 0;
+
 		this->closed = true;
 		return ::close(this->socket);
 	}
@@ -80,10 +84,22 @@ namespace tunmode
 	{
 		int flags = fcntl(this->socket, F_GETFL, 0);
 		if (flags == -1) return -1;
-		flags = state ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK);
+		flags = state ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
 		return fcntl(this->socket, F_SETFL, flags);
 	}
 
+	/* Pending error, e.g. the outcome of a non-blocking connect; clears it */
+	int Socket::get_error()
+	{
+		int error = 0;
+		socklen_t length = sizeof(error);
+
+		if (getsockopt(this->socket, SOL_SOCKET, SO_ERROR, &error, &length) == -1)
+			return errno;
+
+		return error;
+	}
+
 	void Socket::operator<<(const Buffer& buffer)
 	{
 		this->send(&buffer);
@@ -24,6 +24,7 @@ namespace tunmode
 
 		int    get_socket();
 		int    set_nonblocking(bool state);
+		int    get_error();
 
 		void   operator<<(const Buffer& buffer);
 		void   operator<<(const Buffer* buffer);
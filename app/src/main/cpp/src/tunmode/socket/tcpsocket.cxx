@@ -2,6 +2,7 @@
 #include <tunmode/common/utils.hpp>
 #include <tunmode/definitions.hpp>
 #include <tunmode/tunmode.hpp>
+#include <tunmode/filter/hostpeek.hpp>
 
 #include <sys/socket.h>
 #include <arpa/inet.h>
@@ -11,38 +12,69 @@
 #include <unistd.h>
 #include <errno.h>
 #include <cstdlib>
+#include <algorithm>
 #include <random>
 
 #include <misc/logger.hpp>
 
 namespace tunmode
 {
-	TCPSocket::TCPSocket() : SessionSocket()
+	namespace
 	{
-		this->state = TCPSTATE_LISTEN;
-		this->syn_recved = false;
+		bool _offers_window_scale(const Packet& packet, const tcphdr* tcp_header)
+		{
+			const uint8_t* option = (const uint8_t*)(tcp_header + 1);
+			const uint8_t* end = std::min((const uint8_t*)tcp_header + tcp_header->th_off * 4,
+				(const uint8_t*)packet.get_buffer() + packet.get_size());
+
+			while ((option < end) && (*option != TCPOPT_EOL))
+			{
+				if (*option == TCPOPT_NOP)
+				{
+					option++;
+					continue;
+				}
+
+				if ((end - option < 2) || (option[1] < 2))
+					break;
+
+				if (*option == TCPOPT_WINDOW)
+					return true;
+
+				option += option[1];
+			}
+
+			return false;
+		}
 	}
 
-	TCPSocket::~TCPSocket()
+	TCPSocket::TCPSocket() : SessionSocket(TUNMODE_TCP_QUEUE)
 	{
-		SessionSocket::~SessionSocket();
+		this->state = TCPSTATE_LISTEN;
+		this->syn_recved = false;
+		this->pending_count = 0;
+		this->pending_next = 0;
+		this->deferred = false;
+		this->congested = false;
+		this->window_closed = false;
+		this->window_scaled = false;
 	}
 
-	int TCPSocket::connect(Socket* skt)
-	{
-		static constexpr char hs_opts[] = {2, 4, 15, 160, 1, 3, 3, 8, 1, 1, 4, 2};
+	TCPSocket::~TCPSocket() {}
 
-		Packet client_packet;
-		client_packet.set_protocol(TUNMODE_PROTOCOL_TCP);
-		Packet server_packet;
-		server_packet.set_protocol(TUNMODE_PROTOCOL_TCP);
+	int TCPSocket::accept(Socket* skt)
+	{
+		PacketRef client_packet;
 
-		*this > client_packet;
+		if (!this->next(client_packet))
+		{
+			return 1;
+		}
 
 		ip* ip_header;
 		tcphdr* tcp_header;
 
-		utils::point_headers_tcp(&client_packet, &ip_header, &tcp_header);
+		utils::point_headers_tcp(client_packet.get(), &ip_header, &tcp_header);
 
 		this->client_addr = ip_header->ip_src;
 		this->client_port = tcp_header->th_sport;
@@ -55,11 +87,12 @@ namespace tunmode
 		this->vars.snd.wnd = ntohs(tcp_header->th_win);
 		this->vars.snd.iss = (uint32_t)rand();
 		this->vars.snd.nxt = this->vars.snd.iss + 1;
+		this->window_scaled = _offers_window_scale(*client_packet, tcp_header);
 
 		if (tcp_header->th_flags != TH_SYN)
 		{
 			this->set_state(TCPSTATE_CLOSED);
-			this->reset(client_packet);
+			this->reset(*client_packet);
 			return -1;
 		}
 
@@ -67,11 +100,22 @@ namespace tunmode
 
 		skt->bind(params::net_iface, 0);
 
-		if (skt->connect(this->server_addr, this->server_port) == -1)
-		{
-			this->reset(client_packet);
-			return -1;
-		}
+		// HTTP and TLS clients speak first, so their upstream connect can
+		// wait until the first segment names the host
+		this->deferred = params::deferred_connect.load(std::memory_order_relaxed)
+			&& ((ntohs(this->server_port) == 80) || (ntohs(this->server_port) == 443));
+
+		return 0;
+	}
+
+	void TCPSocket::syn_ack()
+	{
+		static constexpr char hs_opts[] = {2, 4, 15, 160, 1, 3, 3, WINDOW_SHIFT, 1, 1, 4, 2};
+
+		Packet server_packet;
+		server_packet.set_protocol(TUNMODE_PROTOCOL_TCP);
+		ip* ip_header;
+		tcphdr* tcp_header;
 
 		utils::build_tcp_packet(&server_packet);
 		utils::point_headers_tcp(&server_packet, &ip_header, &tcp_header);
@@ -90,50 +134,151 @@ namespace tunmode
 		server_packet.set_size(server_packet.get_size() + 12);
 
 		this->send_tun(server_packet);
+	}
 
-		do {
-			*this > client_packet;
-			utils::point_headers_tcp(&client_packet, &ip_header, &tcp_header);
-		} while ((ntohl(tcp_header->th_seq) == this->vars.rcv.irs) && (tcp_header->th_flags == TH_SYN));
+	int TCPSocket::handshake()
+	{
+		PacketRef client_packet;
+		ip* ip_header;
+		tcphdr* tcp_header;
 
-		if ((tcp_header->th_flags != TH_ACK) && (tcp_header->th_flags != TH_RST))
+		while (this->next(client_packet))
 		{
-			this->set_state(TCPSTATE_CLOSED);
-			this->reset(client_packet);
-			return -1;
+			utils::point_headers_tcp(client_packet.get(), &ip_header, &tcp_header);
+
+			if ((ntohl(tcp_header->th_seq) == this->vars.rcv.irs) && (tcp_header->th_flags == TH_SYN))
+			{
+				continue;
+			}
+
+			if ((tcp_header->th_flags != TH_ACK) && (tcp_header->th_flags != TH_RST))
+			{
+				this->set_state(TCPSTATE_CLOSED);
+				this->reset(*client_packet);
+				return -1;
+			}
+
+			this->vars.snd.nxt++;
+			this->vars.snd.una = this->vars.snd.nxt;
+
+			this->set_state(TCPSTATE_ESTABLISHED);
+			return 0;
+		}
+
+		return 1;
+	}
+
+	int TCPSocket::peek()
+	{
+		size_t count = this->pending_count;
+
+		while ((this->pending_count < PEEK_SEGMENTS) && this->next(this->pending[this->pending_count]))
+		{
+			this->pending_count++;
+		}
+
+		if (this->pending_count == count)
+		{
+			return 1;
+		}
+
+		// Payloads in sequence from the first byte not yet received; retransmissions are left out
+		uint8_t data[PEEK_SEGMENTS * SEGMENT_SIZE];
+		size_t size = 0;
+
+		for (size_t i = 0; i < this->pending_count; i++)
+		{
+			ip* ip_header;
+			tcphdr* tcp_header;
+			utils::point_headers_tcp(this->pending[i].get(), &ip_header, &tcp_header);
+
+			InBuffer in_buffer = this->pending[i]->get_data();
+
+			if ((ntohl(tcp_header->th_seq) == (uint32_t)(this->vars.rcv.nxt + size)) && (in_buffer.get_size() <= sizeof(data) - size))
+			{
+				memcpy(data + size, in_buffer.get_buffer(), in_buffer.get_size());
+				size += in_buffer.get_size();
+			}
+		}
+
+		// The rest of a TLS record still to come, or no data yet: wait while there is room
+		if (((size == 0) || (size < hostpeek::tls_record_size(data, size))) && (this->pending_count < PEEK_SEGMENTS))
+		{
+			return 1;
 		}
 
-		this->vars.snd.nxt++;
-		this->vars.snd.una = this->vars.snd.nxt;
+		const char* name;
+		size_t length;
+
+		if (hostpeek::server_name(data, size, name, length))
+		{
+			RcuReadGuard guard;
 
-		this->set_state(TCPSTATE_ESTABLISHED);
-		// stk->set_nonblocking(true);
+			if (params::rules.get()->get_blocked_domains()->contains(name, length))
+			{
+				LOGD_("Blocked connection to %.*s", (int)length, name);
+				this->abort();
+				return -1;
+			}
+		}
 
 		return 0;
 	}
 
+	int TCPSocket::connect(Socket* skt)
+	{
+		if (skt->connect(this->server_addr, this->server_port) == 0)
+		{
+			return 0;
+		}
+
+		return (errno == EINPROGRESS) ? 1 : -1;
+	}
+
+	bool TCPSocket::is_deferred()
+	{
+		return this->deferred;
+	}
+
 	size_t TCPSocket::send_tun(Packet& packet)
 	{
+		ip* ip_header;
+		tcphdr* tcp_header;
+		utils::point_headers_tcp(&packet, &ip_header, &tcp_header);
+
+		if (!(tcp_header->th_flags & TH_RST))
+		{
+			tcp_header->th_win = htons(this->window(tcp_header->th_flags & TH_SYN));
+		}
+
 		utils::finalize_packet_tcp(&packet);
 		return SessionSocket::send_tun(packet);
 	}
 
-	size_t TCPSocket::send(const Packet& packet)
+	bool TCPSocket::send(Packet* packet)
 	{
 		ip* ip_header;
 		tcphdr* tcp_header;
-		utils::point_headers_tcp((Packet*)&packet, &ip_header, &tcp_header);
+		utils::point_headers_tcp(packet, &ip_header, &tcp_header);
 
 		if (tcp_header->th_flags == TH_SYN)
 		{
+			// Retransmitted SYN: taken and dropped
 			if (this->syn_recved)
 			{
-				return packet.get_size();
+				PacketPool::release(packet);
+				return true;
 			}
 			this->syn_recved = true;
 		}
 
-		return SessionSocket::send(packet);
+		// Dropped before it was ACKed: the client sends it again
+		if (!this->push(packet))
+		{
+			PacketPool::release(packet);
+		}
+
+		return true;
 	}
 
 	size_t TCPSocket::send(const Buffer& buffer)
@@ -166,12 +311,38 @@ namespace tunmode
 
 	size_t TCPSocket::recv(Buffer& buffer)
 	{
-		Packet packet;
-		packet.set_protocol(TUNMODE_PROTOCOL_TCP);
+		if (this->pending_next < this->pending_count)
+		{
+			PacketRef& peeked = this->pending[this->pending_next++];
+			size_t size = this->receive(*peeked, buffer);
+			peeked.reset();
+
+			return size;
+		}
+
+		PacketRef packet;
+
+		if (!this->next(packet))
+		{
+			// Queue drained after a zero window: announce the room again
+			if (this->window_closed && !this->congested && (this->get_state() == TCPSTATE_ESTABLISHED))
+			{
+				this->ack();
+			}
+
+			buffer.set_size(0);
+			errno = EAGAIN;
+			return -1;
+		}
+
+		return this->receive(*packet, buffer);
+	}
+
+	size_t TCPSocket::receive(Packet& packet, Buffer& buffer)
+	{
 		ip* ip_header;
 		tcphdr* tcp_header;
 
-		*this > packet;
 		InBuffer in_buffer = packet.get_data();
 
 		utils::point_headers_tcp(&packet, &ip_header, &tcp_header);
@@ -187,9 +358,16 @@ namespace tunmode
 		}
 		else
 		{
-			if ((!((this->vars.rcv.nxt <= ntohl(tcp_header->th_seq)) && (ntohl(tcp_header->th_seq) < (this->vars.rcv.nxt + this->vars.rcv.wnd))))
-				|| !((this->vars.rcv.nxt <= (ntohl(tcp_header->th_seq) + in_buffer.get_size() - 1)) && ((ntohl(tcp_header->th_seq) + in_buffer.get_size() - 1) < (this->vars.rcv.nxt + this->vars.rcv.wnd))))
+			// Data is only taken in order: a segment after a gap (one that found
+			// the queue full) or a retransmission gets our ACK for the gap instead
+			if ((ntohl(tcp_header->th_seq) != this->vars.rcv.nxt)
+				|| !((ntohl(tcp_header->th_seq) + in_buffer.get_size() - 1) < (this->vars.rcv.nxt + this->vars.rcv.wnd)))
 			{
+				if ((this->get_state() == TCPSTATE_ESTABLISHED) && !(tcp_header->th_flags & TH_RST))
+				{
+					this->ack();
+				}
+
 				buffer.set_size(0);
 				return 0;
 			}
@@ -398,39 +576,69 @@ namespace tunmode
 
 	}
 
-	void TCPSocket::close()
+	bool TCPSocket::close()
 	{
 		TCPState state = this->get_state();
-		if (state == TCPSTATE_ESTABLISHED)
+
+		if ((state != TCPSTATE_ESTABLISHED) && (state != TCPSTATE_CLOSE_WAIT))
 		{
-			Packet client_packet;
-			client_packet.set_protocol(TUNMODE_PROTOCOL_TCP);
-			ip* ip_header;
-			tcphdr* tcp_header;
+			return true;
+		}
 
-			utils::build_tcp_packet(&client_packet);
-			utils::point_headers_tcp(&client_packet, &ip_header, &tcp_header);
+		Packet client_packet;
+		client_packet.set_protocol(TUNMODE_PROTOCOL_TCP);
+		ip* ip_header;
+		tcphdr* tcp_header;
 
-			ip_header->ip_src = this->server_addr;
-			tcp_header->th_sport = this->server_port;
-			ip_header->ip_dst = this->client_addr;
-			tcp_header->th_dport = this->client_port;
+		utils::build_tcp_packet(&client_packet);
+		utils::point_headers_tcp(&client_packet, &ip_header, &tcp_header);
 
-			tcp_header->th_seq = htonl(this->vars.snd.nxt);
-			tcp_header->th_ack = htonl(this->vars.rcv.nxt);
-			tcp_header->th_flags = TH_FIN | TH_ACK;
+		ip_header->ip_src = this->server_addr;
+		tcp_header->th_sport = this->server_port;
+		ip_header->ip_dst = this->client_addr;
+		tcp_header->th_dport = this->client_port;
 
-			this->send_tun(client_packet);
-			this->set_state(TCPSTATE_FIN_WAIT_1);
+		tcp_header->th_seq = htonl(this->vars.snd.nxt);
+		tcp_header->th_ack = htonl(this->vars.rcv.nxt);
+		tcp_header->th_flags = TH_FIN | TH_ACK;
 
-			*this > client_packet; // assume packet is ACK of FIN
+		this->send_tun(client_packet);
+		this->set_state((state == TCPSTATE_ESTABLISHED) ? TCPSTATE_FIN_WAIT_1 : TCPSTATE_LAST_ACK);
 
-			utils::point_headers_tcp(&client_packet, &ip_header, &tcp_header);
+		return false;
+	}
+
+	int TCPSocket::closing()
+	{
+		PacketRef client_packet;
+		ip* ip_header;
+		tcphdr* tcp_header;
+
+		while (this->next(client_packet))
+		{
+			TCPState state = this->get_state();
 
-			if (tcp_header->th_flags == TH_ACK)
+			if (state == TCPSTATE_LAST_ACK)
+			{
+				// assume packet is ACK of FIN
+				LOGD_("CLOSE_WAIT | Closing connection");
+
+				this->set_state(TCPSTATE_CLOSED);
+				return 0;
+			}
+
+			if ((state != TCPSTATE_FIN_WAIT_1) && (state != TCPSTATE_FIN_WAIT_2))
+			{
+				return 0;
+			}
+
+			utils::point_headers_tcp(client_packet.get(), &ip_header, &tcp_header);
+
+			// ACK of our FIN; the client's FIN | ACK follows
+			if ((state == TCPSTATE_FIN_WAIT_1) && (tcp_header->th_flags == TH_ACK))
 			{
 				this->set_state(TCPSTATE_FIN_WAIT_2);
-				*this > client_packet; // assume packet is FIN | ACK
+				continue;
 			}
 
 			if (ntohl(tcp_header->th_seq) > this->vars.rcv.nxt)
@@ -444,7 +652,7 @@ namespace tunmode
 				this->vars.snd.nxt += 1;
 			}
 
-			utils::build_tcp_packet(&client_packet);
+			utils::build_tcp_packet(client_packet.get());
 
 			ip_header->ip_src = this->server_addr;
 			tcp_header->th_sport = this->server_port;
@@ -458,36 +666,78 @@ namespace tunmode
 			LOGD_("ESTABLISHED | Closing connection");
 
 			this->set_state(TCPSTATE_TIME_WAIT);
-			this->send_tun(client_packet);
+			this->send_tun(*client_packet);
+			return 0;
 		}
-		else if (state == TCPSTATE_CLOSE_WAIT)
+
+		return 1;
+	}
+
+	void TCPSocket::set_congested(bool congested)
+	{
+		if (this->congested == congested)
 		{
-			Packet client_packet;
-			client_packet.set_protocol(TUNMODE_PROTOCOL_TCP);
-			ip* ip_header;
-			tcphdr* tcp_header;
+			return;
+		}
 
-			utils::build_tcp_packet(&client_packet);
-			utils::point_headers_tcp(&client_packet, &ip_header, &tcp_header);
+		this->congested = congested;
 
-			ip_header->ip_src = this->server_addr;
-			tcp_header->th_sport = this->server_port;
-			ip_header->ip_dst = this->client_addr;
-			tcp_header->th_dport = this->client_port;
+		// Zero window now rather than at the next segment, and a window
+		// update when lifted: the client would otherwise wait on its
+		// persist timer
+		if (this->get_state() == TCPSTATE_ESTABLISHED)
+		{
+			this->ack();
+		}
+	}
 
-			tcp_header->th_seq = htonl(this->vars.snd.nxt);
-			tcp_header->th_ack = htonl(this->vars.rcv.nxt);
-			tcp_header->th_flags = TH_FIN | TH_ACK;
+	/*
+	 * Room left in our queue of client segments. The queue is bounded in
+	 * packets, so it closes while a few slots are still free for segments
+	 * of any size already in flight. SYN windows are never scaled, the
+	 * others only if both ends agreed to it.
+	 */
+	uint16_t TCPSocket::window(bool syn)
+	{
+		size_t room = this->get_queue_room();
 
-			this->send_tun(client_packet);
-			this->set_state(TCPSTATE_LAST_ACK);
+		this->window_closed = this->congested || (room <= QUEUE_RESERVE);
 
-			*this > client_packet; // assume packet is ACK of FIN
+		if (this->window_closed)
+		{
+			return 0;
+		}
 
-			LOGD_("CLOSE_WAIT | Closing connection");
+		size_t bytes = (room - QUEUE_RESERVE) * SEGMENT_SIZE;
 
-			this->set_state(TCPSTATE_CLOSED);
+		if (!syn && this->window_scaled)
+		{
+			bytes >>= WINDOW_SHIFT;
 		}
+
+		return (uint16_t)std::min<size_t>(bytes, 0xFFFF);
+	}
+
+	void TCPSocket::ack()
+	{
+		Packet client_packet;
+		client_packet.set_protocol(TUNMODE_PROTOCOL_TCP);
+		ip* ip_header;
+		tcphdr* tcp_header;
+
+		utils::build_tcp_packet(&client_packet);
+		utils::point_headers_tcp(&client_packet, &ip_header, &tcp_header);
+
+		ip_header->ip_src = this->server_addr;
+		tcp_header->th_sport = this->server_port;
+		ip_header->ip_dst = this->client_addr;
+		tcp_header->th_dport = this->client_port;
+
+		tcp_header->th_seq = htonl(this->vars.snd.nxt);
+		tcp_header->th_ack = htonl(this->vars.rcv.nxt);
+		tcp_header->th_flags = TH_ACK;
+
+		this->send_tun(client_packet);
 	}
 
 	TCPState TCPSocket::get_state()
@@ -604,4 +854,35 @@ namespace tunmode
 
 		this->set_state(TCPSTATE_CLOSED);
 	}
+
+	void TCPSocket::abort()
+	{
+		Packet client_packet;
+		client_packet.set_protocol(TUNMODE_PROTOCOL_TCP);
+		ip* ip_header;
+		tcphdr* tcp_header;
+
+		utils::build_tcp_packet(&client_packet);
+		utils::point_headers_tcp(&client_packet, &ip_header, &tcp_header);
+
+		ip_header->ip_src = this->server_addr;
+		tcp_header->th_sport = this->server_port;
+		ip_header->ip_dst = this->client_addr;
+		tcp_header->th_dport = this->client_port;
+
+		tcp_header->th_seq = htonl(this->vars.snd.nxt);
+		tcp_header->th_ack = htonl(this->vars.rcv.nxt);
+		tcp_header->th_flags = (TH_RST | TH_ACK);
+
+		this->send_tun(client_packet);
+
+		for (PacketRef& peeked : this->pending)
+		{
+			peeked.reset();
+		}
+
+		this->pending_count = 0;
+		this->pending_next = 0;
+		this->set_state(TCPSTATE_CLOSED);
+	}
 }
\ No newline at end of file
@@ -49,17 +49,52 @@ namespace tunmode
 		TCPSocket();
 		~TCPSocket() override;
 
-		int connect(Socket* skt);
+		static constexpr int PEEK_TIMEOUT_MS  = 1000;
+		static constexpr int WINDOW_SHIFT     = 8;                            // window scale we announce
+		static constexpr size_t SEGMENT_SIZE  = TUNMODE_PACKET_SIZE - 40;     // client payload per queued packet
+		static constexpr size_t PEEK_SEGMENTS = 4;                            // client segments peek() holds at most
+		static constexpr size_t QUEUE_RESERVE = 16;                           // queue slots kept out of the window
+
+		/*
+		 * Handshake, one step per event of the session, never blocking:
+		 *     accept()      client SYN, binds `skt`
+		 *     connect()     upstream connect; before syn_ack() unless deferred
+		 *     syn_ack()
+		 *     handshake()   client ACK
+		 *     peek()        deferred only: holds the first client segments, up
+		 *                   to a whole TLS record, and checks the host they
+		 *                   name before connect()
+		 * Steps that read client segments return 1 while none is queued, and
+		 * -1 once the client has been reset.
+		 */
+		int  accept(Socket* skt);
+		int  connect(Socket* skt);    // 0 connected, 1 in progress, -1 failed
+		void syn_ack();
+		int  handshake();
+		int  peek();
+		bool is_deferred();
 
 		size_t send_tun(Packet& packet) override;
-		size_t send(const Packet& packet) override;
+		bool   send(Packet* packet) override;     // always taken; a segment that finds the queue full is never ACKed
 		size_t send(const Buffer& buffer) override;
-		size_t recv(Buffer& buffer) override;
+		size_t recv(Buffer& buffer) override;    // -1 with EAGAIN once no segment is queued; peeked ones first
 
 		void   operator<<(const Buffer& buffer) override;
 		void   operator>>(Buffer& buffer) override;
 
-		void close();
+		/* Sends our FIN; false while the client still has to answer it, see closing() */
+		bool close();
+		/* Takes the client's answers to our FIN; 0 once the close is over */
+		int  closing();
+		/* Resets the connection from the upstream side */
+		void abort();
+
+		/*
+		 * Backpressure while the upstream is backed up: the session stops
+		 * taking (and so ACKing) client segments and the window we
+		 * advertise drops to zero. Both changes are announced with an ACK.
+		 */
+		void set_congested(bool congested);
 
 		TCPState get_state();
 
@@ -74,6 +109,18 @@ namespace tunmode
 		TCPVars vars;
 		TCPState state;
 
+		PacketRef pending[PEEK_SEGMENTS];    // first client segments, held while the upstream connect waits on them
+		size_t pending_count;
+		size_t pending_next;                 // next one recv() takes
+		bool   deferred;
+		bool   congested;
+		bool   window_closed;    // last window we advertised was zero
+		bool   window_scaled;    // the client's SYN offered window scaling too
+
+		size_t   receive(Packet& packet, Buffer& buffer);
+		uint16_t window(bool syn);
+		void     ack();
+
 		void set_state(TCPState state);
 		void reset(const Packet& packet);
 	};
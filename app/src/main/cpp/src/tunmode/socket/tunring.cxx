@@ -0,0 +1,271 @@
+#include <tunmode/socket/tunring.hpp>
+#include <tunmode/definitions.hpp>
+
+#include <errno.h>
+#include <cstring>
+
+#include <misc/logger.hpp>
+
+namespace tunmode
+{
+	TunRing::TunRing()
+	{
+		this->tunnel = -1;
+		this->multishot = false;
+		this->failed = false;
+		this->posted = 0;
+	}
+
+	bool TunRing::open(int tunnel)
+	{
+		this->close();
+
+		if (!this->ring.open(BUFFER_COUNT))
+			return false;
+
+		this->buffers.assign((size_t)BUFFER_COUNT * BUFFER_SIZE, 0);
+
+		if (!this->ring.supports(IORING_OP_READ)
+			|| !this->ring.register_buffers(GROUP, this->buffers.data(), BUFFER_COUNT, BUFFER_SIZE))
+		{
+			this->close();
+			return false;
+		}
+
+		this->tunnel = tunnel;
+		this->multishot = this->ring.supports(IoUring::OP_READ_MULTISHOT);
+		this->failed = false;
+		this->posted = 0;
+
+		this->post();
+
+		if (this->ring.submit() < 0)
+		{
+			this->close();
+			return false;
+		}
+
+		LOGI_("TUN reads on io_uring (%s)", this->multishot ? "multishot" : "batched");
+		return true;
+	}
+
+	void TunRing::close()
+	{
+		this->ring.close();
+		this->buffers.clear();
+		this->buffers.shrink_to_fit();
+		this->tunnel = -1;
+		this->posted = 0;
+	}
+
+	bool TunRing::is_open() const
+	{
+		return this->ring.is_open();
+	}
+
+	/* Tops the reads in flight back up; submitted by the next wait() */
+	void TunRing::post()
+	{
+		uint32_t target = this->multishot ? 1 : TUNMODE_TUN_BURST;
+
+		while (!this->failed && (this->posted < target))
+		{
+			struct io_uring_sqe* sqe = this->ring.get_sqe();
+
+			if (!sqe)
+				break;
+
+			sqe->opcode = this->multishot ? (uint8_t)IoUring::OP_READ_MULTISHOT : (uint8_t)IORING_OP_READ;
+			sqe->fd = this->tunnel;
+			sqe->flags = IOSQE_BUFFER_SELECT;
+			sqe->buf_group = GROUP;
+			sqe->len = this->multishot ? 0 : BUFFER_SIZE;
+
+			this->posted++;
+		}
+	}
+
+	int TunRing::wait(int timeout_ms)
+	{
+		if (this->ring.peek_cqe())
+		{
+			this->ring.submit();    // reads reposted by read()
+			return 1;
+		}
+
+		if (this->failed)
+			return -1;
+
+		if (this->ring.submit(1, timeout_ms) < 0)
+			return -1;
+
+		return this->ring.peek_cqe() ? 1 : 0;
+	}
+
+	size_t TunRing::read(Packet* const* packets, size_t count)
+	{
+		size_t received = 0;
+		struct io_uring_cqe* cqe;
+
+		while ((received < count) && (cqe = this->ring.peek_cqe()))
+		{
+			int res = cqe->res;
+			uint32_t flags = cqe->flags;
+
+			this->ring.seen();
+
+			if (!(flags & IORING_CQE_F_MORE))
+				this->posted--;
+
+			if (flags & IORING_CQE_F_BUFFER)
+			{
+				uint16_t id = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+
+				if (res > 0)
+				{
+					memcpy(packets[received]->get_buffer(), this->ring.get_buffer(id), (size_t)res);
+					packets[received]->set_size((size_t)res);
+					received++;
+				}
+
+				this->ring.recycle_buffer(id);
+				continue;
+			}
+
+			// Out of buffers until the ones just read are recycled; reposted below
+			if ((res == -ENOBUFS) || (res == -EAGAIN) || (res == -EINTR))
+				continue;
+
+			if (res <= 0)
+			{
+				LOGW_("TUN read on io_uring failed (%d)", res);
+				this->failed = true;
+			}
+		}
+
+		this->post();
+		return received;
+	}
+
+	TunBatch::TunBatch()
+	{
+		this->queued = 0;
+		this->inflight = 0;
+	}
+
+	TunBatch::~TunBatch()
+	{
+		this->close();
+	}
+
+	bool TunBatch::open()
+	{
+		if (!this->ring.open(SLOT_COUNT) || !this->ring.supports(IORING_OP_WRITE))
+		{
+			this->ring.close();
+			return false;
+		}
+
+		this->slots.assign((size_t)SLOT_COUNT * SLOT_SIZE, 0);
+		this->free_slots.clear();
+
+		for (uint32_t slot = SLOT_COUNT; slot-- > 0;)
+			this->free_slots.push_back((uint16_t)slot);
+
+		this->queued = 0;
+		this->inflight = 0;
+
+		return true;
+	}
+
+	void TunBatch::close()
+	{
+		if (!this->ring.is_open())
+			return;
+
+		this->flush();
+
+		// The slots must outlive every write that points into them
+		while (this->inflight)
+		{
+			if (this->ring.submit(1, 1000) < 0)
+				break;
+
+			this->reap();
+		}
+
+		this->ring.close();
+		this->slots.clear();
+		this->slots.shrink_to_fit();
+		this->free_slots.clear();
+	}
+
+	void TunBatch::reap()
+	{
+		struct io_uring_cqe* cqe;
+
+		while ((cqe = this->ring.peek_cqe()))
+		{
+			this->free_slots.push_back((uint16_t)cqe->user_data);
+			this->inflight--;
+			this->ring.seen();
+		}
+	}
+
+	bool TunBatch::write(int tunnel, const Packet& packet)
+	{
+		size_t size = packet.get_size();
+
+		if (size > SLOT_SIZE)
+			return false;
+
+		this->reap();
+
+		if (this->free_slots.empty())
+		{
+			// Every slot is queued or in flight: wait for one write
+			this->flush();
+
+			if (this->inflight && (this->ring.submit(1, -1) >= 0))
+				this->reap();
+
+			if (this->free_slots.empty())
+				return false;
+		}
+
+		struct io_uring_sqe* sqe = this->ring.get_sqe();
+
+		if (!sqe)
+			return false;
+
+		uint16_t slot = this->free_slots.back();
+		uint8_t* data = this->slots.data() + (size_t)slot * SLOT_SIZE;
+
+		this->free_slots.pop_back();
+		memcpy(data, packet.get_buffer(), size);
+
+		sqe->opcode = IORING_OP_WRITE;
+		sqe->fd = tunnel;
+		sqe->addr = (uint64_t)(uintptr_t)data;
+		sqe->len = (uint32_t)size;
+		sqe->user_data = slot;
+
+		this->queued++;
+
+		return true;
+	}
+
+	void TunBatch::flush()
+	{
+		if (this->queued == 0)
+			return;
+
+		int ret = this->ring.submit();
+
+		if (ret > 0)
+		{
+			this->inflight += (uint32_t)ret;
+			this->queued -= (uint32_t)ret;
+		}
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "../common/iouring.hpp"
+#include "../common/packet.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace tunmode
+{
+	/*
+	 * TUN reads on io_uring: reads stay posted on the fd and land in a
+	 * ring of provided buffers, so a wakeup returns every packet queued
+	 * since the last one without a poll() and a read() per packet. A
+	 * single multishot read covers it on Linux 6.7+, earlier kernels keep
+	 * TUNMODE_TUN_BURST plain reads in flight.
+	 *
+	 * Used by the tunnel thread only.
+	 */
+	class TunRing
+	{
+	public:
+		static constexpr uint32_t BUFFER_COUNT = 256;
+		static constexpr uint32_t BUFFER_SIZE  = TUNMODE_BUFFER_SIZE;
+		static constexpr uint16_t GROUP        = 1;
+
+		TunRing();
+
+		/* False where io_uring (or a feature it needs) is not available */
+		bool open(int tunnel);
+		void close();
+		bool is_open() const;
+
+		/* 1 once packets are ready, 0 on timeout, -1 if reading the TUN failed */
+		int    wait(int timeout_ms);
+		/* Copies up to `count` ready packets out (data and size only); returns how many */
+		size_t read(Packet* const* packets, size_t count);
+
+	private:
+		IoUring ring;
+		int  tunnel;
+		bool multishot;
+		bool failed;
+		uint32_t posted;    // reads in flight
+
+		std::vector<uint8_t> buffers;
+
+		void post();
+	};
+
+	/*
+	 * TUN writes of one thread, queued during a batch of events and
+	 * handed to the kernel in one submission by flush(). Packets are
+	 * copied into slots of the batch, which stay busy until their write
+	 * completes.
+	 */
+	class TunBatch
+	{
+	public:
+		static constexpr uint32_t SLOT_COUNT = 64;
+		static constexpr uint32_t SLOT_SIZE  = TUNMODE_BUFFER_SIZE + 100;    // as Buffer
+
+		TunBatch();
+		~TunBatch();
+
+		bool open();
+		/* Waits for the writes in flight */
+		void close();
+
+		/* False if the packet could not be queued; the caller writes it directly */
+		bool write(int tunnel, const Packet& packet);
+		void flush();
+
+	private:
+		IoUring ring;
+		uint32_t queued;      // filled in, not yet submitted
+		uint32_t inflight;    // submitted, not yet completed
+
+		std::vector<uint8_t>  slots;
+		std::vector<uint16_t> free_slots;
+
+		void reap();
+	};
+}
@@ -3,12 +3,18 @@
 #include <tunmode/definitions.hpp>
 
 #include <unistd.h>
+#include <fcntl.h>
 #include <netinet/ip.h>
 
 #include <misc/logger.hpp>
 
 namespace tunmode
 {
+	namespace
+	{
+		thread_local TunBatch* _batch = nullptr;
+	}
+
 	TunSocket::TunSocket()
 	{
 		this->tunnel = 0;
@@ -16,17 +22,56 @@ namespace tunmode
 
 	void TunSocket::close()
 	{
+		this->ring.close();
 		::close(this->tunnel);
 	}
 
 	size_t TunSocket::send(const Packet* packet)
 	{
+		if (_batch && _batch->write(this->tunnel, *packet))
+			return packet->get_size();
+
 		return ::write(this->tunnel, packet->get_buffer(), packet->get_size());
 	}
 
 	size_t TunSocket::recv(Packet* packet)
 	{
 		size_t size = ::read(this->tunnel, packet->get_buffer(), TUNMODE_BUFFER_SIZE);
+		this->prepare(packet, size);
+		return size;
+	}
+
+	size_t TunSocket::recv_burst(Packet* const* packets, size_t count)
+	{
+		size_t received = 0;
+
+		if (this->ring.is_open())
+		{
+			received = this->ring.read(packets, count);
+
+			for (size_t i = 0; i < received; i++)
+				this->prepare(packets[i], packets[i]->get_size());
+
+			return received;
+		}
+
+		while (received < count)
+		{
+			ssize_t size = ::read(this->tunnel, packets[received]->get_buffer(), TUNMODE_BUFFER_SIZE);
+
+			// EAGAIN: queue drained
+			if (size <= 0)
+				break;
+
+			this->prepare(packets[received], (size_t)size);
+			received++;
+		}
+
+		return received;
+	}
+
+	void TunSocket::prepare(Packet* packet, size_t size)
+	{
 		packet->set_size(size);
 		ip* ip_header = (ip*)packet->get_buffer();
 		int proto = ip_header->ip_p;
@@ -44,12 +89,17 @@ namespace tunmode
 			packet->set_protocol(TUNMODE_PROTOCOL_UNKNOWN);
 			break;
 		}
-
-		return size;
 	}
 
 	int TunSocket::poll(int timeout, int& revents)
 	{
+		if (this->ring.is_open())
+		{
+			int ret = this->ring.wait(timeout);
+			revents = (ret == 1) ? POLLIN : 0;
+			return ret;
+		}
+
 		this->fds[0].fd = this->tunnel;
 		this->fds[0].events = POLLIN;
 		this->fds[0].revents = 0;
@@ -60,6 +110,44 @@ namespace tunmode
 		return ret;
 	}
 
+	bool TunSocket::use_uring()
+	{
+		return (this->tunnel > 0) && this->ring.open(this->tunnel);
+	}
+
+	bool TunSocket::batch_writes(bool enabled)
+	{
+		if (!enabled)
+		{
+			delete _batch;
+			_batch = nullptr;
+			return true;
+		}
+
+		if (_batch)
+			return true;
+
+		if (!this->ring.is_open())
+			return false;
+
+		_batch = new TunBatch();
+
+		if (!_batch->open())
+		{
+			delete _batch;
+			_batch = nullptr;
+			return false;
+		}
+
+		return true;
+	}
+
+	void TunSocket::flush_writes()
+	{
+		if (_batch)
+			_batch->flush();
+	}
+
 	int TunSocket::get_tunnel()
 	{
 		return this->tunnel;
@@ -77,6 +165,10 @@ namespace tunmode
 
 	int TunSocket::operator=(const int& tunnel)
 	{
+		// VpnService already hands out a non-blocking fd; burst reads rely on it
+		if (tunnel > 0)
+			fcntl(tunnel, F_SETFL, fcntl(tunnel, F_GETFL, 0) | O_NONBLOCK);
+
 		return this->tunnel = tunnel;
 	}
 }
\ No newline at end of file
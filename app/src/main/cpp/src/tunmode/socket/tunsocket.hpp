@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../common/packet.hpp"
+#include "tunring.hpp"
 
 #include <netinet/in.h>
 #include <poll.h>
@@ -17,9 +18,24 @@ namespace tunmode
 
 		size_t send(const Packet* packet);
 		size_t recv(Packet* packet);
+		/* Reads up to `count` queued packets without blocking, into packets[0..n); returns n */
+		size_t recv_burst(Packet* const* packets, size_t count);
 
 		int    poll(int timeout, int& revents);
 
+		/*
+		 * Moves poll() / recv_burst() onto io_uring for the current
+		 * tunnel; false (and nothing changes) where it is unavailable.
+		 * Undone by close().
+		 */
+		bool   use_uring();
+		/*
+		 * io_uring only: send() from the calling thread queues the packet
+		 * until flush_writes(). Disabling waits for the queued writes.
+		 */
+		bool   batch_writes(bool enabled);
+		static void flush_writes();
+
 		int    get_tunnel();
 
 		void   operator<(const Packet& packet);
@@ -29,5 +45,8 @@ namespace tunmode
 	private:
 		int tunnel;
 		struct pollfd fds[1];
+		TunRing ring;
+
+		void prepare(Packet* packet, size_t size);
 	};
 }
\ No newline at end of file
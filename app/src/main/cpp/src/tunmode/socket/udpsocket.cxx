@@ -15,23 +15,22 @@
 
 namespace tunmode
 {
-	UDPSocket::UDPSocket() : SessionSocket() {}
+	UDPSocket::UDPSocket() : SessionSocket(TUNMODE_UDP_QUEUE) {}
 
-	UDPSocket::~UDPSocket()
-	{
-		SessionSocket::~SessionSocket();
-	}
+	UDPSocket::~UDPSocket() {}
 
-	void UDPSocket::init(Socket* skt)
+	int UDPSocket::init(Socket* skt)
 	{
-		Packet client_packet;
-		client_packet.set_protocol(TUNMODE_PROTOCOL_UDP);
+		PacketRef client_packet;
 		ip* ip_header;
 		udphdr* udp_header;
 
-		*this > client_packet;
+		if (!this->next(client_packet))
+		{
+			return -1;
+		}
 
-		utils::point_headers_udp(&client_packet, &ip_header, &udp_header);
+		utils::point_headers_udp(client_packet.get(), &ip_header, &udp_header);
 
 		this->client_addr = ip_header->ip_src;
 		this->client_port = udp_header->uh_sport;
@@ -41,9 +40,11 @@ namespace tunmode
 		skt->bind(params::net_iface, 0);
 		skt->connect(this->server_addr, this->server_port);
 
-		InBuffer in_buffer = client_packet.get_data();
+		InBuffer in_buffer = client_packet->get_data();
 		Buffer buffer(in_buffer.get_buffer(), in_buffer.get_size());
 		*skt << buffer;
+
+		return 0;
 	}
 
 	size_t UDPSocket::send_tun(Packet& packet)
@@ -54,6 +55,11 @@ namespace tunmode
 
 	size_t UDPSocket::send(const Buffer& buffer)
 	{
+		if (ntohs(this->server_port) == TUNMODE_DNS_PORT)
+		{
+			dns_response_received(this->server_addr, (const uint8_t*)buffer.get_buffer(), buffer.get_size());
+		}
+
 		Packet packet;
 		packet.set_protocol(TUNMODE_PROTOCOL_UDP);
 		ip* ip_header;
@@ -76,16 +82,15 @@ namespace tunmode
 
 	size_t UDPSocket::recv(Buffer& buffer)
 	{
-		Packet packet;
-		packet.set_protocol(TUNMODE_PROTOCOL_UDP);
-		ip* ip_header;
-		udphdr* udp_header;
+		PacketRef packet;
 
-		*this > packet;
+		if (!this->next(packet))
+		{
+			buffer.set_size(0);
+			return -1;
+		}
 
-		// utils::point_headers_udp(&packet, &ip_header, &udp_header);
-
-		InBuffer in_buffer = packet.get_data();
+		InBuffer in_buffer = packet->get_data();
 		buffer(in_buffer.get_buffer(), in_buffer.get_size());
 		return buffer.get_size();
 	}
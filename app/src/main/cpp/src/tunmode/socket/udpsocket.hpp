@@ -16,11 +16,12 @@ namespace tunmode
 		UDPSocket();
 		~UDPSocket() override;
 
-		void init(Socket* skt);
+		/* Takes the first client datagram and sends it upstream; -1 if none is queued */
+		int init(Socket* skt);
 
 		size_t send_tun(Packet& packet) override;
 		size_t send(const Buffer& buffer) override;
-		size_t recv(Buffer& buffer) override;
+		size_t recv(Buffer& buffer) override;    // -1 once no datagram is queued
 
 		void operator<<(const Buffer& buffer) override;
 		void operator>>(Buffer& buffer) override;
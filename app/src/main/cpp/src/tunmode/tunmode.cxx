@@ -2,16 +2,36 @@
 #include <tunmode/socket/sessionsocket.hpp>
 #include <tunmode/manager/tcpmanager.hpp>
 #include <tunmode/manager/udpmanager.hpp>
+#include <tunmode/reactor/reactor.hpp>
+#include <tunmode/filter/ipclassifier.hpp>
+#include <tunmode/filter/ipclassifiereditor.hpp>
+#include <tunmode/filter/flowclassifier.hpp>
+#include <tunmode/filter/domainset.hpp>
+#include <tunmode/filter/patternset.hpp>
+#include <tunmode/filter/rangetable.hpp>
+#include <tunmode/filter/verdictcache.hpp>
+#include <tunmode/filter/ruleset.hpp>
+#include <tunmode/filter/listreader.hpp>
+#include <tunmode/filter/hitcounters.hpp>
+#include <tunmode/filter/routeplanner.hpp>
+#include <tunmode/filter/ratelimiter.hpp>
+#include <tunmode/filter/tempipset.hpp>
+#include <tunmode/dns/dnsmessage.hpp>
+#include <tunmode/common/rcu.hpp>
+#include <tunmode/common/packetpool.hpp>
+#include <tunmode/common/utils.hpp>
 
 #include <future>
+#include <memory>
 #include <string>
+#include <cstring>
 #include <vector>
 #include <thread>
-#include <sstream>
 #include <algorithm>
 
 #include <poll.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <netinet/ip.h>
 #include <arpa/inet.h>
 
@@ -27,99 +47,1063 @@ namespace tunmode
         in_addr dns_address;
         jobject TunModeService_object;
         std::atomic<bool> stop_flag;
+        std::atomic<bool> reject_blocked;    // 拦截时主动拒绝（TCP RST / UDP ICMP）而不是静默丢弃
+        std::atomic<bool> dns_nxdomain;      // 被拦截的域名回 NXDOMAIN，否则回 0.0.0.0 / ::
+        std::atomic<bool> deferred_connect;  // 80/443 先与客户端握手，按 SNI/Host 判定后再连接上游
 
         std::promise<void> tunnel_promise;
         std::atomic<int> thread_count;
 
-        // 存储拦截IP列表
-        std::vector<std::string> blocked_ips;
+        // 当前规则快照（拦截IP/CIDR等），通过RCU无锁发布
+        RcuPointer<RuleSet> rules;
+
+        // 上游 DNS 应答缓存，会话线程写入、隧道线程读取
+        DnsCache dns_cache;
+
+        // 已转发上游、尚未收到应答的 DNS 查询，相同的查询在此等待同一个应答
+        DnsInflight dns_inflight;
+
+        // 被拦截域名解析出的地址，在 TTL 内按 IP 拦截（无锁查询）
+        TempIPSet blocked_answers;
+    }
+
+    // 会话按流哈希分片到各事件循环线程（约每核一个）
+    Reactor reactor;
+    TCPManager tcp_session_manager(&reactor);
+    UDPManager udp_manager(&reactor);
+    VerdictCache verdict_cache;
+
+    // 隧道线程直接读进池中的包，整包交给会话队列，不再拷贝
+    PacketPool packet_pool(TUNMODE_PACKET_POOL);
+
+    // 每个被拦截目的地址每秒最多回 5 个 ICMP（突发 10 个）
+    RateLimiter icmp_limiter(5, 10);
+
+    // 增量更新使用的编辑器，只在 params::rules 的写锁内访问
+    IPClassifierEditor blocked_ips_editor;
+
+    void set_jvm(JavaVM* jvm)
+    {
+        params::jvm = jvm;
+    }
+
+    // 在调用线程上构建完成后再原子替换，隧道线程不会看到半成品
+    void _publish_blocked_ips(IPClassifier* blocked_ips, DomainSet* blocked_domains = nullptr)
+    {
+        std::shared_ptr<const IPClassifier> classifier(blocked_ips);
+        std::shared_ptr<const DomainSet> domains(blocked_domains ? blocked_domains : new DomainSet());
+
+        params::rules.update([&](const RuleSet* current) {
+            RuleSet* next = current ? current->next() : new RuleSet();
+            next->set_blocked_ips(classifier);
+            next->set_blocked_domains(domains);
+            return next;
+        });
+
+        // 域名列表已替换，旧列表解析出的地址不再拦截
+        params::blocked_answers.clear();
+    }
+
+    void initialize(JNIEnv* env, jobject TunModeService_object)
+    {
+        params::tun = 0;
+        SessionSocket::tun = &params::tun;
+        params::TunModeService_object = env->NewGlobalRef(TunModeService_object);
+
+        params::stop_flag.store(false);
+        params::thread_count.store(0);
+
+        // 初始化默认拦截IP
+        IPClassifierBuilder builder;
+        builder.add("192.168.0.102", 13);
+
+        _publish_blocked_ips(builder.build());
+    }
+
+    IPClassifier* _finish_blocked_ips(IPClassifierBuilder& builder, const ListReader& reader) {
+        if (reader.get_invalid_count()) {
+            LOGW_("Invalid blocked IP entries skipped: %d", (int)reader.get_invalid_count());
+        }
+
+        // 如果没有有效的IP，使用默认值
+        if (builder.get_count() == 0) {
+            builder.add("192.168.0.102", 13);
+        }
+
+        return builder.build();
+    }
+
+    // hosts 文件和域名列表里的域名收集到 DomainSet
+    void _collect_domains(ListReader& reader, DomainSetBuilder& domains) {
+        reader.set_domain_callback([&domains](const char* name, size_t length) {
+            domains.add(name, length);
+        });
+    }
+
+    DomainSet* _finish_blocked_domains(DomainSetBuilder& domains, const ListReader& reader) {
+        if (reader.get_domain_count() > domains.get_count()) {
+            LOGW_("Invalid blocked domains skipped: %d", (int)(reader.get_domain_count() - domains.get_count()));
+        }
+
+        size_t pattern_count = domains.get_pattern_count();
+        DomainSet* blocked_domains = domains.build();
+
+        if (blocked_domains && blocked_domains->get_entry_count()) {
+            LOGI_("Blocked domains: %d, %d bytes (%.2f bytes per domain)",
+                  (int)blocked_domains->get_entry_count(), (int)blocked_domains->get_memory_usage(),
+                  blocked_domains->get_bytes_per_entry());
+        }
+
+        // 通配规则合并成 DFA（通常只有一个），状态总数超限时跳过剩余的规则
+        if (blocked_domains && pattern_count) {
+            const PatternSet* patterns = blocked_domains->get_patterns();
+
+            if (patterns) {
+                LOGI_("Blocked domain patterns: %d, %d automata, %d states, %d bytes",
+                      (int)patterns->get_pattern_count(), (int)patterns->get_automaton_count(),
+                      (int)patterns->get_state_count(), (int)patterns->get_memory_usage());
+            }
+
+            if (!patterns || (patterns->get_pattern_count() < pattern_count)) {
+                LOGW_("Blocked domain patterns skipped: %d, automata too large",
+                      (int)(pattern_count - (patterns ? patterns->get_pattern_count() : 0)));
+            }
+        }
+
+        return blocked_domains;
+    }
+
+    IPClassifier* _build_blocked_ips(const std::string& ips_str, DomainSet*& blocked_domains) {
+        IPClassifierBuilder builder;
+        DomainSetBuilder domains;
+        ListReader reader(builder);
+
+        // 支持 a.b.c.d、a.b.c.d/nn、hosts 文件格式、单独的域名和 # 注释
+        _collect_domains(reader, domains);
+        reader.read_buffer(ips_str.data(), ips_str.size());
+
+        blocked_domains = _finish_blocked_domains(domains, reader);
+        return _finish_blocked_ips(builder, reader);
+    }
+
+    // 设置拦截列表
+    void set_blocked_ips(const std::string& ips_str) {
+        DomainSet* blocked_domains;
+        IPClassifier* blocked_ips = _build_blocked_ips(ips_str, blocked_domains);
+        [[maybe_unused]] int count = (int)blocked_ips->get_entry_count();
+
+        _publish_blocked_ips(blocked_ips, blocked_domains);
+
+        LOGI_("Blocked IPs updated, count: %d", count);
+    }
+
+    // 从文件描述符流式读取拦截列表（不经过 Java String）
+    int set_blocked_ips_fd(int fd) {
+        IPClassifierBuilder builder;
+        DomainSetBuilder domains;
+        ListReader reader(builder);
+
+        _collect_domains(reader, domains);
+
+        if (!reader.read_fd(fd)) {
+            LOGW_("Couldn't read blocked IP list from fd %d", fd);
+            return -1;
+        }
+
+        IPClassifier* blocked_ips = _finish_blocked_ips(builder, reader);
+        int count = (int)blocked_ips->get_entry_count();
+
+        _publish_blocked_ips(blocked_ips, _finish_blocked_domains(domains, reader));
+
+        LOGI_("Blocked IPs streamed from fd, lines: %d, count: %d", (int)reader.get_line_count(), count);
+        return count;
+    }
+
+    int set_blocked_ips_path(const char* path) {
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+        if (fd == -1) {
+            return -1;
+        }
+
+        int count = set_blocked_ips_fd(fd);
+        close(fd);
+        return count;
+    }
+
+    // 域名表与规则文件放在一起：<path>.domains
+    std::string _domains_path(const char* path) {
+        return std::string(path) + ".domains";
+    }
+
+    // 编译拦截列表为二进制规则文件
+    bool compile_blocked_ips(const std::string& ips_str, const char* path) {
+        DomainSet* domains;
+        std::unique_ptr<IPClassifier> blocked_ips(_build_blocked_ips(ips_str, domains));
+        std::unique_ptr<DomainSet> blocked_domains(domains);
+
+        if (!blocked_domains || !blocked_domains->save(_domains_path(path).c_str())) {
+            return false;
+        }
+
+        return blocked_ips->save(path);
+    }
+
+    // 以只读 mmap 方式加载已编译的规则文件，不做逐条解析
+    bool load_blocked_ips(const char* path) {
+        IPClassifier* blocked_ips = IPClassifier::load(path);
+
+        if (!blocked_ips) {
+            LOGW_("Couldn't load rule file: %s", path);
+            return false;
+        }
+
+        // 旧版本编译的规则文件没有域名表或格式不同，按空表处理，需重新编译
+        DomainSet* blocked_domains = DomainSet::load(_domains_path(path).c_str());
+        [[maybe_unused]] int count = (int)blocked_ips->get_entry_count();
+        [[maybe_unused]] int domain_count = blocked_domains ? (int)blocked_domains->get_entry_count() : 0;
+        [[maybe_unused]] int pattern_count = (blocked_domains && blocked_domains->get_patterns())
+                                             ? (int)blocked_domains->get_patterns()->get_pattern_count() : 0;
+
+        _publish_blocked_ips(blocked_ips, blocked_domains);
+
+        LOGI_("Blocked IPs loaded from rule file, count: %d, domains: %d, patterns: %d", count, domain_count, pattern_count);
+        return true;
+    }
+
+    // 把 ip2asn 格式的地址段数据库（start end asn country ...）编译为规则文件
+    bool compile_ip_ranges(const char* src, const char* path) {
+        RangeTableBuilder builder;
+
+        if (!builder.read_path(src)) {
+            LOGW_("Couldn't read IP ranges: %s", src);
+            return false;
+        }
+
+        if (builder.get_invalid_count()) {
+            LOGW_("Invalid IP ranges skipped: %d", (int)builder.get_invalid_count());
+        }
+
+        std::unique_ptr<RangeTable> ip_ranges(builder.build());
+        return ip_ranges->save(path);
+    }
+
+    // 以只读 mmap 方式加载地址段数据库
+    bool load_ip_ranges(const char* path) {
+        RangeTable* table = RangeTable::load(path);
+
+        if (!table) {
+            LOGW_("Couldn't load IP ranges file: %s", path);
+            return false;
+        }
+
+        [[maybe_unused]] int count = (int)table->get_range_count();
+        std::shared_ptr<const RangeTable> ip_ranges(table);
+
+        params::rules.update([&](const RuleSet* current) {
+            RuleSet* next = current ? current->next() : new RuleSet();
+            next->set_ip_ranges(ip_ranges);
+            return next;
+        });
+
+        LOGI_("IP ranges loaded, count: %d", count);
+        return true;
+    }
+
+    // 设置要拦截的国家和 ASN，以空白或逗号分隔，例如 "CN RU AS13335"
+    int set_blocked_regions(const std::string& tags_str) {
+        RangeTagSet* tags = new RangeTagSet();
+        int invalid = 0;
+
+        for (size_t pos = 0; pos < tags_str.size();) {
+            size_t first = tags_str.find_first_not_of(" \t\r\n,", pos);
+
+            if (first == std::string::npos) {
+                break;
+            }
+
+            size_t end = tags_str.find_first_of(" \t\r\n,", first);
+
+            if (end == std::string::npos) {
+                end = tags_str.size();
+            }
+
+            if (!tags->add(tags_str.data() + first, end - first)) {
+                invalid++;
+            }
+
+            pos = end;
+        }
+
+        if (invalid) {
+            LOGW_("Invalid regions skipped: %d", invalid);
+        }
+
+        int count = (int)tags->get_count();
+        std::shared_ptr<const RangeTagSet> blocked_tags(tags);
+
+        params::rules.update([&](const RuleSet* current) {
+            RuleSet* next = current ? current->next() : new RuleSet();
+            next->set_blocked_tags(blocked_tags);
+            return next;
+        });
+
+        LOGI_("Blocked regions set, count: %d", count);
+        return count;
+    }
+
+    // 设置五元组规则，每行一条，例如 "block udp to 203.0.113.0/24 port 443 priority 10"
+    int set_flow_rules(const std::string& rules_str) {
+        FlowClassifierBuilder builder;
+        int invalid = 0;
+
+        for (size_t pos = 0; pos < rules_str.size();) {
+            size_t end = rules_str.find('\n', pos);
+
+            if (end == std::string::npos) {
+                end = rules_str.size();
+            }
+
+            const char* line = rules_str.data() + pos;
+            size_t length = end - pos;
+            size_t first = rules_str.find_first_not_of(" \t\r", pos);
+
+            // 跳过空行和注释
+            if (first < end && rules_str[first] != '#' && !builder.add(line, length)) {
+                invalid++;
+            }
+
+            pos = end + 1;
+        }
+
+        if (invalid) {
+            LOGW_("Invalid flow rules skipped: %d", invalid);
+        }
+
+        int count = (int)builder.get_count();
+        std::shared_ptr<const FlowClassifier> flow_rules(builder.build());
+
+        params::rules.update([&](const RuleSet* current) {
+            RuleSet* next = current ? current->next() : new RuleSet();
+            next->set_flow_rules(flow_rules);
+            return next;
+        });
+
+        LOGI_("Flow rules updated, count: %d, tuples: %d", count, (int)flow_rules->get_tuple_count());
+        return count;
+    }
+
+    // 增量添加/删除拦截条目，未变化的表块与上一个快照共享
+    bool update_blocked_ips(const std::string& add_str, const std::string& remove_str) {
+        IPClassifierBuilder add_builder;
+        IPClassifierBuilder remove_builder;
+        ListReader add_reader(add_builder);
+        ListReader remove_reader(remove_builder);
+
+        add_reader.read_buffer(add_str.data(), add_str.size());
+        remove_reader.read_buffer(remove_str.data(), remove_str.size());
+
+        if (add_builder.get_count() == 0 && remove_builder.get_count() == 0) {
+            return false;
+        }
+
+        int count = 0;
+
+        params::rules.update([&](const RuleSet* current) {
+            RuleSet* next = current ? current->next() : new RuleSet();
+            const IPClassifier* base = current ? current->get_blocked_ips() : nullptr;
+            IPClassifier* blocked_ips = base
+                ? blocked_ips_editor.apply(*base, add_builder.get_rules(), remove_builder.get_rules())
+                : blocked_ips_editor.build(add_builder.get_rules());
+
+            count = (int)blocked_ips_editor.get_live_count();
+            next->set_blocked_ips(std::shared_ptr<const IPClassifier>(blocked_ips));
+            return next;
+        });
+
+        LOGI_("Blocked IPs edited, added: %d, removed: %d, count: %d",
+              (int)add_builder.get_count(), (int)remove_builder.get_count(), count);
+        return true;
+    }
+
+    std::string _format_ip(uint32_t addr)
+    {
+        char text[INET_ADDRSTRLEN];
+        in_addr in{htonl(addr)};
+
+        inet_ntop(AF_INET, &in, text, sizeof(text));
+        return text;
+    }
+
+    // 命中统计快照，每行一项：rule/blocked/allowed <地址> <包数> <字节数>
+    std::string get_hit_stats(size_t k)
+    {
+        HitSnapshot snapshot = HitCounters::snapshot(k);
+        std::string stats;
+
+        for (const RuleHits& hits : snapshot.rules) {
+            stats += "rule " + _format_ip(hits.addr) + "/" + std::to_string(hits.prefix) + " "
+                    + std::to_string(hits.packets) + " " + std::to_string(hits.bytes) + "\n";
+        }
+
+        for (const HeavyHitter& hitter : snapshot.blocked) {
+            stats += "blocked " + _format_ip(hitter.addr) + " "
+                    + std::to_string(hitter.packets) + " " + std::to_string(hitter.bytes) + "\n";
+        }
+
+        for (const HeavyHitter& hitter : snapshot.allowed) {
+            stats += "allowed " + _format_ip(hitter.addr) + " "
+                    + std::to_string(hitter.packets) + " " + std::to_string(hitter.bytes) + "\n";
+        }
+
+        if (snapshot.untracked) {
+            stats += "untracked " + std::to_string(snapshot.untracked) + "\n";
+        }
+
+        return stats;
+    }
+
+    // 计算需要导入 TUN 的路由，每行一个 a.b.c.d/nn
+    // allowed_ips 为空时只路由会被拦截的网段；否则路由除白名单外的全部地址
+    // 返回空串时调用方应路由 0.0.0.0/0
+    std::string plan_routes(size_t max_routes, const char* allowed_ips) {
+        std::vector<routeplanner::Route> prefixes;
+        std::vector<routeplanner::Route> routes;
+
+        if (allowed_ips != nullptr) {
+            IPClassifierBuilder builder;
+            ListReader reader(builder);
+            reader.read_buffer(allowed_ips, strlen(allowed_ips));
+
+            for (const IPRule& rule : builder.get_rules()) {
+                prefixes.push_back({rule.addr, rule.prefix});
+            }
+
+            routes = routeplanner::complement(std::move(prefixes), max_routes);
+        } else {
+            {
+                RcuReadGuard guard;
+                const RuleSet* rules = params::rules.get();
+                const IPClassifier* blocked_ips = rules->get_blocked_ips();
+
+                // 五元组规则和国家/ASN 规则拦截的目的地址随规则和地址段数据库变化，
+                // 域名规则（以及按 SNI/Host 检查的延迟连接）拦截的是任意地址，
+                // 路由却只在连接时规划一次：这时不规划，由调用方路由全部流量
+                if (rules->get_flow_rules()->get_rule_count() || !rules->get_blocked_tags()->is_empty()
+                    || !rules->get_blocked_domains()->is_empty()
+                    || params::deferred_connect.load(std::memory_order_relaxed)) {
+                    LOGI_("Routes not planned: flow, region or domain rules or deferred connect in use");
+                    return std::string();
+                }
+
+                for (uint32_t i = 0; i < blocked_ips->get_rule_count(); i++) {
+                    const IPRule& rule = blocked_ips->get_rule(i);
+
+                    if (!blocked_ips->is_removed(i) && !(rule.flags & IPRULE_FILTER)) {
+                        prefixes.push_back({rule.addr, rule.prefix});
+                    }
+                }
+
+                // 过滤器里的主机不在规则表中，单独取出
+                size_t host_count;
+                const uint32_t* hosts = blocked_ips->get_filter_hosts(host_count);
+
+                for (size_t i = 0; i < host_count; i++) {
+                    prefixes.push_back({hosts[i], 32});
+                }
+            }
+
+            routes = routeplanner::cover(std::move(prefixes), max_routes);
+        }
+
+        std::string text;
+
+        for (const routeplanner::Route& route : routes) {
+            text += _format_ip(route.addr) + "/" + std::to_string(route.prefix) + "\n";
+        }
+
+        LOGI_("Routes planned: %d (max %d, %s)", (int)routes.size(), (int)max_routes,
+              allowed_ips != nullptr ? "exclude" : "include");
+        return text;
+    }
+
+    int get_jni_env(JNIEnv** env)
+    {
+        int status = params::jvm->GetEnv((void**)env, JNI_VERSION_1_6);
+
+        if (status == JNI_EDETACHED) {
+            if (params::jvm->AttachCurrentThread(env, nullptr) != 0) {
+                return 2; // Failed to attach
+            }
+            return 1; // Attached, need detach
+        }
+
+        return 0; // Already attached
+    }
+
+    void _thread_start()
+    {
+        params::thread_count++;
+    }
+
+    void _thread_stop()
+    {
+        int val = params::thread_count.fetch_sub(1) - 1;
+
+        if (val == 0)
+        {
+            params::tunnel_promise.set_value();
+        }
+    }
+
+    // 先匹配五元组规则（按优先级），未命中再查拦截列表
+    // 命中时 hit.addr/prefix 返回规则的目的网段，用于命中统计
+    // temporary 表示结果来自会过期的临时地址，不能写入判决缓存
+    // blocked_index 不为空时是批量查好的拦截列表结果，不再重复查表
+    VerdictHit _match(const RuleSet* rules, const Packet& packet, bool& temporary,
+                      const uint32_t* blocked_index = nullptr)
+    {
+        temporary = false;
+
+        if (packet.get_size() < sizeof(ip))
+        {
+            return {VERDICT_NONE, 0, 0};
+        }
+
+        const ip* ip_header = reinterpret_cast<const ip*>(packet.get_buffer());
+        uint32_t dst = ntohl(ip_header->ip_dst.s_addr);
+
+        const FlowClassifier* flow_rules = rules->get_flow_rules();
+
+        if (flow_rules->get_rule_count())
+        {
+            // TunSocket::recv 已把目的端口放进 packet id
+            uint16_t port = ntohs((uint16_t)(packet.get_id() >> 16));
+            uint32_t index = flow_rules->lookup((uint8_t)packet.get_protocol(), ntohl(ip_header->ip_src.s_addr), dst, port);
+
+            if (index != FlowClassifier::NO_MATCH)
+            {
+                const FlowRule& rule = flow_rules->get_rule(index);
+                return {(Verdict)rule.verdict, rule.dst_prefix, rule.dst_addr};
+            }
+        }
+
+        // 使用存储的列表进行拦截检查
+        const IPClassifier* blocked_ips = rules->get_blocked_ips();
+        uint32_t index = blocked_index ? *blocked_index : blocked_ips->lookup(dst);
+
+        if (index != IPClassifier::NO_MATCH)
+        {
+            // 过滤器里的主机共用一条规则，命中的就是目的地址本身
+            const IPRule& rule = blocked_ips->get_rule(index);
+            return {VERDICT_BLOCK, rule.prefix, (rule.flags & IPRULE_FILTER) ? dst : rule.addr};
+        }
+
+        // 按国家/ASN 拦截；结果随流判决缓存，每条流只查一次
+        const RangeTagSet* blocked_tags = rules->get_blocked_tags();
+
+        if (!blocked_tags->is_empty())
+        {
+            const IPRange* range = rules->get_ip_ranges()->lookup(dst);
+
+            if (range && blocked_tags->contains(*range))
+            {
+                return {VERDICT_BLOCK, 32, dst};
+            }
+        }
+
+        // 被拦截域名最近解析出的地址
+        if (params::blocked_answers.contains(dst))
+        {
+            temporary = true;
+            return {VERDICT_BLOCK, 32, dst};
+        }
+
+        return {VERDICT_NONE, 0, 0};
+    }
+
+    VerdictHit _classify(const RuleSet* rules, const Packet& packet, bool& temporary,
+                         const uint32_t* blocked_index = nullptr)
+    {
+        VerdictHit hit = _match(rules, packet, temporary, blocked_index);
+
+        if (hit.verdict != VERDICT_BLOCK)
+        {
+            hit.verdict = VERDICT_ALLOW;
+        }
+
+        return hit;
+    }
+
+    // 批量判定：先一次性查完所有目的地址（各包的缓存未命中相互重叠），再逐包匹配其余规则
+    void _classify_batch(const RuleSet* rules, const Packet* const* packets, size_t count, VerdictHit* hits,
+                         bool* temporary)
+    {
+        uint32_t dsts[TUNMODE_TUN_BURST];
+        uint32_t indexes[TUNMODE_TUN_BURST];
+
+        for (size_t i = 0; i < count; i++)
+        {
+            const ip* ip_header = reinterpret_cast<const ip*>(packets[i]->get_buffer());
+            dsts[i] = (packets[i]->get_size() < sizeof(ip)) ? 0 : ntohl(ip_header->ip_dst.s_addr);
+        }
+
+        rules->get_blocked_ips()->lookup_batch(dsts, indexes, count);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            hits[i] = _classify(rules, *packets[i], temporary[i], &indexes[i]);
+        }
+    }
+
+    // 按判定时命中的规则和目的地址统计，计数在本线程分片内完成
+    void _count_hit(const Packet& packet, const VerdictHit& hit)
+    {
+        if (packet.get_size() < sizeof(ip))
+        {
+            return;
+        }
+
+        const ip* ip_header = reinterpret_cast<const ip*>(packet.get_buffer());
+        uint32_t dst = ntohl(ip_header->ip_dst.s_addr);
+        uint32_t bytes = (uint32_t)packet.get_size();
+
+        if (hit.verdict == VERDICT_BLOCK)
+        {
+            HitCounters::count_block(hit.addr, hit.prefix, dst, bytes);
+        }
+        else
+        {
+            HitCounters::count_allow(dst, bytes);
+        }
+    }
+
+    // 每条流只在首个包（TCP SYN / UDP 首个数据报）时判定一次
+    Verdict _flow_verdict(const Packet& packet)
+    {
+        RcuReadGuard guard;
+        const RuleSet* rules = params::rules.get();
+
+        uint32_t generation = rules->get_generation();
+        VerdictHit hit = verdict_cache.get(packet.get_id(), packet.get_protocol(), generation);
+
+        if (hit.verdict == VERDICT_NONE)
+        {
+            bool temporary;
+            hit = _classify(rules, packet, temporary);
+
+            if (!temporary)
+            {
+                verdict_cache.set(packet.get_id(), packet.get_protocol(), generation, hit);
+            }
+        }
+
+        _count_hit(packet, hit);
+        return hit.verdict;
+    }
+
+    // 一次读到的多个包：缓存未命中的一起判定
+    void _flow_verdicts(const Packet* const* packets, size_t count, Verdict* verdicts)
+    {
+        RcuReadGuard guard;
+        const RuleSet* rules = params::rules.get();
+
+        uint32_t generation = rules->get_generation();
+        const Packet* misses[TUNMODE_TUN_BURST];
+        VerdictHit hits[TUNMODE_TUN_BURST];
+        VerdictHit miss_hits[TUNMODE_TUN_BURST];
+        bool miss_temporary[TUNMODE_TUN_BURST];
+        size_t miss_count = 0;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            const Packet& packet = *packets[i];
+            hits[i] = {VERDICT_ALLOW, 0, 0};
+
+            // 只有 TCP/UDP 需要判定
+            if (packet.get_protocol() == TUNMODE_PROTOCOL_UNKNOWN)
+            {
+                continue;
+            }
+
+            hits[i] = verdict_cache.get(packet.get_id(), packet.get_protocol(), generation);
+
+            if (hits[i].verdict == VERDICT_NONE)
+            {
+                misses[miss_count++] = &packet;
+            }
+        }
+
+        if (miss_count)
+        {
+            _classify_batch(rules, misses, miss_count, miss_hits, miss_temporary);
+        }
+
+        for (size_t i = 0, k = 0; i < count; i++)
+        {
+            const Packet& packet = *packets[i];
+            verdicts[i] = hits[i].verdict;
+
+            if (packet.get_protocol() == TUNMODE_PROTOCOL_UNKNOWN)
+            {
+                continue;
+            }
+
+            if ((k < miss_count) && (misses[k] == &packet))
+            {
+                // 临时地址会过期，每个包重新判定
+                if (!miss_temporary[k])
+                {
+                    verdict_cache.set(packet.get_id(), packet.get_protocol(), generation, miss_hits[k]);
+                }
+
+                hits[i] = miss_hits[k++];
+                verdicts[i] = hits[i].verdict;
+            }
+
+            _count_hit(packet, hits[i]);
+        }
+    }
+
+    // 无状态拒绝：直接经 TUN 回 RST，不建会话、不起线程
+    void _reject_tcp(const Packet& packet)
+    {
+        if (!params::reject_blocked.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+
+        Packet reset;
+
+        if (utils::build_tcp_reset(&packet, &reset))
+        {
+            params::tun < reset;
+        }
+    }
+
+    // 无状态拒绝：回 ICMP 目的不可达（管理禁止），按目的地址限速
+    void _reject_udp(const Packet& packet)
+    {
+        if (!params::reject_blocked.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+
+        const ip* ip_header = reinterpret_cast<const ip*>(packet.get_buffer());
+
+        if (!icmp_limiter.allow(ip_header->ip_dst.s_addr))
+        {
+            return;
+        }
+
+        Packet reply;
+
+        if (utils::build_icmp_unreachable(&packet, &reply, ICMP_PKT_FILTERED))
+        {
+            params::tun < reply;
+        }
+    }
+
+    // 以 DNS 服务器的身份回复 packet 中的查询，返回写应答的位置
+    uint8_t* _dns_reply(const Packet& packet, Packet& reply, size_t& capacity)
+    {
+        reply.set_protocol(TUNMODE_PROTOCOL_UDP);
+        utils::build_udp_packet(&reply);
+
+        ip* ip_header;
+        udphdr* udp_header;
+        ip* query_ip_header;
+        udphdr* query_udp_header;
+
+        utils::point_headers_udp(&reply, &ip_header, &udp_header);
+        utils::point_headers_udp(&packet, &query_ip_header, &query_udp_header);
+
+        ip_header->ip_src = query_ip_header->ip_dst;
+        udp_header->uh_sport = query_udp_header->uh_dport;
+        ip_header->ip_dst = query_ip_header->ip_src;
+        udp_header->uh_dport = query_udp_header->uh_sport;
+
+        capacity = TUNMODE_PACKET_SIZE - reply.get_size();
+        return (uint8_t*)reply.get_data().get_buffer();
+    }
+
+    void _send_dns_reply(Packet& reply, size_t size)
+    {
+        reply.set_size(reply.get_size() + size);
+        utils::finalize_packet_udp(&reply);
+        params::tun < reply;
     }
 
-    TCPManager tcp_session_manager;
-    UDPManager udp_manager;
+    // DNS 拦截：被拦截域名的查询直接回 NXDOMAIN 或 0.0.0.0 / ::
+    bool _sinkhole_dns(const Packet& packet, const uint8_t* query, const dns::Question& question)
+    {
+        {
+            RcuReadGuard guard;
 
-    void set_jvm(JavaVM* jvm)
+            if (!params::rules.get()->get_blocked_domains()->contains(question.name, question.name_length))
+            {
+                return false;
+            }
+        }
+
+        static const uint8_t null_address[16] = {};
+        bool nxdomain = params::dns_nxdomain.load(std::memory_order_relaxed);
+        size_t address_size = 0;
+
+        if (!nxdomain && (question.klass == TUNMODE_DNS_CLASS_IN))
+        {
+            if (question.type == TUNMODE_DNS_TYPE_A)
+            {
+                address_size = 4;
+            }
+            else if (question.type == TUNMODE_DNS_TYPE_AAAA)
+            {
+                address_size = 16;
+            }
+        }
+
+        Packet reply;
+        size_t capacity;
+        uint8_t* answer = _dns_reply(packet, reply, capacity);
+
+        // 其他类型的记录回空应答（NODATA）
+        size_t size = dns::build_answer(query, question,
+                                        nxdomain ? TUNMODE_DNS_RCODE_NXDOMAIN : TUNMODE_DNS_RCODE_NOERROR,
+                                        address_size ? null_address : nullptr, address_size, 60,
+                                        answer, capacity);
+
+        if (size == 0)
+        {
+            return false;
+        }
+
+        _send_dns_reply(reply, size);
+        return true;
+    }
+
+    // 缓存命中时直接应答，TTL 按已缓存的时间递减
+    bool _answer_dns_cached(const Packet& packet, const uint8_t* query, const dns::Question& question)
     {
-        params::jvm = jvm;
+        Packet reply;
+        size_t capacity;
+        uint8_t* answer = _dns_reply(packet, reply, capacity);
+        const ip* ip_header = reinterpret_cast<const ip*>(packet.get_buffer());
+        size_t size = params::dns_cache.lookup(ip_header->ip_dst, query, question, answer, capacity);
+
+        if (size == 0)
+        {
+            return false;
+        }
+
+        _send_dns_reply(reply, size);
+        return true;
     }
 
-    void initialize(JNIEnv* env, jobject TunModeService_object)
+    // DNS 查询在隧道线程内处理：被拦截的域名和缓存命中直接应答，不建会话、不起线程
+    // 返回 false 表示需要照常转发给上游
+    bool _answer_dns(const Packet& packet)
     {
-        params::tun = 0;
-        SessionSocket::tun = &params::tun;
-        params::TunModeService_object = env->NewGlobalRef(TunModeService_object);
+        if (ntohs((uint16_t)(packet.get_id() >> 16)) != TUNMODE_DNS_PORT)
+        {
+            return false;
+        }
 
-        params::stop_flag.store(false);
-        params::thread_count.store(0);
+        InBuffer data = packet.get_data();
+        const uint8_t* query = (const uint8_t*)data.get_buffer();
+        const ip* ip_header = reinterpret_cast<const ip*>(packet.get_buffer());
+        dns::Question question;
 
-        // 初始化默认拦截IP
-        params::blocked_ips.clear();
-        params::blocked_ips.push_back("192.168.0.102");
+        if (!dns::parse_query(query, data.get_size(), question))
+        {
+            return false;
+        }
+
+        return _sinkhole_dns(packet, query, question)
+            || _answer_dns_cached(packet, query, question)
+            || params::dns_inflight.join(ip_header->ip_dst, (const uint8_t*)packet.get_buffer(), packet.get_size(), question);
     }
 
-    // 设置拦截列表
-    void set_blocked_ips(const std::string& ips_str) {
-        params::blocked_ips.clear();
-
-        std::stringstream ss(ips_str);
-        std::string line;
-        while (std::getline(ss, line)) {
-            // 简单处理：去除前后空白
-            size_t start = line.find_first_not_of(" \t\r\n");
-            if (start != std::string::npos) {
-                size_t end = line.find_last_not_of(" \t\r\n");
-                std::string clean_ip = line.substr(start, end - start + 1);
-                if (!clean_ip.empty()) {
-                    params::blocked_ips.push_back(clean_ip);
+    // 上游应答中被拦截的域名（包括 CNAME 链上的）解析出的 IPv4 地址，加入临时拦截表
+    // 应用缓存了地址或绕过本地 DNS 时，域名规则在包层同样生效
+    // 只采信配置的解析服务器，应用自己查询的服务器可以返回任意地址
+    void _snoop_dns(in_addr server, const uint8_t* response, size_t size)
+    {
+        static constexpr uint32_t MIN_TTL = 300;     // 应用常在 TTL 过期后继续使用地址
+        static constexpr uint32_t MAX_TTL = 3600;
+
+        if ((params::dns_address.s_addr == 0) || (server.s_addr != params::dns_address.s_addr))
+        {
+            return;
+        }
+
+        dns::Question question;
+        std::vector<dns::Record> records;
+
+        if (!dns::parse_response(response, size, question) || !dns::parse_records(response, size, question, records))
+        {
+            return;
+        }
+
+        bool blocked;
+
+        {
+            RcuReadGuard guard;
+            const DomainSet* blocked_domains = params::rules.get()->get_blocked_domains();
+
+            if (blocked_domains->is_empty())
+            {
+                return;
+            }
+
+            blocked = blocked_domains->contains(question.name, question.name_length);
+
+            for (size_t i = 0; i < records.size() && !blocked; i++)
+            {
+                const dns::Record& record = records[i];
+                char name[TUNMODE_DNS_MAX_NAME + 1];
+                size_t length;
+
+                if (record.section == 0 && record.type == TUNMODE_DNS_TYPE_CNAME
+                    && dns::read_name(response, size, record.rdata_offset, name, length))
+                {
+                    blocked = blocked_domains->contains(name, length);
                 }
             }
         }
 
-        // 如果没有有效的IP，使用默认值
-        if (params::blocked_ips.empty()) {
-            params::blocked_ips.push_back("192.168.0.102");
+        if (!blocked)
+        {
+            return;
         }
 
-        LOGI_("Blocked IPs updated, count: %d", params::blocked_ips.size());
+        for (const dns::Record& record : records)
+        {
+            if (record.section == 0 && record.type == TUNMODE_DNS_TYPE_A && record.klass == TUNMODE_DNS_CLASS_IN
+                && record.rdata_length == 4)
+            {
+                uint32_t addr;
+                memcpy(&addr, response + record.rdata_offset, 4);
+                addr = ntohl(addr);
+
+                if (addr != 0)
+                {
+                    params::blocked_answers.insert(addr, std::clamp(record.ttl, MIN_TTL, MAX_TTL));
+                }
+            }
+        }
     }
 
-    int get_jni_env(JNIEnv** env)
+    // 上游应答（会话线程中调用）：写入缓存，并分发给等待同一查询的请求方
+    void dns_response_received(in_addr server, const uint8_t* response, size_t size)
     {
-        int status = params::jvm->GetEnv((void**)env, JNI_VERSION_1_6);
+        _snoop_dns(server, response, size);
+        params::dns_cache.insert(server, response, size);
 
-        if (status == JNI_EDETACHED) {
-            if (params::jvm->AttachCurrentThread(env, nullptr) != 0) {
-                return 2; // Failed to attach
+        for (const DnsInflight::Waiter& waiter : params::dns_inflight.complete(server, response, size))
+        {
+            Packet packet;
+            packet(waiter.data(), waiter.size());
+            packet.set_protocol(TUNMODE_PROTOCOL_UDP);
+
+            InBuffer data = packet.get_data();
+            const uint8_t* query = (const uint8_t*)data.get_buffer();
+            dns::Question question;
+
+            if (!dns::parse_query(query, data.get_size(), question))
+            {
+                continue;
             }
-            return 1; // Attached, need detach
-        }
 
-        return 0; // Already attached
+            Packet reply;
+            size_t capacity;
+            uint8_t* answer = _dns_reply(packet, reply, capacity);
+            size_t answer_size = dns::rewrite_answer(response, size, query, question, answer, capacity);
+
+            if (answer_size)
+            {
+                _send_dns_reply(reply, answer_size);
+            }
+        }
     }
 
-    void _thread_start()
+    // 等待超时的查询各自转发给上游
+    void _forward_expired_dns()
     {
-        params::thread_count++;
+        for (const DnsInflight::Waiter& waiter : params::dns_inflight.expire())
+        {
+            Packet* packet = packet_pool.acquire();
+
+            // 包池耗尽时丢弃，客户端会重发查询
+            if (!packet)
+            {
+                continue;
+            }
+
+            (*packet)(waiter.data(), waiter.size());
+            packet->set_protocol(TUNMODE_PROTOCOL_UDP);
+            utils::make_udp_id(packet);
+
+            if (!udp_manager.handle_packet(packet))
+            {
+                PacketPool::release(packet);
+            }
+        }
     }
 
-    void _thread_stop()
+    // 返回 true 表示包已交给会话（所有权随之转移）
+    bool _dispatch(Packet* packet, Verdict verdict)
     {
-        int val = params::thread_count.fetch_sub(1) - 1;
-
-        if (val == 0)
+        switch (packet->get_protocol())
         {
-            params::tunnel_promise.set_value();
+            case TUNMODE_PROTOCOL_TCP:
+                if (verdict == VERDICT_BLOCK)
+                {
+                    _reject_tcp(*packet);
+                    break;
+                }
+
+                return tcp_session_manager.handle_packet(packet);
+
+            case TUNMODE_PROTOCOL_UDP:
+                if (verdict == VERDICT_BLOCK)
+                {
+                    _reject_udp(*packet);
+                    break;
+                }
+
+                if (_answer_dns(*packet))
+                {
+                    break;
+                }
+
+                return udp_manager.handle_packet(packet);
+
+            default:
+                break;
         }
+
+        return false;
     }
 
     void _tunnel_loop()
     {
         _thread_start();
 
+        // TUN 为非阻塞：每次唤醒读空队列（至多 TUNMODE_TUN_BURST 个包）
+        // 包直接读进池中，交给会话的包由会话归还，空出的位置下次再补
+        Packet* burst[TUNMODE_TUN_BURST] = {};
+        Packet spare;
+        Packet* spare_burst[1] = {&spare};
+        Verdict verdicts[TUNMODE_TUN_BURST];
+
         while (!params::stop_flag.load())
         {
+            _forward_expired_dns();
+
+            // 有等待中的 DNS 查询时缩短超时，以便及时转发超时的查询
             int revents = 0;
-            int ret = params::tun.poll(2000, revents);
+            int timeout = params::dns_inflight.is_empty() ? 2000 : (int)DnsInflight::SWEEP_MS;
+            int ret = params::tun.poll(timeout, revents);
 
             if (ret == -1)
             {
@@ -133,46 +1117,45 @@ namespace tunmode
             {
                 if (revents & POLLIN)
                 {
-                    Packet packet;
-                    params::tun > packet;
+                    size_t available = 0;
 
-                    bool drop_packet = false;
-                    if (packet.get_size() >= sizeof(ip))
+                    while ((available < TUNMODE_TUN_BURST)
+                           && (burst[available] || (burst[available] = packet_pool.acquire())))
                     {
-                        const ip* ip_header = reinterpret_cast<const ip*>(packet.get_buffer());
-                        struct in_addr dest_addr;
-                        dest_addr.s_addr = ip_header->ip_dst.s_addr;
-                        char* dest_ip_str = inet_ntoa(dest_addr);
-
-                        // 使用存储的列表进行拦截检查
-                        for (const auto& blocked_ip : params::blocked_ips)
-                        {
-                            if (strcmp(dest_ip_str, blocked_ip.c_str()) == 0)
-                            {
-                                drop_packet = true;
-                                break;
-                            }
-                        }
+                        available++;
                     }
 
-                    if (drop_packet)
+                    // 包池耗尽（会话队列积压）：照常读出 TUN 但丢弃，避免 poll 空转
+                    if (available == 0)
                     {
+                        params::tun.recv_burst(spare_burst, 1);
                         continue;
                     }
 
-                    // 原有逻辑不变
-                    switch (packet.get_protocol())
+                    size_t count = params::tun.recv_burst(burst, available);
+
+                    if (count == 1)
                     {
-                        case TUNMODE_PROTOCOL_TCP:
-                            tcp_session_manager.handle_packet(packet);
-                            break;
+                        Packet& packet = *burst[0];
+                        Verdict verdict = (packet.get_protocol() == TUNMODE_PROTOCOL_UNKNOWN)
+                                          ? VERDICT_ALLOW : _flow_verdict(packet);
 
-                        case TUNMODE_PROTOCOL_UDP:
-                            udp_manager.handle_packet(packet);
-                            break;
+                        if (_dispatch(burst[0], verdict))
+                        {
+                            burst[0] = nullptr;
+                        }
+                    }
+                    else if (count > 1)
+                    {
+                        _flow_verdicts(burst, count, verdicts);
 
-                        default:
-                            break;
+                        for (size_t i = 0; i < count; i++)
+                        {
+                            if (_dispatch(burst[i], verdicts[i]))
+                            {
+                                burst[i] = nullptr;
+                            }
+                        }
                     }
                 }
                 else
@@ -182,18 +1165,46 @@ namespace tunmode
             }
         }
 
+        for (Packet* packet : burst)
+        {
+            if (packet)
+            {
+                PacketPool::release(packet);
+            }
+        }
+
         _thread_stop();
     }
 
     void _run_loops()
     {
+        // 内核支持时 TUN 读写走 io_uring（事件循环批量提交写），否则仍用 poll/read/write
+        params::tun.use_uring();
+
+        // 事件循环起不来时隧道线程立即退出，走正常的关闭流程
+        if (!reactor.start())
+        {
+            LOGW_("Failed to start the session event loops");
+            params::stop_flag.store(true);
+        }
+
         std::thread tunnel_loop_thread(_tunnel_loop);
         tunnel_loop_thread.detach();
     }
 
     void _cleanup()
     {
+        // 隧道线程已退出，不会再有新会话；关闭事件循环后释放剩余会话
+        reactor.stop();
+        tcp_session_manager.clear();
+        udp_manager.clear();
 
+        LOGI_("Dropped on full session queues: %llu UDP datagrams", (unsigned long long)udp_manager.get_dropped());
+
+        // 网络可能已切换，下次开启隧道重新解析
+        params::dns_cache.clear();
+        params::dns_inflight.clear();
+        params::blocked_answers.clear();
     }
 
     void _tunnel_closed()
@@ -262,4 +1273,211 @@ Java_com_matthew_ipblocker_interceptor_activities_MainActivity_setBlockedIPsNati
         tunmode::set_blocked_ips(blocked_ips_str);
         env->ReleaseStringUTFChars(j_blocked_ips, blocked_ips_str);
     }
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_matthew_ipblocker_interceptor_activities_MainActivity_addBlockedIPsNative(
+        JNIEnv* env,
+        jobject thiz,
+        jstring j_blocked_ips) {
+
+    const char* blocked_ips_str = env->GetStringUTFChars(j_blocked_ips, nullptr);
+    bool ok = false;
+
+    if (blocked_ips_str != nullptr) {
+        ok = tunmode::update_blocked_ips(blocked_ips_str, "");
+        env->ReleaseStringUTFChars(j_blocked_ips, blocked_ips_str);
+    }
+
+    return ok ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_matthew_ipblocker_interceptor_activities_MainActivity_removeBlockedIPsNative(
+        JNIEnv* env,
+        jobject thiz,
+        jstring j_blocked_ips) {
+
+    const char* blocked_ips_str = env->GetStringUTFChars(j_blocked_ips, nullptr);
+    bool ok = false;
+
+    if (blocked_ips_str != nullptr) {
+        ok = tunmode::update_blocked_ips("", blocked_ips_str);
+        env->ReleaseStringUTFChars(j_blocked_ips, blocked_ips_str);
+    }
+
+    return ok ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_matthew_ipblocker_interceptor_activities_MainActivity_compileBlockedIPsNative(
+        JNIEnv* env,
+        jobject thiz,
+        jstring j_blocked_ips,
+        jstring j_path) {
+
+    const char* blocked_ips_str = env->GetStringUTFChars(j_blocked_ips, nullptr);
+    const char* path_str = env->GetStringUTFChars(j_path, nullptr);
+    bool ok = false;
+
+    if (blocked_ips_str != nullptr && path_str != nullptr) {
+        ok = tunmode::compile_blocked_ips(blocked_ips_str, path_str);
+    }
+
+    if (blocked_ips_str != nullptr) env->ReleaseStringUTFChars(j_blocked_ips, blocked_ips_str);
+    if (path_str != nullptr) env->ReleaseStringUTFChars(j_path, path_str);
+
+    return ok ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_matthew_ipblocker_interceptor_activities_MainActivity_loadBlockedIPsFileNative(
+        JNIEnv* env,
+        jobject thiz,
+        jstring j_path) {
+
+    const char* path_str = env->GetStringUTFChars(j_path, nullptr);
+    bool ok = false;
+
+    if (path_str != nullptr) {
+        ok = tunmode::load_blocked_ips(path_str);
+        env->ReleaseStringUTFChars(j_path, path_str);
+    }
+
+    return ok ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C" JNIEXPORT jint JNICALL
+Java_com_matthew_ipblocker_interceptor_activities_MainActivity_setBlockedIPsFromFdNative(
+        JNIEnv* env,
+        jobject thiz,
+        jint fd) {
+
+    return tunmode::set_blocked_ips_fd(fd);
+}
+
+extern "C" JNIEXPORT jint JNICALL
+Java_com_matthew_ipblocker_interceptor_activities_MainActivity_setBlockedIPsFromFileNative(
+        JNIEnv* env,
+        jobject thiz,
+        jstring j_path) {
+
+    const char* path_str = env->GetStringUTFChars(j_path, nullptr);
+    int count = -1;
+
+    if (path_str != nullptr) {
+        count = tunmode::set_blocked_ips_path(path_str);
+        env->ReleaseStringUTFChars(j_path, path_str);
+    }
+
+    return count;
+}
+
+extern "C" JNIEXPORT jstring JNICALL
+Java_com_matthew_ipblocker_interceptor_activities_MainActivity_getHitStatsNative(
+        JNIEnv* env,
+        jobject thiz,
+        jint top_k) {
+
+    std::string stats = tunmode::get_hit_stats(top_k > 0 ? (size_t)top_k : tunmode::HitCounters::TOP_K);
+    return env->NewStringUTF(stats.c_str());
+}
+
+extern "C" JNIEXPORT jint JNICALL
+Java_com_matthew_ipblocker_interceptor_activities_MainActivity_setFlowRulesNative(
+        JNIEnv* env,
+        jobject thiz,
+        jstring j_rules) {
+
+    const char* rules_str = env->GetStringUTFChars(j_rules, nullptr);
+    int count = -1;
+
+    if (rules_str != nullptr) {
+        count = tunmode::set_flow_rules(rules_str);
+        env->ReleaseStringUTFChars(j_rules, rules_str);
+    }
+
+    return count;
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_matthew_ipblocker_interceptor_activities_MainActivity_setRejectBlockedNative(
+        JNIEnv* env,
+        jobject thiz,
+        jboolean reject) {
+
+    tunmode::params::reject_blocked.store(reject == JNI_TRUE);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_matthew_ipblocker_interceptor_activities_MainActivity_setDnsNxdomainNative(
+        JNIEnv* env,
+        jobject thiz,
+        jboolean nxdomain) {
+
+    tunmode::params::dns_nxdomain.store(nxdomain == JNI_TRUE);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_matthew_ipblocker_interceptor_activities_MainActivity_setDeferredConnectNative(
+        JNIEnv* env,
+        jobject thiz,
+        jboolean deferred) {
+
+    tunmode::params::deferred_connect.store(deferred == JNI_TRUE);
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_matthew_ipblocker_interceptor_activities_MainActivity_compileIPRangesNative(
+        JNIEnv* env,
+        jobject thiz,
+        jstring j_src,
+        jstring j_path) {
+
+    const char* src_str = env->GetStringUTFChars(j_src, nullptr);
+    const char* path_str = env->GetStringUTFChars(j_path, nullptr);
+    bool ok = false;
+
+    if (src_str != nullptr && path_str != nullptr) {
+        ok = tunmode::compile_ip_ranges(src_str, path_str);
+    }
+
+    if (src_str != nullptr) env->ReleaseStringUTFChars(j_src, src_str);
+    if (path_str != nullptr) env->ReleaseStringUTFChars(j_path, path_str);
+
+    return ok ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_matthew_ipblocker_interceptor_activities_MainActivity_loadIPRangesFileNative(
+        JNIEnv* env,
+        jobject thiz,
+        jstring j_path) {
+
+    const char* path_str = env->GetStringUTFChars(j_path, nullptr);
+    bool ok = false;
+
+    if (path_str != nullptr) {
+        ok = tunmode::load_ip_ranges(path_str);
+        env->ReleaseStringUTFChars(j_path, path_str);
+    }
+
+    return ok ? JNI_TRUE : JNI_FALSE;
+}
+
+extern "C" JNIEXPORT jint JNICALL
+Java_com_matthew_ipblocker_interceptor_activities_MainActivity_setBlockedRegionsNative(
+        JNIEnv* env,
+        jobject thiz,
+        jstring j_regions) {
+
+    const char* regions_str = env->GetStringUTFChars(j_regions, nullptr);
+    int count = -1;
+
+    if (regions_str != nullptr) {
+        count = tunmode::set_blocked_regions(regions_str);
+        env->ReleaseStringUTFChars(j_regions, regions_str);
+    }
+
+    return count;
 }
\ No newline at end of file
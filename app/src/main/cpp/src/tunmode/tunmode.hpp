@@ -1,6 +1,11 @@
 #pragma once
 
 #include "socket/tunsocket.hpp"
+#include "common/rcu.hpp"
+#include "filter/ruleset.hpp"
+#include "dns/dnscache.hpp"
+#include "dns/dnsinflight.hpp"
+#include "filter/tempipset.hpp"
 
 #include <jni.h>
 #include <netinet/in.h>
@@ -16,6 +21,12 @@ namespace tunmode
 		extern in_addr dns_address;
 		extern jobject TunModeService_object;
 		extern std::atomic<bool> stop_flag;
+		extern std::atomic<bool> reject_blocked;
+		extern std::atomic<bool> deferred_connect;
+		extern RcuPointer<RuleSet> rules;
+		extern DnsCache dns_cache;
+		extern DnsInflight dns_inflight;
+		extern TempIPSet blocked_answers;
 	}
 
 	void set_jvm(JavaVM* jvm);
@@ -23,4 +34,6 @@ namespace tunmode
 	int get_jni_env(JNIEnv** env);
 	void open_tunnel();
 	void close_tunnel();
+	std::string plan_routes(size_t max_routes, const char* allowed_ips);
+	void dns_response_received(in_addr server, const uint8_t* response, size_t size);
 }
\ No newline at end of file
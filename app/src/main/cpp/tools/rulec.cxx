@@ -0,0 +1,122 @@
+/*
+ * Offline rule compiler.
+ *
+ * Turns a text list (see ListReader for the accepted syntax) into a
+ * binary rule file that the app maps with IPClassifier::load(), plus
+ * <output.rules>.domains with the host names for DomainSet::load().
+ *
+ * With -r, compiles an IP ranges database (ip2asn-v4.tsv format, see
+ * RangeTableBuilder) into a file for RangeTable::load() instead.
+ *
+ * usage: tunmode_rulec <input.txt> <output.rules>
+ *        tunmode_rulec -r <input.tsv> <output.ranges>
+ */
+
+#include <tunmode/filter/ipclassifier.hpp>
+#include <tunmode/filter/domainset.hpp>
+#include <tunmode/filter/listreader.hpp>
+#include <tunmode/filter/rangetable.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+
+static int compile_ranges(const char* input, const char* output)
+{
+	tunmode::RangeTableBuilder builder;
+
+	if (!builder.read_path(input))
+	{
+		fprintf(stderr, "couldn't read %s\n", input);
+		return 1;
+	}
+
+	size_t lines = builder.get_count();
+	std::unique_ptr<tunmode::RangeTable> table(builder.build());
+
+	if (!table->save(output))
+	{
+		fprintf(stderr, "couldn't write %s\n", output);
+		return 1;
+	}
+
+	printf("%zu ranges, %zu invalid, %zu after merging, %zu bytes of tables\n",
+		lines, builder.get_invalid_count(), table->get_range_count(), table->get_memory_usage());
+
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	if ((argc == 4) && (strcmp(argv[1], "-r") == 0))
+		return compile_ranges(argv[2], argv[3]);
+
+	if (argc != 3)
+	{
+		fprintf(stderr, "usage: %s <input.txt> <output.rules>\n", argv[0]);
+		fprintf(stderr, "       %s -r <input.tsv> <output.ranges>\n", argv[0]);
+		return 2;
+	}
+
+	tunmode::IPClassifierBuilder builder;
+	tunmode::DomainSetBuilder domains;
+	tunmode::ListReader reader(builder);
+
+	reader.set_domain_callback([&domains](const char* name, size_t length) {
+		domains.add(name, length);
+	});
+
+	if (!reader.read_path(argv[1]))
+	{
+		fprintf(stderr, "couldn't read %s\n", argv[1]);
+		return 1;
+	}
+
+	size_t valid_domains = domains.get_count();
+	size_t patterns = domains.get_pattern_count();
+	std::unique_ptr<tunmode::IPClassifier> classifier(builder.build());
+	std::unique_ptr<tunmode::DomainSet> domain_set(domains.build());
+	std::string domains_path = std::string(argv[2]) + ".domains";
+
+	if (!classifier->save(argv[2]))
+	{
+		fprintf(stderr, "couldn't write %s\n", argv[2]);
+		return 1;
+	}
+
+	if (!domain_set || !domain_set->save(domains_path.c_str()))
+	{
+		fprintf(stderr, "couldn't write %s\n", domains_path.c_str());
+		return 1;
+	}
+
+	printf("%zu lines, %zu rules, %zu invalid, %zu bytes of tables\n",
+		reader.get_line_count(), classifier->get_rule_count(), reader.get_invalid_count(),
+		classifier->get_memory_usage());
+
+	if (const tunmode::HostFilter* host_filter = classifier->get_host_filter())
+		printf("%zu hosts in a filter, %zu bytes (%.2f bits per host)\n",
+			host_filter->get_entry_count(), host_filter->get_memory_usage(),
+			host_filter->get_memory_usage() * 8.0 / host_filter->get_entry_count());
+
+	printf("%zu host names, %zu unique, %zu invalid, %zu bytes of tables (%.2f bytes per name)\n",
+		reader.get_domain_count(), domain_set->get_entry_count(), reader.get_domain_count() - valid_domains,
+		domain_set->get_memory_usage(), domain_set->get_bytes_per_entry());
+
+	if (patterns)
+	{
+		const tunmode::PatternSet* pattern_set = domain_set->get_patterns();
+
+		size_t built = pattern_set ? pattern_set->get_pattern_count() : 0;
+
+		if (pattern_set)
+			printf("%zu patterns, %zu DFAs, %zu states, %zu bytes of tables\n",
+				built, pattern_set->get_automaton_count(), pattern_set->get_state_count(), pattern_set->get_memory_usage());
+
+		if (built < patterns)
+			printf("%zu patterns skipped, automata too large\n", patterns - built);
+	}
+
+	return 0;
+}
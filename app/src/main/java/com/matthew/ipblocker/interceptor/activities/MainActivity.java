@@ -12,6 +12,8 @@ import android.view.View;
 
 import android.os.Bundle;
 
+import java.io.File;
+
 import com.matthew.ipblocker.R;
 import com.matthew.ipblocker.interceptor.services.TunModeService;
 
@@ -24,6 +26,19 @@ public class MainActivity extends AppCompatActivity implements TunModeService.Ev
 	private static final String PREFS_NAME = "TunModePrefs";
 	private static final String BLOCKED_IPS_KEY = "blocked_ips";
 	private static final String DEFAULT_BLOCKED_IPS = "192.168.0.102";
+	private static final String BLOCKED_IPS_RULES_FILE = "blocked_ips.rules";
+	// 拦截时主动拒绝连接（TCP RST / ICMP 不可达），而不是静默丢弃；默认静默丢弃
+	private static final boolean REJECT_BLOCKED = false;
+	// 被拦截的域名回 NXDOMAIN；为 false 时回 0.0.0.0 / ::
+	private static final boolean DNS_NXDOMAIN = false;
+	// HTTP/HTTPS 连接先读出 SNI / Host，命中拦截域名则直接 RST，不再连接服务器（默认关闭）
+	// 开启后所有流量都要经过 TUN，TunModeService.planRoutes 的路由规划不再生效
+	private static final boolean DEFERRED_CONNECT = false;
+	// 地址段数据库（ip2asn-v4.tsv 格式），首次使用时编译为 mmap 规则文件
+	private static final String IP_RANGES_SOURCE_FILE = "ip2asn-v4.tsv";
+	private static final String IP_RANGES_RULES_FILE = "ip_ranges.rules";
+	// 按国家代码或 ASN 拦截，以空格或逗号分隔，例如 "CN RU AS13335"；为空时不按地区拦截
+	private static final String BLOCKED_REGIONS = "";
 
 	@Override
 	protected void onCreate(Bundle savedInstanceState) {
@@ -43,8 +58,13 @@ public class MainActivity extends AppCompatActivity implements TunModeService.Ev
 				MainActivity.this.startTunMode(TunModeService.Operation.DISCONNECT);
 			} else if (state.equals(TunModeService.State.DISCONNECTED)) {
 				MainActivity.this.startTunMode(TunModeService.Operation.CONNECT);
-				// 【开启VPN时传递拦截列表】
-				setBlockedIPsToNative();
+				// 【开启VPN时传递拦截列表】已编译的规则文件直接加载
+				loadBlockedIPsToNative();
+				setRejectBlockedNative(REJECT_BLOCKED);
+				setDnsNxdomainNative(DNS_NXDOMAIN);
+				setDeferredConnectNative(DEFERRED_CONNECT);
+				loadIPRangesToNative();
+				setBlockedRegionsNative(BLOCKED_REGIONS);
 			} else {
 				Toast.makeText(this, "Try Again", Toast.LENGTH_SHORT).show();
 			}
@@ -166,14 +186,66 @@ public class MainActivity extends AppCompatActivity implements TunModeService.Ev
 		editor.apply();
 	}
 
+	private String getRulesPath() {
+		return new File(getFilesDir(), BLOCKED_IPS_RULES_FILE).getAbsolutePath();
+	}
+
 	// 【直接传递给Native层】
+	// 先编译为二进制规则文件再以 mmap 方式加载；失败时回退为文本传递
 	private void setBlockedIPsToNative() {
 		String blockedIPs = blocked_ips_edittext.getText().toString().trim();
-		setBlockedIPsNative(blockedIPs);
+		String rulesPath = getRulesPath();
+
+		if (!compileBlockedIPsNative(blockedIPs, rulesPath) || !loadBlockedIPsFileNative(rulesPath)) {
+			setBlockedIPsNative(blockedIPs);
+		}
+	}
+
+	private void loadBlockedIPsToNative() {
+		if (!loadBlockedIPsFileNative(getRulesPath())) {
+			setBlockedIPsToNative();
+		}
+	}
+
+	// 没有已编译的地址段文件时，从数据库源文件编译一次
+	private void loadIPRangesToNative() {
+		String rangesPath = new File(getFilesDir(), IP_RANGES_RULES_FILE).getAbsolutePath();
+
+		if (!loadIPRangesFileNative(rangesPath)) {
+			File source = new File(getFilesDir(), IP_RANGES_SOURCE_FILE);
+
+			if (source.exists() && compileIPRangesNative(source.getAbsolutePath(), rangesPath)) {
+				loadIPRangesFileNative(rangesPath);
+			}
+		}
 	}
 
 	// Native方法声明
 	private native void setBlockedIPsNative(String blockedIPs);
+	private native boolean compileBlockedIPsNative(String blockedIPs, String path);
+	private native boolean loadBlockedIPsFileNative(String path);
+	// 增量添加/删除条目（同样支持 CIDR 与 hosts 格式），只替换受影响的表块
+	private native boolean addBlockedIPsNative(String blockedIPs);
+	private native boolean removeBlockedIPsNative(String blockedIPs);
+	// 大型列表（IP/CIDR/hosts 文件）直接由 Native 层流式读取，返回规则数，失败返回 -1
+	private native int setBlockedIPsFromFdNative(int fd);
+	private native int setBlockedIPsFromFileNative(String path);
+	// 命中统计（按规则与目的地址），每行：rule/blocked/allowed <地址> <包数> <字节数>
+	private native String getHitStatsNative(int topK);
+	// 拦截时主动拒绝（TCP 回 RST，UDP 回 ICMP 不可达），应用一个 RTT 内失败，而不是等待重传/超时
+	private native void setRejectBlockedNative(boolean reject);
+	// 拦截列表中的域名（hosts 文件或每行一个域名）由隧道线程直接应答 DNS 查询
+	private native void setDnsNxdomainNative(boolean nxdomain);
+	// 延迟连接：握手后先查看首个数据段中的 TLS SNI / HTTP Host 再决定是否连接上游
+	private native void setDeferredConnectNative(boolean deferred);
+	// 五元组规则（协议/源/目的网段/目的端口范围 + 优先级），每行一条，返回规则数
+	// 例如 "allow tcp to 10.0.0.0/8 port 22 priority 20"、"block tcp port 25"
+	private native int setFlowRulesNative(String rules);
+	// 地址段数据库：编译（源文件 -> 规则文件）与 mmap 加载
+	private native boolean compileIPRangesNative(String src, String path);
+	private native boolean loadIPRangesFileNative(String path);
+	// 要拦截的国家/ASN，返回有效条目数；每条流只查一次地址段表
+	private native int setBlockedRegionsNative(String regions);
 
 	static {
 		System.loadLibrary("tunmode");
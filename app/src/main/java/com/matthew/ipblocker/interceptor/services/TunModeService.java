@@ -26,6 +26,9 @@ import androidx.core.app.TaskStackBuilder;
 import java.lang.Thread;
 import java.lang.System;
 
+import java.net.InetAddress;
+import java.net.Inet4Address;
+
 import com.matthew.ipblocker.R;
 import com.matthew.ipblocker.TunModeApp;
 
@@ -46,11 +49,33 @@ public class TunModeService extends VpnService {
 	 * to route dns queries over TUN socket. Note that you
 	 * will need to identify and handle query packets yourself!
 	 *
-	 * Set to `null` if you want to use system dns resolver
+	 * Queries routed over TUN are checked against the blocked
+	 * domains; blocked names are answered locally, the rest are
+	 * forwarded to this resolver.
+	 *
+	 * Leave `null` to use the resolver of the underlying network
+	 * (its first IPv4 one). Without one, queries bypass the TUN
+	 * and domain blocking is inactive.
 	 **/
-	// public static final String dnsAddress = "8.8.8.8";
 	public static final String dnsAddress = null;
 
+	/**
+	 * Route planning (opt-in)
+	 *
+	 * Only destinations that can be blocked are routed into the TUN;
+	 * everything else bypasses the userspace proxy. Routes are planned
+	 * when connecting, so rule changes that need new routes take effect
+	 * on the next connect. While flow, region or domain rules are set,
+	 * or connects are deferred to check the host, all traffic is
+	 * routed anyway.
+	 *
+	 * Set `allowedIPs` (IP/CIDR list) to route everything except those
+	 * instead. By default all traffic is routed.
+	 **/
+	public static boolean planRoutes = false;
+	public static String allowedIPs = null;
+	public static final int MAX_ROUTES = 1024;
+
 	public static final String INTENT_EXTRA_OPERATION = "TunModeService_Operation";
 	public static final String NOTIFICATION_CHANNEL = "tun_mode_vpn_service_nc";
 
@@ -190,18 +215,24 @@ public class TunModeService extends VpnService {
 			return;
 		}
 
+		String dnsServer = (TunModeService.dnsAddress != null)
+			? TunModeService.dnsAddress
+			: TunModeService.getNetworkDnsServer(linkProperties);
+
 		TunModeService.setState(State.CONNECTING);
 		this.sendEvent(Event.CONNECTING);
 
 		new Thread(() -> {
 			VpnService.Builder builder = new VpnService.Builder()
 				.addAddress(TunModeService.tunAddress, 32)
-				.addRoute("0.0.0.0", 0)
 				.setMtu(1500);
 
-			if (TunModeService.dnsAddress != null) {
+			TunModeService.addRoutes(builder);
+
+			if (dnsServer != null) {
 				// route dns queries as well
-				builder.addDnsServer(dnsAddress);
+				builder.addDnsServer(dnsServer);
+				builder.addRoute(dnsServer, 32);
 			}
 
 			this.tunnel = builder.establish();
@@ -209,7 +240,7 @@ public class TunModeService extends VpnService {
 			if (this.tunnel != null) {
 				TunModeService.setState(State.CONNECTED);
 				this.sendEvent(Event.CONNECTED);
-				TunModeService.tunnelOpenNative(this.tunnel.detachFd(), networkInterface, dnsAddress);
+				TunModeService.tunnelOpenNative(this.tunnel.detachFd(), networkInterface, dnsServer);
 			} else {
 				TunModeService.setState(State.DISCONNECTED);
 				this.tunnelClosed();
@@ -217,6 +248,39 @@ public class TunModeService extends VpnService {
 		}).start();
 	}
 
+	private static String getNetworkDnsServer(LinkProperties linkProperties) {
+		for (InetAddress address : linkProperties.getDnsServers()) {
+			if (address instanceof Inet4Address) {
+				return address.getHostAddress();
+			}
+		}
+
+		return null;
+	}
+
+	private static void addRoutes(VpnService.Builder builder) {
+		int count = 0;
+
+		if (TunModeService.planRoutes) {
+			String routes = TunModeService.planRoutesNative(TunModeService.MAX_ROUTES, TunModeService.allowedIPs);
+
+			for (String route : routes.split("\n")) {
+				int slash = route.indexOf('/');
+
+				if (slash <= 0) {
+					continue;
+				}
+
+				builder.addRoute(route.substring(0, slash), Integer.parseInt(route.substring(slash + 1)));
+				count++;
+			}
+		}
+
+		if (count == 0) {
+			builder.addRoute("0.0.0.0", 0);
+		}
+	}
+
 	private void disconnect() {
 		if (this.tunnel != null) {
 			TunModeService.setState(State.DISCONNECTING);
@@ -254,4 +318,5 @@ public class TunModeService extends VpnService {
 	private static native void setupNative(Object service);
 	private static native void tunnelOpenNative(int fd, String net_iface, String dns_address);
 	private static native void tunnelCloseNative();
+	private static native String planRoutesNative(int maxRoutes, String allowedIPs);
 }